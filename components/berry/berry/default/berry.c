@@ -76,6 +76,9 @@
     "  -o <file> save bytecode to 'file'\n"                         \
     "  -g        force named globals in VM\n"                       \
     "  -s        force Berry compiler in strict mode\n"             \
+    "  -O        optimize the compiled code (peephole pass and\n"   \
+    "            inlining of small local functions)\n"              \
+    "  -L        compile function bodies on their first call\n"    \
     "  -v        show version information\n"                        \
     "  -h        show help information\n\n"                         \
     "For more information, please see:\n"                           \
@@ -94,6 +97,8 @@
 #define arg_s       (1 << 8)
 #define arg_err     (1 << 9)
 #define arg_m       (1 << 10)
+#define arg_O       (1 << 11)
+#define arg_L       (1 << 12)
 
 struct arg_opts {
     int idx;
@@ -265,6 +270,8 @@ static int parse_arg(struct arg_opts *opt, int argc, char *argv[])
         case 'e': args |= arg_e; break;
         case 'g': args |= arg_g; break;
         case 's': args |= arg_s; break;
+        case 'O': args |= arg_O; break;
+        case 'L': args |= arg_L; break;
         case 'm':
             args |= arg_m;
             opt->modulepath = opt->optarg;
@@ -352,7 +359,7 @@ static int analysis_args(bvm *vm, int argc, char *argv[])
 {
     int args = 0;
     struct arg_opts opt = { 0 };
-    opt.pattern = "m?vhilegsc?o?";
+    opt.pattern = "m?vhilegsOLc?o?";
     args = parse_arg(&opt, argc, argv);
     argc -= opt.idx;
     argv += opt.idx;
@@ -380,6 +387,14 @@ static int analysis_args(bvm *vm, int argc, char *argv[])
         comp_set_strict(vm);    /* compiler in strict mode */
         args &= ~arg_s;
     }
+    if (args & arg_O) {
+        comp_set_optimize(vm);  /* peephole optimiser and inlining in compiler */
+        args &= ~arg_O;
+    }
+    if (args & arg_L) {
+        comp_set_lazy(vm);      /* nested functions are compiled when first called */
+        args &= ~arg_L;
+    }
     if (args & arg_v) {
         be_writestring(FULL_VERSION "\n");
     }
@@ -75,6 +75,45 @@
  **/
 #define BE_VM_OBSERVABILITY_SAMPLING    20
 
+/* Macro: BE_USE_COMPUTED_GOTO
+ * Use direct-threaded dispatch in the VM loop: every instruction
+ * jumps to the handler of the next one through a label table
+ * instead of returning to a shared switch. Requires the "labels
+ * as values" extension (GCC or Clang), ignored otherwise.
+ * Default: 1
+ **/
+#define BE_USE_COMPUTED_GOTO            1
+
+/* Macro: BE_USE_INLINE_CACHE
+ * Cache the resolution of `obj.member` in the instructions that
+ * access instance members by constant name (GETMBR, GETMET and
+ * SETMBR). A hit skips the class member map lookups. Each proto
+ * allocates one cache entry per such instruction the first time
+ * it runs.
+ * Default: 1
+ **/
+#define BE_USE_INLINE_CACHE             1
+
+/* Macro: BE_GLOBAL_CACHE_SIZE
+ * Number of entries of the cache that maps global names to
+ * their slot index, used by named global access (GETNGBL and
+ * SETNGBL) and by be_getglobal(). Must be a power of 2, 0
+ * disables the cache and every access hashes the name.
+ * Default: 64
+ **/
+#define BE_GLOBAL_CACHE_SIZE            64
+
+/* Macro: BE_USE_NAN_BOXING
+ * Store each value in 8 bytes instead of 16: real numbers are
+ * kept as is and the other values are encoded in the NaN space
+ * of a double. Requires 64-bit pointers with 48 significant
+ * bits, BE_INTGER_TYPE 0 and BE_USE_SINGLE_FLOAT 0. Native code
+ * must use the var_*() accessors of be_object.h, the constant
+ * tables are only supported in C (not C++).
+ * Default: 0
+ **/
+#define BE_USE_NAN_BOXING               0
+
 /* Macro: BE_STACK_TOTAL_MAX
  * Set the maximum total stack size.
  * Default: 20000
@@ -95,16 +134,6 @@
  **/
 #define BE_STACK_START                  50
 
-/* Macro: BE_CONST_SEARCH_SIZE
- * Constants in function are limited to 255. However the compiler
- * will look for a maximum of pre-existing constants to avoid
- * performance degradation. This may cause the number of constants
- * to be higher than required.
- * Increase is you need to solidify functions.
- * Default: 50
- **/
-#define BE_CONST_SEARCH_SIZE            50
-
 /* Macro: BE_STACK_FREE_MIN
  * The short string will hold the hash value when the value is
  * true. It may be faster but requires more RAM.
@@ -141,6 +170,15 @@
  **/
 #define BE_USE_BYTECODE_LOADER          1
 
+/* Macro: BE_USE_BYTECODE_CACHE
+ * Keep a compiled copy (.bec) next to each imported script (.be) when
+ * BE_USE_BYTECODE_CACHE is not 0, the copy is used by the next imports
+ * until the source or the compile options change. Only the code compiled
+ * with named globals is cached. Requires the bytecode saver and loader.
+ * Default: 1
+ **/
+#define BE_USE_BYTECODE_CACHE           1
+
 /* Macro: BE_USE_SHARED_LIB
  * Enable shared library  when BE_USE_SHARED_LIB is not 0,
  * otherwise disable the feature.
@@ -170,6 +208,59 @@
  **/
 #define BE_USE_DEBUG_GC                  0
 
+/* Macro: BE_GC_STEP_SIZE
+ * The work done by each step of the incremental GC, counted as one
+ * unit per object or value scanned or swept. The steps are run by
+ * the allocations until the cycle is completed. Set to 0 to complete
+ * each cycle at once.
+ * Default: 100
+ **/
+#define BE_GC_STEP_SIZE                  100
+
+/* Macro: BE_GC_PROMOTE_AGE
+ * The number of minor collections survived by an object before it
+ * is promoted to the old objects, which are only collected by the
+ * major cycles. The minor collections scan the young objects and
+ * the old objects changed since the last major cycle. It can be 1
+ * to 3, set to 0 to disable the generational mode.
+ * Default: 2
+ **/
+#define BE_GC_PROMOTE_AGE                2
+
+/* Macro: BE_GC_NURSERY_SIZE
+ * The number of bytes allocated between two minor collections, or
+ * a quarter of the memory in use if it is larger.
+ * Default: 4096
+ **/
+#define BE_GC_NURSERY_SIZE               4096
+
+/* Macro: BE_GC_HEAP_LIMIT
+ * The target ceiling in bytes of the memory in use, the major cycles
+ * start early enough to stay under it while the live objects leave
+ * room. It can be changed with be_gc_setpace(). 0 for no ceiling.
+ * Default: 0
+ **/
+#define BE_GC_HEAP_LIMIT                 0
+
+/* Macro: BE_GC_CPU_SHARE
+ * The maximum share of the time spent by the GC in percent. The heap
+ * grows by the steprate between two major cycles, or more if the
+ * allocation rate, the survival rate and the time of the last cycles
+ * show the GC would take more time, unless the ceiling is reached.
+ * 0 to only use the steprate.
+ * Default: 25
+ **/
+#define BE_GC_CPU_SHARE                  25
+
+/* Macro: BE_USE_MEM_POOLS
+ * Allocate the blocks of 128 bytes or less in slabs of 1 KB split
+ * by size class, so the small objects do not fragment the heap.
+ * Set to 0 to use the system allocator for all the blocks, e.g.
+ * to find memory errors with a checker.
+ * Default: 1
+ **/
+#define BE_USE_MEM_POOLS                 1
+
 /* Macro: BE_USE_DEBUG_STACK
  * Enable Stack Resize debug mode. At each function call
  * the stack is reallocated at a different memory location
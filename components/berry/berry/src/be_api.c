@@ -70,6 +70,7 @@ static bclass* class_auto_make(bvm *vm, bstring *name, const bnfuncinfo *lib)
         var_setnil(res); /* must be initialized to ensure correct GC */
         c = be_newclass(vm, name, NULL);
         var_setclass(res, c);
+        be_gc_barrier(vm, vm->ntvclass);
         class_init(vm, c, lib); /* bind members */
         return c;
     }
@@ -441,7 +442,11 @@ BERRY_API bbool be_setsuper(bvm *vm, int index)
         bclass *c = var_toobj(v);
         if (!gc_isconst(c)) {
             bclass *super = var_toobj(top);
+#if BE_USE_INLINE_CACHE
+            be_icache_invalidate(vm);
+#endif
             be_class_setsuper(c, super);
+            be_gc_barrier(vm, c);
             return btrue;
         }
     }
@@ -732,6 +737,7 @@ BERRY_API bbool be_setindex(bvm *vm, int index)
     }
     if (dst) {
         var_setval(dst, v);
+        be_gc_barrier(vm, var_togc(o));
         return btrue;
     }
     return bfalse;
@@ -762,6 +768,7 @@ BERRY_API bbool be_setupval(bvm *vm, int index, int pos)
         be_assert(pos >= 0 && pos < nf->nupvals);
         uv = be_ntvclos_upval(nf, pos)->value;
         var_setval(uv, v);
+        be_gc_barriervar(vm, v);
         return btrue;
     }
     return bfalse;
@@ -403,13 +403,39 @@ static int l_module(bvm *vm)
     be_return(vm);
 }
 
-#if BE_USE_SCRIPT_COMPILER
+#if BE_USE_SCRIPT_COMPILER || BE_USE_BYTECODE_LOADER
 static int raise_compile_error(bvm *vm)
 {
     be_pop(vm, 2); /* pop the exception value and message */
     be_throw(vm, BE_EXCEPTION);
     return 0;
 }
+#endif
+
+#if BE_USE_BYTECODE_LOADER
+/* load a bytecode image held by a `bytes` object, the image of a `bytes`
+ * mapped to a fixed memory region is executed in place */
+static int m_compile_bytes(bvm *vm)
+{
+    int res, mapped;
+    size_t len;
+    const void *buf = be_tobytes(vm, 1, &len);
+    be_getmember(vm, 1, ".size");
+    mapped = be_toint(vm, -1) == -2; /* BYTES_SIZE_MAPPED */
+    be_pop(vm, 1);
+    if (mapped) {
+        res = be_mapbytecode(vm, "bytes", buf, len);
+    } else {
+        res = be_loadbytecode(vm, "bytes", buf, len);
+    }
+    if (res == BE_OK) {
+        be_return(vm);
+    }
+    return raise_compile_error(vm);
+}
+#endif
+
+#if BE_USE_SCRIPT_COMPILER
 
 static int m_compile_str(bvm *vm)
 {
@@ -438,6 +464,11 @@ static int m_compile_file(bvm *vm)
 
 static int l_compile(bvm *vm)
 {
+#if BE_USE_BYTECODE_LOADER
+    if (be_top(vm) && be_isbytes(vm, 1)) {
+        return m_compile_bytes(vm);
+    }
+#endif
 #if BE_USE_SCRIPT_COMPILER
     if (be_top(vm) && be_isstring(vm, 1)) {
         if (be_top(vm) >= 2 && be_isstring(vm, 2)) {
@@ -510,6 +541,7 @@ extern const bclass be_class_list;
 extern const bclass be_class_map;
 extern const bclass be_class_range;
 extern const bclass be_class_bytes;
+extern const bclass be_class_strbuilder;
 extern int be_nfunc_open(bvm *vm);
 /* @const_object_info_begin
 vartab m_builtin (scope: local) {
@@ -537,6 +569,7 @@ vartab m_builtin (scope: local) {
     bytes, class(be_class_bytes)
     call, func(l_call)
     bool, func(l_bool)
+    strbuilder, class(be_class_strbuilder)
 }
 @const_object_info_end */
 #include "../generate/be_fixed_m_builtin.h"
@@ -11,6 +11,7 @@
 #include "be_string.h"
 #include "be_class.h"
 #include "be_func.h"
+#include "be_gc.h"
 #include "be_exec.h"
 #include "be_list.h"
 #include "be_map.h"
@@ -18,12 +19,19 @@
 #include "be_sys.h"
 #include "be_var.h"
 #include "be_vm.h"
+#include "be_parser.h"
 #include <string.h>
 
 #define MAGIC_NUMBER1       0xBE
 #define MAGIC_NUMBER2       0xCD
 #define MAGIC_NUMBER3       0xFE
-#define BYTECODE_VERSION    4
+#define BYTECODE_VERSION    10
+#define BYTECODE_VERSION_MIN 7 /* oldest version that can still be loaded */
+#define BYTECODE_STAMP_MIN  9 /* first version with a source stamp */
+#define BYTECODE_ALIGN_MIN  10 /* first version with aligned instructions */
+#define CODE_ALIGN          4 /* alignment of the instructions in the file */
+#define HEADER_SIZE         8
+#define HEADER_CACHED       0x01 /* flag of byte 5: copy kept by the cache */
 
 #define USE_64BIT_INT       (BE_INTGER_TYPE == 2 \
     || BE_INTGER_TYPE == 1 && LONG_MAX == 9223372036854775807L)
@@ -72,14 +80,15 @@ static void save_long(void *fp, uint32_t value)
     be_fwrite(fp, buffer, sizeof(buffer));
 }
 
-static void save_header(void *fp)
+static void save_header(void *fp, int flags)
 {
-    uint8_t buffer[8] = { 0 };
+    uint8_t buffer[HEADER_SIZE] = { 0 };
     buffer[0] = MAGIC_NUMBER1;
     buffer[1] = MAGIC_NUMBER2;
     buffer[2] = MAGIC_NUMBER3;
     buffer[3] = BYTECODE_VERSION;
     buffer[4] = vm_sizeinfo();
+    buffer[5] = (uint8_t)flags;
     be_fwrite(fp, buffer, sizeof(buffer));
 }
 
@@ -191,8 +200,13 @@ static void save_bytecode(bvm *vm, void *fp, bproto *proto)
     int forbid_gbl = comp_is_named_gbl(vm);
     binstruction *code = proto->code, *end;
     save_long(fp, (uint32_t)proto->codesize);
+    if (proto->codesize) { /* pad so that the instructions can be read in place */
+        static const uint8_t padding[CODE_ALIGN] = { 0 };
+        long pos = be_ftell(fp);
+        be_fwrite(fp, padding, (size_t)(-pos & (CODE_ALIGN - 1)));
+    }
     for (end = code + proto->codesize; code < end; ++code) {
-        save_long(fp, (uint32_t)*code);
+        save_long(fp, (uint32_t)be_vm_unquicken(*code));
         if (forbid_gbl) {   /* we are saving only named globals, so make sure we don't save OP_GETGBL or OP_SETGBL */
             if ((uint32_t)*code == OP_GETGBL || (uint32_t)*code == OP_SETGBL) {
                 be_raise(vm, "internal_error", "GETGBL/SETGBL found when saving with named globals");
@@ -233,9 +247,26 @@ static void save_upvals(void *fp, bproto *proto)
     }
 }
 
+static void save_tryranges(void *fp, bproto *proto)
+{
+    btryrange *range = proto->tryranges, *end;
+    save_long(fp, proto->ntryranges); /* try blocks count */
+    if (range) {
+        for (end = range + proto->ntryranges; range < end; ++range) {
+            save_long(fp, range->beginpc);
+            save_long(fp, range->endpc);
+        }
+    }
+}
+
 static void save_proto(bvm *vm, void *fp, bproto *proto)
 {
     if (proto) {
+#if BE_USE_SCRIPT_COMPILER
+        if (proto->varg & BE_VA_LAZY) { /* save the compiled body */
+            be_parser_lazy(vm, proto);
+        }
+#endif
         save_string(fp, proto->name); /* name */
         save_string(fp, proto->source); /* source */
         save_byte(fp, proto->argc); /* argc */
@@ -243,6 +274,7 @@ static void save_proto(bvm *vm, void *fp, bproto *proto)
         save_byte(fp, proto->varg); /* varg */
         save_byte(fp, 0x00); /* reserved */
         save_bytecode(vm, fp, proto); /* bytecode */
+        save_tryranges(fp, proto); /* try blocks table */
         save_constants(vm, fp, proto); /* constant */
         save_proto_table(vm, fp, proto); /* proto table */
         save_upvals(fp, proto); /* upvals description table */
@@ -281,68 +313,143 @@ static void save_global_info(bvm *vm, void *fp)
     }
 }
 
-void be_bytecode_save(bvm *vm, const char *filename, bproto *proto)
+static void save_file(bvm *vm, const char *filename,
+    bproto *proto, const bcodestamp *stamp)
 {
     void *fp = be_fopen(filename, "wb");
     if (fp == NULL) {
         bytecode_error(vm, be_pushfstring(vm,
             "can not open file '%s'.", filename));
     } else {
-        save_header(fp);
+        save_header(fp, stamp ? HEADER_CACHED : 0);
+        save_long(fp, 0); /* the stamp is written when the file is complete */
+        save_long(fp, 0);
         save_global_info(vm, fp);
         save_proto(vm, fp, proto);
+        if (stamp) {
+            be_fseek(fp, HEADER_SIZE);
+            save_long(fp, stamp->size);
+            save_long(fp, stamp->hash);
+        }
         be_fclose(fp);
     }
 }
+
+void be_bytecode_save(bvm *vm, const char *filename, bproto *proto)
+{
+    save_file(vm, filename, proto, NULL);
+}
+
+/* save a copy of the compiled source file identified by `stamp` */
+void be_bytecode_save_stamp(bvm *vm, const char *filename,
+    bproto *proto, const bcodestamp *stamp)
+{
+    save_file(vm, filename, proto, stamp);
+}
 #endif /* BE_USE_BYTECODE_SAVER */
 
 #if BE_USE_BYTECODE_LOADER
-static bbool load_proto(bvm *vm, void *fp, bproto **proto, int info, int version);
+#define LOAD_BUFFER_SIZE    512
+
+/* source of the bytecode being loaded: a block of memory, or a file read
+ * by blocks through `buf` */
+typedef struct {
+    const uint8_t *s, *end; /* bytes not read yet */
+    size_t pos; /* offset of `s` in the bytecode */
+    void *fp; /* NULL when loading from memory */
+    bvm *vm; /* reports a truncated bytecode, when not NULL */
+    bbool inplace; /* the memory outlives the protos, see load_inplace() */
+    uint8_t buf[LOAD_BUFFER_SIZE];
+} bloader;
+
+static bbool load_proto(bvm *vm, bloader *ld, bgcobject *owner, bproto **proto, int info, int version);
+static void load_proto_data(bvm *vm, bloader *ld, bproto *proto, bstring *name, int info, int version);
+
+static void loader_init(bloader *ld, bvm *vm, void *fp, const void *data, size_t size)
+{
+    ld->vm = vm;
+    ld->fp = fp;
+    ld->s = data;
+    ld->end = ld->s + size;
+    ld->pos = 0;
+    ld->inplace = bfalse;
+}
+
+/* read the next block of the file, returns the number of bytes available */
+static size_t loader_fill(bloader *ld)
+{
+    size_t size = 0;
+    if (ld->fp) {
+        size = be_fread(ld->fp, ld->buf, sizeof(ld->buf));
+        ld->s = ld->buf;
+        ld->end = ld->buf + size;
+    }
+    return size;
+}
 
-static uint8_t load_byte(void *fp)
+/* read `size` bytes to `dst`, the bytes after the end of the bytecode
+ * are an error, or are read as 0 when the loader has no VM */
+static void load_block(bloader *ld, void *dst, size_t size)
 {
-    uint8_t buffer[1];
-    if (be_fread(fp, buffer, sizeof(buffer)) == sizeof(buffer)) {
-        return buffer[0];
+    uint8_t *p = dst;
+    while (size) {
+        size_t n = ld->end - ld->s;
+        if (n == 0 && (n = loader_fill(ld)) == 0) {
+            if (ld->vm) {
+                bytecode_error(ld->vm, "unexpected end of bytecode.");
+            }
+            memset(p, 0, size);
+            return;
+        }
+        n = n < size ? n : size;
+        memcpy(p, ld->s, n);
+        ld->s += n;
+        ld->pos += n;
+        p += n;
+        size -= n;
     }
-    return 0;
 }
 
-static uint16_t load_word(void *fp)
+static uint8_t load_byte(bloader *ld)
+{
+    uint8_t buffer[1];
+    load_block(ld, buffer, sizeof(buffer));
+    return buffer[0];
+}
+
+static uint16_t load_word(bloader *ld)
 {
     uint8_t buffer[2];
-    if (be_fread(fp, buffer, sizeof(buffer)) == sizeof(buffer)) {
-        return ((uint16_t)buffer[1] << 8) | buffer[0];
-    }
-    return 0;
+    load_block(ld, buffer, sizeof(buffer));
+    return ((uint16_t)buffer[1] << 8) | buffer[0];
 }
 
-static uint32_t load_long(void *fp)
+static uint32_t load_long(bloader *ld)
 {
     uint8_t buffer[4];
-    if (be_fread(fp, buffer, sizeof(buffer)) == sizeof(buffer)) {
-        return ((uint32_t)buffer[3] << 24)
-            | ((uint32_t)buffer[2] << 16)
-            | ((uint32_t)buffer[1] << 8)
-            | buffer[0];
-    }
-    return 0;
-}
-
-static int load_head(void *fp)
-{
-    int res;
-    uint8_t buffer[8] = { 0 };
-    be_fread(fp, buffer, sizeof(buffer));
-    res = buffer[0] == MAGIC_NUMBER1 &&
-          buffer[1] == MAGIC_NUMBER2 &&
-          buffer[2] == MAGIC_NUMBER3 &&
-          buffer[4] == vm_sizeinfo();
-    if (res) {
-        return buffer[3];
-    } else {
-        return 0;
-    }
+    load_block(ld, buffer, sizeof(buffer));
+    return ((uint32_t)buffer[3] << 24)
+        | ((uint32_t)buffer[2] << 16)
+        | ((uint32_t)buffer[1] << 8)
+        | buffer[0];
+}
+
+/* return the version of the bytecode in the header `buffer`, or 0 if it
+ * was not made for this VM */
+static int load_head_check(const uint8_t *buffer)
+{
+    int res = buffer[0] == MAGIC_NUMBER1 &&
+              buffer[1] == MAGIC_NUMBER2 &&
+              buffer[2] == MAGIC_NUMBER3 &&
+              buffer[4] == vm_sizeinfo();
+    return res ? buffer[3] : 0;
+}
+
+static int load_head(bloader *ld)
+{
+    uint8_t buffer[HEADER_SIZE];
+    load_block(ld, buffer, sizeof(buffer));
+    return load_head_check(buffer);
 }
 
 bbool be_bytecode_check(const char *path)
@@ -361,42 +468,71 @@ bbool be_bytecode_check(const char *path)
     return bfalse;
 }
 
-static bint load_int(void *fp)
+/* read the stamp of `path` if it is a copy kept by the cache and it can
+ * be loaded, returns bfalse for any other file */
+bbool be_bytecode_stamp(const char *path, bcodestamp *stamp)
+{
+    bbool res = bfalse;
+    void *fp = be_fopen(path, "rb");
+    if (fp) {
+        uint8_t buffer[HEADER_SIZE + 8];
+        if (be_fread(fp, buffer, sizeof(buffer)) == sizeof(buffer) &&
+            load_head_check(buffer) >= BYTECODE_STAMP_MIN &&
+            buffer[3] <= BYTECODE_VERSION && (buffer[5] & HEADER_CACHED)) {
+            bloader ld;
+            loader_init(&ld, NULL, NULL, buffer + HEADER_SIZE, 8);
+            stamp->size = load_long(&ld);
+            stamp->hash = load_long(&ld);
+            res = btrue;
+        }
+        be_fclose(fp);
+    }
+    return res;
+}
+
+static bint load_int(bloader *ld)
 {
 #if USE_64BIT_INT
     bint i;
-    i = load_long(fp);
-    i |= (bint)load_long(fp) << 32;
+    i = load_long(ld);
+    i |= (bint)load_long(ld) << 32;
     return i;
 #else
-    return load_long(fp);
+    return load_long(ld);
 #endif
 }
 
-static breal load_real(void *fp)
+static breal load_real(bloader *ld)
 {
 #if BE_USE_SINGLE_FLOAT
     union { breal r; uint32_t i; } u;
-    u.i = load_long(fp);
+    u.i = load_long(ld);
     return u.r;
 #else
     union {
         breal r;
         uint64_t i;
     } u;
-    u.i = load_long(fp);
-    u.i |= (uint64_t)load_long(fp) << 32;
+    u.i = load_long(ld);
+    u.i |= (uint64_t)load_long(ld) << 32;
     return u.r;
 #endif
 }
 
-static bstring* load_string(bvm *vm, void *fp)
+static bstring* load_string(bvm *vm, bloader *ld)
 {
-    uint16_t len = load_word(fp);
+    uint16_t len = load_word(ld);
     if (len > 0) {
         bstring *str;
-        char *buf = be_malloc(vm, len);
-        be_fread(fp, buf, len);
+        char *buf;
+        if (ld->end - ld->s >= len) { /* the whole string is in the buffer */
+            str = be_newstrn(vm, (const char *)ld->s, len);
+            ld->s += len;
+            ld->pos += len;
+            return str;
+        }
+        buf = be_malloc(vm, len);
+        load_block(ld, buf, len);
         str = be_newstrn(vm, buf, len);
         be_free(vm, buf, len);
         return str;
@@ -404,32 +540,40 @@ static bstring* load_string(bvm *vm, void *fp)
     return str_literal(vm, "");
 }
 
-static bstring* cache_string(bvm *vm, void *fp)
+static bstring* cache_string(bvm *vm, bloader *ld)
 {
-    bstring *str = load_string(vm, fp);
+    bstring *str = load_string(vm, ld);
     var_setstr(vm->top, str);
     be_incrtop(vm);
     return str;
 }
 
-static void load_class(bvm *vm, void *fp, bvalue *v, int version)
+/* load a class in the constant `v` of `proto` */
+static void load_class(bvm *vm, bloader *ld, bproto *proto, bvalue *v, int version)
 {
     int nvar, count;
     bclass *c = be_newclass(vm, NULL, NULL);
     var_setclass(v, c);
-    c->name = load_string(vm, fp);
-    nvar = load_long(fp);
-    count = load_long(fp);
+    be_gc_barrier(vm, proto);
+    c->name = load_string(vm, ld);
+    be_gc_barrier(vm, c);
+    nvar = load_long(ld);
+    count = load_long(ld);
     while (count--) { /* load method table */
         bvalue *value;
-        bstring *name = cache_string(vm, fp);
+        bstring *name = cache_string(vm, ld);
+        bstring *pname;
         value = vm->top;
         var_setproto(value, NULL);
         be_incrtop(vm);
-        if (load_proto(vm, fp, (bproto**)&var_toobj(value), -3, version)) {
-            /* actual method */
-            bbool is_method = ((bproto*)var_toobj(value))->varg & BE_VA_METHOD;
-            be_class_method_bind(vm, c, name, var_toobj(value), !is_method);
+        /* if the name is empty, it's a static member so there is no proto */
+        pname = load_string(vm, ld);
+        if (str_len(pname)) {
+            /* actual method, the proto is kept on the stack while it loads */
+            bproto *proto = be_newproto(vm);
+            var_setproto(value, proto);
+            load_proto_data(vm, ld, proto, pname, -3, version);
+            be_class_method_bind(vm, c, name, proto, !(proto->varg & BE_VA_METHOD));
         } else {
             /* no proto, static member set to nil */
             be_class_member_bind(vm, c, name, bfalse);
@@ -437,36 +581,76 @@ static void load_class(bvm *vm, void *fp, bvalue *v, int version)
         be_stackpop(vm, 2); /* pop the cached string and proto */
     }
     for (count = 0; count < nvar; ++count) { /* load member-variable table */
-        bstring *name = cache_string(vm, fp);
+        bstring *name = cache_string(vm, ld);
         be_class_member_bind(vm, c, name, btrue);
         be_stackpop(vm, 1); /* pop the cached string */
     }
 }
 
-static void load_value(bvm *vm, void *fp, bvalue *v, int version)
+static void load_value(bvm *vm, bloader *ld, bproto *proto, bvalue *v, int version)
 {
-    switch (load_byte(fp)) {
-    case BE_INT: var_setint(v, load_int(fp)); break;
-    case BE_REAL: var_setreal(v, load_real(fp)); break;
-    case BE_STRING: var_setstr(v, load_string(vm, fp)); break;
-    case BE_CLASS: load_class(vm, fp, v, version); break;
+    switch (load_byte(ld)) {
+    case BE_INT: var_setint(v, load_int(ld)); break;
+    case BE_REAL: var_setreal(v, load_real(ld)); break;
+    case BE_STRING: var_setstr(v, load_string(vm, ld)); break;
+    case BE_CLASS: load_class(vm, ld, proto, v, version); break;
     default: break;
     }
+    be_gc_barrier(vm, proto);
+}
+
+/* return the `size` instructions at the read position if they can be run
+ * in place: the memory outlives the protos, its words are the instructions
+ * of this VM and no global index must be fixed */
+static binstruction* load_inplace(bvm *vm, bloader *ld, int size, int bcnt, blist *list)
+{
+    static const uint16_t endian = 1;
+    const binstruction *code = (const binstruction *)ld->s, *p;
+    if (!ld->inplace || *(const uint8_t *)&endian != 1
+            || sizeof(binstruction) != 4 || sizeof(btryrange) != 8
+            || ((size_t)ld->s & (CODE_ALIGN - 1)) != 0
+            || (size_t)(ld->end - ld->s) < sizeof(binstruction) * size) {
+        return NULL;
+    }
+    for (p = code; p < code + size; ++p) {
+        binstruction op = IGET_OP(*p);
+        if ((op == OP_GETGBL || op == OP_SETGBL) && IGET_Bx(*p) >= bcnt) {
+            int idx = IGET_Bx(*p);
+            bvalue *name = be_list_at(list, idx - bcnt);
+            if (be_global_find(vm, var_tostr(name)) != idx) {
+                return NULL;
+            }
+        }
+    }
+    ld->s += sizeof(binstruction) * size;
+    ld->pos += sizeof(binstruction) * size;
+    return cast(binstruction*, code); /* never written, see proto_isreadonly() */
 }
 
-static void load_bytecode(bvm *vm, void *fp, bproto *proto, int info)
+static void load_bytecode(bvm *vm, bloader *ld, bproto *proto, int info, int version)
 {
-    int size = (int)load_long(fp);
+    int size = (int)load_long(ld);
     if (size) {
         binstruction *code, *end;
         int bcnt = be_builtin_count(vm);
         blist *list = var_toobj(be_indexof(vm, info));
         be_assert(be_islist(vm, info));
+        if (version >= BYTECODE_ALIGN_MIN) { /* skip the padding */
+            uint8_t padding[CODE_ALIGN];
+            load_block(ld, padding, -ld->pos & (CODE_ALIGN - 1));
+        }
+        code = load_inplace(vm, ld, size, bcnt, list);
+        if (code != NULL) {
+            proto->code = code;
+            proto->codesize = size;
+            gc_setexmark(proto, BE_PROTO_INPLACE);
+            return;
+        }
         proto->code = be_malloc(vm, sizeof(binstruction) * size);
         proto->codesize = size;
         code = proto->code;
         for (end = code + size; code < end; ++code) {
-            binstruction ins = (binstruction)load_long(fp);
+            binstruction ins = (binstruction)load_long(ld);
             binstruction op = IGET_OP(ins);
             /* fix global variable index */
             if (op == OP_GETGBL || op == OP_SETGBL) {
@@ -482,85 +666,120 @@ static void load_bytecode(bvm *vm, void *fp, bproto *proto, int info)
     }
 }
 
-static void load_constant(bvm *vm, void *fp, bproto *proto, int version)
+static void load_constant(bvm *vm, bloader *ld, bproto *proto, int version)
 {
-    int size = (int)load_long(fp); /* nconst */
+    int size = (int)load_long(ld); /* nconst */
     if (size) {
         bvalue *end, *v = be_malloc(vm, sizeof(bvalue) * size);
         memset(v, 0, sizeof(bvalue) * size);
         proto->ktab = v;
         proto->nconst = size;
         for (end = v + size; v < end; ++v) {
-            load_value(vm, fp, v, version);
+            load_value(vm, ld, proto, v, version);
         }
     }
 }
 
-static void load_proto_table(bvm *vm, void *fp, bproto *proto, int info, int version)
+static void load_proto_table(bvm *vm, bloader *ld, bproto *proto, int info, int version)
 {
-    int size = (int)load_long(fp); /* proto count */
+    int size = (int)load_long(ld); /* proto count */
     if (size) {
         bproto **p = be_malloc(vm, sizeof(bproto *) * size);
         memset(p, 0, sizeof(bproto *) * size);
         proto->ptab = p;
         proto->nproto = size;
         while (size--) {
-            load_proto(vm, fp, p++, info, version);
+            load_proto(vm, ld, gc_object(proto), p++, info, version);
         }
     }
 }
 
-static void load_upvals(bvm *vm, void *fp, bproto *proto)
+static void load_upvals(bvm *vm, bloader *ld, bproto *proto)
 {
-    int size = (int)load_byte(fp);
+    int size = (int)load_byte(ld);
     if (size) {
         bupvaldesc *uv, *end;
         proto->upvals = be_malloc(vm, sizeof(bupvaldesc) * size);
         proto->nupvals = (bbyte)size;
         uv = proto->upvals;
         for (end = uv + size; uv < end; ++uv) {
-            uv->instack = load_byte(fp);
-            uv->idx = load_byte(fp);
+            uv->instack = load_byte(ld);
+            uv->idx = load_byte(ld);
         }
     }
 }
 
-static bbool load_proto(bvm *vm, void *fp, bproto **proto, int info, int version)
+static void load_tryranges(bvm *vm, bloader *ld, bproto *proto)
+{
+    int size = (int)load_long(ld);
+    if (size) {
+        btryrange *range, *end;
+        if (gc_exmark(proto) & BE_PROTO_INPLACE) { /* follows the instructions */
+            if ((size_t)(ld->end - ld->s) < sizeof(btryrange) * size) {
+                bytecode_error(vm, "unexpected end of bytecode.");
+            }
+            proto->tryranges = cast(btryrange*, ld->s);
+            proto->ntryranges = size;
+            ld->s += sizeof(btryrange) * size;
+            ld->pos += sizeof(btryrange) * size;
+            return;
+        }
+        proto->tryranges = be_malloc(vm, sizeof(btryrange) * size);
+        proto->ntryranges = size;
+        range = proto->tryranges;
+        for (end = range + size; range < end; ++range) {
+            range->beginpc = (int)load_long(ld);
+            range->endpc = (int)load_long(ld);
+        }
+    }
+}
+
+/* load a proto in the field `proto` of the object `owner` */
+static bbool load_proto(bvm *vm, bloader *ld, bgcobject *owner, bproto **proto, int info, int version)
 {
     /* first load the name */
     /* if empty, it's a static member so don't allocate an actual proto */
-    bstring *name = load_string(vm, fp);
+    bstring *name = load_string(vm, ld);
     if (str_len(name)) {
         *proto = be_newproto(vm);
-        (*proto)->name = name;
-        (*proto)->source = load_string(vm, fp);
-        (*proto)->argc = load_byte(fp);
-        (*proto)->nstack = load_byte(fp);
-        if (version > 1) {
-            (*proto)->varg = load_byte(fp);
-            load_byte(fp); /* discard reserved byte */
-        }
-        load_bytecode(vm, fp, *proto, info);
-        load_constant(vm, fp, *proto, version);
-        load_proto_table(vm, fp, *proto, info, version);
-        load_upvals(vm, fp, *proto);
+        be_gc_barrier(vm, owner);
+        load_proto_data(vm, ld, *proto, name, info, version);
         return btrue;
     }
     return bfalse;  /* no proto read */
 }
 
-void load_global_info(bvm *vm, void *fp)
+/* load everything that follows the name of a proto */
+static void load_proto_data(bvm *vm, bloader *ld, bproto *proto, bstring *name, int info, int version)
+{
+    proto->name = name;
+    proto->source = load_string(vm, ld);
+    be_gc_barrier(vm, proto);
+    proto->argc = load_byte(ld);
+    proto->nstack = load_byte(ld);
+    if (version > 1) {
+        proto->varg = load_byte(ld);
+        load_byte(ld); /* discard reserved byte */
+    }
+    load_bytecode(vm, ld, proto, info, version);
+    load_tryranges(vm, ld, proto);
+    load_constant(vm, ld, proto, version);
+    load_proto_table(vm, ld, proto, info, version);
+    load_upvals(vm, ld, proto);
+}
+
+void load_global_info(bvm *vm, bloader *ld)
 {
     int i;
-    int bcnt = (int)load_long(fp); /* builtin count */
-    int gcnt = (int)load_long(fp); /* global count */
+    int bcnt = (int)load_long(ld); /* builtin count */
+    int gcnt = (int)load_long(ld); /* global count */
     if (bcnt > be_builtin_count(vm)) {
         bytecode_error(vm, be_pushfstring(vm,
             "inconsistent number of builtin objects."));
     }
     be_newlist(vm);
     for (i = 0; i < gcnt; ++i) {
-        bstring *name = cache_string(vm, fp);
+        bstring *name = cache_string(vm, ld);
         be_global_new(vm, name);
         be_data_push(vm, -2); /* push the variable name to list */
         be_stackpop(vm, 1); /* pop the cached string */
@@ -568,29 +787,53 @@ void load_global_info(bvm *vm, void *fp)
     be_global_release_space(vm);
 }
 
+static bclosure* load_closure(bvm *vm, bloader *ld, const char *name)
+{
+    int version = load_head(ld);
+    if (version >= BYTECODE_VERSION_MIN && version <= BYTECODE_VERSION) {
+        bclosure *cl;
+        if (version >= BYTECODE_STAMP_MIN) { /* skip the stamp */
+            load_long(ld);
+            load_long(ld);
+        }
+        cl = be_newclosure(vm, 0);
+        var_setclosure(vm->top, cl);
+        be_stackpush(vm);
+        load_global_info(vm, ld);
+        load_proto(vm, ld, gc_object(cl), &cl->proto, -1, version);
+        be_stackpop(vm, 2); /* pop the closure and list */
+        return cl;
+    }
+    bytecode_error(vm, be_pushfstring(vm,
+        "invalid bytecode version '%s'.", name));
+    return NULL;
+}
+
 bclosure* be_bytecode_load(bvm *vm, const char *filename)
 {
+    bloader ld;
+    bclosure *cl;
     void *fp = be_fopen(filename, "rb");
     if (fp == NULL) {
         bytecode_error(vm, be_pushfstring(vm,
             "can not open file '%s'.", filename));
-    } else {
-        int version = load_head(fp);
-        if (version == BYTECODE_VERSION) {
-            bclosure *cl = be_newclosure(vm, 0);
-            var_setclosure(vm->top, cl);
-            be_stackpush(vm);
-            load_global_info(vm, fp);
-            load_proto(vm, fp, &cl->proto, -1, version);
-            be_stackpop(vm, 2); /* pop the closure and list */
-            be_fclose(fp);
-            return cl;
-        }
-        bytecode_error(vm, be_pushfstring(vm,
-            "invalid bytecode version '%s'.", filename));
     }
-    bytecode_error(vm, be_pushfstring(vm,
-        "invalid bytecode file '%s'.", filename));
-    return NULL;
+    loader_init(&ld, vm, fp, NULL, 0);
+    cl = load_closure(vm, &ld, filename);
+    be_fclose(fp);
+    return cl;
+}
+
+/* load the bytecode in the `size` bytes from `data`, `name` is only used
+ * in the error messages. When `inplace` is set, `data` must be left
+ * unchanged while the loaded functions live: their instructions are then
+ * read from it rather than copied. */
+bclosure* be_bytecode_load_mem(bvm *vm, const char *name,
+    const void *data, size_t size, bbool inplace)
+{
+    bloader ld;
+    loader_init(&ld, vm, NULL, data, size);
+    ld.inplace = inplace;
+    return load_closure(vm, &ld, name);
 }
 #endif /* BE_USE_BYTECODE_LOADER */
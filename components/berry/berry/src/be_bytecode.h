@@ -10,8 +10,19 @@
 
 #include "be_object.h"
 
+/* identity of the source of a bytecode file kept by the cache */
+typedef struct {
+    uint32_t size; /* size of the source file */
+    uint32_t hash; /* hash of the source, compile options and opcodes */
+} bcodestamp;
+
 void be_bytecode_save(bvm *vm, const char *filename, bproto *proto);
+void be_bytecode_save_stamp(bvm *vm, const char *filename,
+    bproto *proto, const bcodestamp *stamp);
 bclosure* be_bytecode_load(bvm *vm, const char *filename);
+bclosure* be_bytecode_load_mem(bvm *vm, const char *name,
+    const void *data, size_t size, bbool inplace);
 bbool be_bytecode_check(const char *path);
+bbool be_bytecode_stamp(const char *path, bcodestamp *stamp);
 
 #endif
@@ -18,6 +18,7 @@
 #define check_members(vm, c)            \
     if (!(c)->members) {                \
         (c)->members = be_map_new(vm);  \
+        be_gc_barrier(vm, c);           \
     }
 
 bclass* be_newclass(bvm *vm, bstring *name, bclass *super)
@@ -60,18 +61,19 @@ int be_class_attribute(bvm *vm, bclass *c, bstring *attr)
 void be_class_member_bind(bvm *vm, bclass *c, bstring *name, bbool var)
 {
     bvalue *attr;
+#if BE_USE_INLINE_CACHE
+    be_icache_invalidate(vm);
+#endif
     set_fixed(name);
     check_members(vm, c);
     attr = be_map_insertstr(vm, c->members, name, NULL);
     restore_fixed(name);
     if (var) {
         /* this is an instance variable so we set it as MT_VARIABLE */
-        attr->v.i = c->nvar++;
-        attr->type = MT_VARIABLE;
+        var_setindex(attr, c->nvar++);
     } else {
         /* this is a static class constant, leave it as BE_NIL */
-        attr->v.i = 0;
-        attr->type = BE_NIL;
+        var_setnil(attr);
     }
 }
 
@@ -79,6 +81,9 @@ void be_class_method_bind(bvm *vm, bclass *c, bstring *name, bproto *p, bbool is
 {
     bclosure *cl;
     bvalue *attr;
+#if BE_USE_INLINE_CACHE
+    be_icache_invalidate(vm);
+#endif
     set_fixed(name);
     check_members(vm, c);
     attr = be_map_insertstr(vm, c->members, name, NULL);
@@ -87,29 +92,37 @@ void be_class_method_bind(bvm *vm, bclass *c, bstring *name, bproto *p, bbool is
     cl = be_newclosure(vm, p->nupvals);
     cl->proto = p;
     var_setclosure(attr, cl);
+    be_gc_barrier(vm, c->members);
     if (is_static) {
         var_markstatic(attr);
+    } else if (!gc_isconst(p)) {
+        p->cls = c; /* `self` is expected to be an instance of `c` */
+        be_gc_barrier(vm, p);
     }
 }
 
 void be_class_native_method_bind(bvm *vm, bclass *c, bstring *name, bntvfunc f)
 {
     bvalue *attr;
+#if BE_USE_INLINE_CACHE
+    be_icache_invalidate(vm);
+#endif
     set_fixed(name);
     check_members(vm, c);
     attr = be_map_insertstr(vm, c->members, name, NULL);
     restore_fixed(name);
-    attr->v.nf = f;
-    attr->type = MT_PRIMMETHOD;
+    var_setntvfunc(attr, f);
 }
 
 void be_class_closure_method_bind(bvm *vm, bclass *c, bstring *name, bclosure *cl)
 {
     bvalue *attr;
+#if BE_USE_INLINE_CACHE
+    be_icache_invalidate(vm);
+#endif
     check_members(vm, c);
     attr = be_map_insertstr(vm, c->members, name, NULL);
-    attr->v.gc = (bgcobject*) cl;
-    attr->type = MT_METHOD;
+    var_setclosure(attr, cl);
 }
 
 /* get the closure method count that need upvalues */
@@ -210,6 +223,7 @@ static binstance* newobject(bvm *vm, bclass *c)
     be_incrtop(vm); /* protect new objects from GC */
     for (c = c->super; c; c = c->super) {  /* initialize one instance object per class and per superclass */
         prev->super = newobjself(vm, c);
+        be_gc_barrier(vm, prev);
         prev->super->sub = prev;  /* link the super/sub classes instances */
         prev = prev->super;
     }
@@ -249,13 +263,58 @@ int be_instance_member_simple(bvm *vm, binstance *instance, bstring *name, bvalu
     be_assert(name != NULL);
     binstance * obj = instance_member(vm, instance, name, dst);
     if (obj && var_type(dst) == MT_VARIABLE) {
-        *dst = obj->members[dst->v.i];
+        *dst = obj->members[var_toidx(dst)];
     }
     type = var_type(dst);
     var_clearstatic(dst);
     return type;
 }
 
+/* Member was not found in the class hierarchy, try virtual members */
+/* Returns the type of the member or BE_NONE if member not found */
+static int instance_member_virtual(bvm *vm, binstance *instance, bstring *name, bvalue *dst)
+{
+    int type;
+    binstance *obj;
+    /* if 'init' does not exist, create a virtual empty constructor */
+    if (strcmp(str(name), "init") == 0) {
+        var_setntvfunc(dst, be_default_init_native_function);
+        return var_primetype(dst);
+    } else {
+        /* get method 'member' */
+        obj = instance_member(vm, instance, str_literal(vm, "member"), vm->top);
+        if (obj && basetype(var_type(vm->top)) == BE_FUNCTION) {
+            bvalue *top = vm->top;
+            /* the call may reallocate the stack, `dst` can be on it */
+            bbool onstack = dst >= vm->stack && dst < vm->stacktop;
+            ptrdiff_t dstoff = dst - vm->stack;
+            var_setinstance(&top[1], instance);
+            var_setstr(&top[2], name);
+            vm->top += 3;   /* prevent gc collection results */
+            be_dofunc(vm, top, 2); /* call method 'member' */
+            vm->top -= 3;
+            if (onstack) {
+                dst = vm->stack + dstoff;
+            }
+            *dst = *vm->top;   /* copy result to R(A) */
+            if (obj && var_type(dst) == MT_VARIABLE) {
+                *dst = obj->members[var_toidx(dst)];
+            }
+            type = var_type(dst);
+            if (type == BE_MODULE) {
+                /* check if the module is named `undefined` */
+                bmodule *mod = var_toobj(dst);
+                if (strcmp(be_module_name(mod), "undefined") == 0) {
+                    return BE_NONE;     /* if the return value is module `undefined`, consider it is an error */
+                }
+            }
+            var_clearstatic(dst);
+            return type;
+        }
+    }
+    return BE_NONE;
+}
+
 /* Find instance member by name and copy value to `dst` */
 /* Input: none of `obj`, `name` and `dst` may not be NULL */
 /* Returns the type of the member or BE_NONE if member not found */
@@ -266,47 +325,70 @@ int be_instance_member(bvm *vm, binstance *instance, bstring *name, bvalue *dst)
     be_assert(name != NULL);
     binstance *obj = instance_member(vm, instance, name, dst);
     if (obj && var_type(dst) == MT_VARIABLE) {
-        *dst = obj->members[dst->v.i];
+        *dst = obj->members[var_toidx(dst)];
     }
     type = var_type(dst);
     if (obj) {
         var_clearstatic(dst);
         return type;
-    } else {  /* if no method found, try virtual */
-        /* if 'init' does not exist, create a virtual empty constructor */
-        if (strcmp(str(name), "init") == 0) {
-            var_setntvfunc(dst, be_default_init_native_function);
-            return var_primetype(dst);
-        } else {
-            /* get method 'member' */
-            obj = instance_member(vm, instance, str_literal(vm, "member"), vm->top);
-            if (obj && basetype(var_type(vm->top)) == BE_FUNCTION) {
-                bvalue *top = vm->top;
-                var_setinstance(&top[1], instance);
-                var_setstr(&top[2], name);
-                vm->top += 3;   /* prevent gc collection results */
-                be_dofunc(vm, top, 2); /* call method 'member' */
-                vm->top -= 3;
-                *dst = *vm->top;   /* copy result to R(A) */
-                if (obj && var_type(dst) == MT_VARIABLE) {
-                    *dst = obj->members[dst->v.i];
-                }
-                type = var_type(dst);
-                if (type == BE_MODULE) {
-                    /* check if the module is named `undefined` */
-                    bmodule *mod = var_toobj(dst);
-                    if (strcmp(be_module_name(mod), "undefined") == 0) {
-                        return BE_NONE;     /* if the return value is module `undefined`, consider it is an error */
-                    }
-                }
-                    var_clearstatic(dst);
-                    return type;
-            }
+    }
+    return instance_member_virtual(vm, instance, name, dst);
+}
+
+#if BE_USE_INLINE_CACHE
+/* Look up the inline cache, returns the (super-)instance owning the member or NULL on miss */
+static binstance* icache_lookup(bvm *vm, bicache *ic, binstance *obj)
+{
+    if (ic->cls == obj->_class && ic->epoch == vm->icepoch) {
+        int depth = ic->depth;
+        while (depth-- && obj) {
+            obj = obj->super;
+        }
+        /* an instance created before `setsuper` may have a different hierarchy */
+        if (obj && obj->_class == ic->owner) {
+            return obj;
         }
     }
-    return BE_NONE;
+    return NULL;
 }
 
+/* Fill the inline cache after a successful lookup of raw member `v` in `owner` */
+static void icache_fill(bvm *vm, bicache *ic, binstance *obj, binstance *owner, bvalue *v)
+{
+    bbyte depth = 0;
+    for (ic->cls = obj->_class; obj != owner; obj = obj->super) {
+        ++depth;
+    }
+    ic->owner = owner->_class;
+    ic->epoch = vm->icepoch;
+    ic->depth = depth;
+    ic->value = *v;
+}
+
+/* Same as `be_instance_member()` but resolves the member through the inline cache `ic` */
+int be_instance_member_cached(bvm *vm, bicache *ic, binstance *instance, bstring *name, bvalue *dst)
+{
+    int type;
+    binstance *obj = icache_lookup(vm, ic, instance);
+    if (obj) { /* cache hit, no map lookup */
+        *dst = ic->value;
+    } else {
+        be_assert(name != NULL);
+        obj = instance_member(vm, instance, name, dst);
+        if (!obj) {
+            return instance_member_virtual(vm, instance, name, dst);
+        }
+        icache_fill(vm, ic, instance, obj, dst);
+    }
+    if (var_type(dst) == MT_VARIABLE) {
+        *dst = obj->members[var_toidx(dst)];
+    }
+    type = var_type(dst);
+    var_clearstatic(dst);
+    return type;
+}
+#endif
+
 int be_class_member(bvm *vm, bclass *obj, bstring *name, bvalue *dst)
 {
     int type;
@@ -324,11 +406,12 @@ bbool be_instance_setmember(bvm *vm, binstance *o, bstring *name, bvalue *src)
     binstance * obj = instance_member(vm, o, name, &v);
     if (obj && var_istype(&v, MT_VARIABLE)) {
         obj->members[var_toint(&v)] = *src;
+        be_gc_barrier(vm, obj);
         return btrue;
     } else {
         obj = instance_member(vm, o, str_literal(vm, "setmember"), &v);
         if (obj && var_type(&v) == MT_VARIABLE) {
-            v = obj->members[v.v.i];
+            v = obj->members[var_toidx(&v)];
         }
         if (var_basetype(&v) == BE_FUNCTION) {
             bvalue *top = vm->top;
@@ -359,6 +442,30 @@ bbool be_instance_setmember(bvm *vm, binstance *o, bstring *name, bvalue *src)
     return bfalse;
 }
 
+#if BE_USE_INLINE_CACHE
+/* Same as `be_instance_setmember()` but resolves instance variables through the inline cache `ic` */
+bbool be_instance_setmember_cached(bvm *vm, bicache *ic, binstance *o, bstring *name, bvalue *src)
+{
+    bvalue v;
+    binstance *obj = icache_lookup(vm, ic, o);
+    if (obj) { /* cache hit, no map lookup */
+        v = ic->value;
+    } else {
+        be_assert(name != NULL);
+        obj = instance_member(vm, o, name, &v);
+        if (obj) {
+            icache_fill(vm, ic, o, obj, &v);
+        }
+    }
+    if (obj && var_istype(&v, MT_VARIABLE)) {
+        obj->members[var_toint(&v)] = *src;
+        be_gc_barrier(vm, obj);
+        return btrue;
+    }
+    return be_instance_setmember(vm, o, name, src); /* try virtual setter */
+}
+#endif
+
 bbool be_class_setmember(bvm *vm, bclass *o, bstring *name, bvalue *src)
 {
     bvalue v;
@@ -366,6 +473,9 @@ bbool be_class_setmember(bvm *vm, bclass *o, bstring *name, bvalue *src)
     if (!gc_isconst(o)) {
         bclass * obj = class_member(vm, o, name, &v);
         if (obj && !var_istype(&v, MT_VARIABLE)) {
+#if BE_USE_INLINE_CACHE
+            be_icache_invalidate(vm);
+#endif
             be_map_insertstr(vm, obj->members, name, src);
             return btrue;
         }
@@ -64,5 +64,9 @@ bbool be_class_newobj(bvm *vm, bclass *c, int pos, int argc, int mode);
 int be_instance_member_simple(bvm *vm, binstance *obj, bstring *name, bvalue *dst);
 int be_instance_member(bvm *vm, binstance *obj, bstring *name, bvalue *dst);
 bbool be_instance_setmember(bvm *vm, binstance *obj, bstring *name, bvalue *src);
+#if BE_USE_INLINE_CACHE
+int be_instance_member_cached(bvm *vm, bicache *ic, binstance *obj, bstring *name, bvalue *dst);
+bbool be_instance_setmember_cached(bvm *vm, bicache *ic, binstance *obj, bstring *name, bvalue *src);
+#endif
 
 #endif
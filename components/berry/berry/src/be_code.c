@@ -10,10 +10,16 @@
 #include "be_parser.h"
 #include "be_lexer.h"
 #include "be_vector.h"
+#include "be_mem.h"
 #include "be_list.h"
+#include "be_map.h"
 #include "be_var.h"
+#include "be_class.h"
 #include "be_exec.h"
 #include "be_vm.h"
+#include "be_gc.h"
+#include "be_strlib.h"
+#include <string.h>
 
 #define NOT_MASK                (1 << 0)
 #define NOT_EXPR                (1 << 1)
@@ -30,10 +36,16 @@
 #define code_call(f, a, b)      codeABC(f, OP_CALL, a, b, 0)
 #define code_getmbr(f, a, b, c) codeABC(f, OP_GETMBR, a, b, c)
 #define jumpboolop(e, b)        ((b) != notmask(e) ? OP_JMPT : OP_JMPF)
+#define value2real(v)           (var_isreal(v) ? var_toreal(v) : cast(breal, var_toint(v)))
+#define isjumpop(op)            ((op) == OP_JMP || (op) == OP_JMPT || (op) == OP_JMPF || \
+                                 (op) == OP_EXBLK || (op) == OP_FORLOOP)
+/* LDBOOL with C set and CATCH may skip the next instruction */
+#define isskipop(i)             ((IGET_OP(i) == OP_LDBOOL && IGET_RKC(i)) || IGET_OP(i) == OP_CATCH)
 
 #if BE_USE_SCRIPT_COMPILER
 
 static int var2reg(bfuncinfo *finfo, bexpdesc *e, int dst);
+static void discard_calls(bfuncinfo *finfo, int pc);
 
 #if BE_DEBUG_RUNTIME_INFO
 static void codelineinfo(bfuncinfo *finfo)
@@ -195,9 +207,15 @@ void be_code_jumpto(bfuncinfo *finfo, int dst)
     be_code_patchlist(finfo, be_code_jump(finfo), dst);
 }
 
-void be_code_jumpbool(bfuncinfo *finfo, bexpdesc *e, int jture)
+/* `cond` is true when `e` is only a condition: a literal whose truth value
+ * never takes the jump needs no test. The value of `&&` and `||` is made a
+ * bool by the jump lists, so their left operand always keeps its test. */
+static void jumpbool(bfuncinfo *finfo, bexpdesc *e, int jture, bbool cond)
 {
-    int pc = appendjump(finfo, jumpboolop(e, jture), e);
+    int pc = NO_JUMP;
+    if (!cond || be_code_constcond(e) != !jture) {
+        pc = appendjump(finfo, jumpboolop(e, jture), e);
+    }
     be_code_conjump(finfo, jture ? &e->t : &e->f, pc);
     be_code_patchjump(finfo, jture ? e->f : e->t);
     free_expreg(finfo, e);
@@ -205,6 +223,28 @@ void be_code_jumpbool(bfuncinfo *finfo, bexpdesc *e, int jture)
     e->not = 0;
 }
 
+void be_code_jumpbool(bfuncinfo *finfo, bexpdesc *e, int jture)
+{
+    jumpbool(finfo, e, jture, btrue);
+}
+
+/* Truth value of a condition known at compile time: 1 if it is always true,
+ * 0 if it is always false and -1 if it is only known at run time */
+int be_code_constcond(bexpdesc *e)
+{
+    if (hasjump(e)) {
+        return -1;
+    }
+    switch (e->type) {
+    case ETNIL: return 0;
+    case ETBOOL: case ETINT: return e->v.i != 0;
+    case ETREAL: return e->v.r != cast(breal, 0);
+    case ETSTRING: return str_len(e->v.s) != 0;
+    case ETPROTO: return 1;
+    default: return -1;
+    }
+}
+
 /* connect jump */
 void be_code_conjump(bfuncinfo *finfo, int *list, int jmp)
 {
@@ -247,69 +287,52 @@ static int newconst(bfuncinfo *finfo, bvalue *k)
     if (k == NULL) {
         var_setnil(&finfo->proto->ktab[idx]);
     }
+    be_gc_barrier(finfo->lexer->vm, finfo->proto);
     return idx;
 }
 
 /* Find constant by value and return constant number, or -1 if constant does not exist */
-/* The search is linear and limited to BE_CONST_SEARCH_SIZE elements for performance reasons */
-static int findconst(bfuncinfo *finfo, bexpdesc *e)
-{
-    int i, count = be_vector_count(&finfo->kvec);
-    /* if the constant table is too large, the lookup
-     * operation will become very time consuming.
-     * so only search the constant table for the
-     * previous value.
-     **/
-    count = count < BE_CONST_SEARCH_SIZE ? count : BE_CONST_SEARCH_SIZE;
-    for (i = 0; i < count; ++i) {
-        bvalue *k = be_vector_at(&finfo->kvec, i);
-        switch (e->type) {
-        case ETINT:
-            if (var_isint(k) && k->v.i == e->v.i) {
-                return i;
-            }
-            break;
-        case ETREAL:
-            if (var_isreal(k) && k->v.r == e->v.r) {
-                return i;
-            }
-            break;
-        case ETSTRING:
-            if (var_isstr(k) && be_eqstr(k->v.p, e->v.s)) {
-                return i;
-            }
-            break;
-        default:
-            break;
-        }
+/* The constants are indexed by value in `finfo->kmap`, so each one is only added once */
+static int findconst(bfuncinfo *finfo, bvalue *k)
+{
+    bvalue *v = be_map_find(finfo->lexer->vm, finfo->kmap, k);
+    return v ? var_toidx(v) : -1;
+}
+
+/* Return the number of the constant `k`, which is added if it does not exist yet */
+static int kindex(bfuncinfo *finfo, bvalue *k)
+{
+    int idx = findconst(finfo, k); /* does the constant already exist? */
+    if (idx == -1) { /* if not add it */
+        bvalue v;
+        idx = newconst(finfo, k);  /* create new constant */
+        var_setint(&v, idx);
+        be_map_insert(finfo->lexer->vm, finfo->kmap, k, &v);
     }
-    return -1;
+    return idx;
 }
 
 /* convert expdesc to constant and return kreg index (either constant kindex or register number) */
 static int exp2const(bfuncinfo *finfo, bexpdesc *e)
 {
-    int idx = findconst(finfo, e); /* does the constant already exist? */
-    if (idx == -1) { /* if not add it */
-        bvalue k;
-        switch (e->type) {
-        case ETINT:
-            k.type = BE_INT;
-            k.v.i = e->v.i;
-            break;
-        case ETREAL:
-            k.type = BE_REAL;
-            k.v.r = e->v.r;
-            break;
-        case ETSTRING:
-            k.type = BE_STRING;
-            k.v.s = e->v.s;
-            break;
-        default: /* all other values are filled later */
-            break;
-        }
-        idx = newconst(finfo, &k);  /* create new constant */
+    int idx;
+    bvalue k;
+    switch (e->type) {
+    case ETINT:
+        var_setint(&k, e->v.i);
+        break;
+    case ETREAL:
+        var_setreal(&k, e->v.r);
+        break;
+    case ETSTRING:
+        var_setstr(&k, e->v.s);
+        break;
+    default: /* only literals are turned to constants */
+        be_assert(0);
+        var_setnil(&k);
+        break;
     }
+    idx = kindex(finfo, &k);
     if (idx < 256) {  /* if constant number fits in KB or KC */
         e->type = ETCONST;  /* new type is constant by index */
         e->v.idx = setK(idx);
@@ -367,13 +390,36 @@ static int suffix_destreg(bfuncinfo *finfo, bexpdesc *e1, int dst, bbool no_reg_
     return dst;
 }
 
+/* Slot of the instance variable `self.<name>` in a method of `finfo->cls`,
+ * or -1 if the member is looked up by name. Only the variables declared in
+ * the class itself are known here, the super class is bound at run time. */
+static int self_slot(bfuncinfo *finfo, bexpdesc *e)
+{
+    bclass *c = finfo->cls;
+    if (c && c->members && e->v.ss.tt == ETLOCAL && e->v.ss.obj == 0 && isK(e->v.ss.idx)) {
+        bvalue *k = (bvalue*)be_vector_data(&finfo->kvec) + KR2idx(e->v.ss.idx);
+        if (var_isstr(k)) {
+            bvalue *v = be_map_findstr(finfo->lexer->vm, c->members, var_tostr(k));
+            if (v && var_isindex(v) && var_toidx(v) < (1 << IRA_BITS)) {
+                return var_toidx(v);
+            }
+        }
+    }
+    return -1;
+}
+
 static int code_suffix(bfuncinfo *finfo, bopcode op, bexpdesc *e, int dst, bbool no_reg_reuse)
 {
+    int slot = op == OP_GETMBR ? self_slot(finfo, e) : -1;
     dst = suffix_destreg(finfo, e, dst, no_reg_reuse);
     if (dst > finfo->freereg) {
         dst = finfo->freereg;
     }
-    codeABC(finfo, op, dst, e->v.ss.obj, e->v.ss.idx);
+    if (slot >= 0) { /* `self.<var>`: R(A) <- self.members[slot] */
+        codeABC(finfo, OP_GETSMBR, dst, slot, e->v.ss.idx);
+    } else {
+        codeABC(finfo, op, dst, e->v.ss.obj, e->v.ss.idx);
+    }
     return dst;
 }
 
@@ -413,7 +459,7 @@ static int var2reg(bfuncinfo *finfo, bexpdesc *e, int dst)
         if (constint(finfo, e->v.i)) {
             return exp2const(finfo, e);
         } else {
-            codeABx(finfo, OP_LDINT, dst, var_toidx(e) + IsBx_MAX);
+            codeABx(finfo, OP_LDINT, dst, cast_int(e->v.i) + IsBx_MAX);
         }
         break;
     case ETBOOL:
@@ -519,17 +565,152 @@ static void binaryexp(bfuncinfo *finfo, bopcode op, bexpdesc *e1, bexpdesc *e2,
     e1->v.idx = dst; /* update register as output */
 }
 
+/* true if `e` is a nil, bool, number or string literal */
+static bbool isliteral(bexpdesc *e)
+{
+    return e->type >= ETNIL && e->type <= ETSTRING && !hasjump(e);
+}
+
+static void literal2value(bexpdesc *e, bvalue *v)
+{
+    switch (e->type) {
+    case ETNIL: var_setnil(v); break;
+    case ETBOOL: var_setbool(v, e->v.i != 0); break;
+    case ETREAL: var_setreal(v, e->v.r); break;
+    case ETINT: var_setint(v, e->v.i); break;
+    default: var_setstr(v, e->v.s); break;
+    }
+}
+
+/* `e` is a literal, it has no jump list to keep */
+static void value2literal(bvalue *v, bexpdesc *e)
+{
+    if (var_isbool(v)) {
+        e->type = ETBOOL;
+        e->v.i = var_tobool(v);
+    } else if (var_isint(v)) {
+        e->type = ETINT;
+        e->v.i = var_toint(v);
+    } else if (var_isreal(v)) {
+        e->type = ETREAL;
+        e->v.r = var_toreal(v);
+    } else {
+        e->type = ETSTRING;
+        e->v.s = var_tostr(v);
+    }
+}
+
+/* compute `a op b` for two integers like the VM, return bfalse if it
+ * must be left to run time (errors or undefined results) */
+static bbool fold_int(int op, bint x, bint y, bvalue *res)
+{
+    bint r;
+    switch (op) {
+    case OptAdd: r = int_wrap(+, x, y); break;
+    case OptSub: r = int_wrap(-, x, y); break;
+    case OptMul: r = int_wrap(*, x, y); break;
+    case OptDiv: case OptMod:
+        if (y == 0 || y == -1) { /* division by zero or overflow */
+            return bfalse;
+        }
+        r = op == OptDiv ? x / y : x % y;
+        break;
+    case OptBitAnd: r = x & y; break;
+    case OptBitOr: r = x | y; break;
+    case OptBitXor: r = x ^ y; break;
+    case OptShiftL: case OptShiftR:
+        if (y < 0 || y >= (bint)sizeof(bint) * 8) {
+            return bfalse;
+        }
+        r = op == OptShiftL ? int_wrap(<<, x, y) : x >> y;
+        break;
+    default: return bfalse;
+    }
+    var_setint(res, r);
+    return btrue;
+}
+
+static bbool fold_real(int op, breal x, breal y, bvalue *res)
+{
+    breal r;
+    switch (op) {
+    case OptAdd: r = x + y; break;
+    case OptSub: r = x - y; break;
+    case OptMul: r = x * y; break;
+    case OptDiv:
+        if (y == cast(breal, 0)) {
+            return bfalse; /* division by zero */
+        }
+        r = x / y;
+        break;
+    default: return bfalse;
+    }
+    var_setreal(res, r);
+    return btrue;
+}
+
+/* Fold `e1 op e2` into e1 when both are literals and the result is known
+ * at compile time. Operations that raise an error or build an object at
+ * run time (e.g. `1 .. 2`) are not folded. */
+static bbool fold_binop(bfuncinfo *finfo, int op, bexpdesc *e1, bexpdesc *e2)
+{
+    bvm *vm = finfo->lexer->vm;
+    bvalue a, b, res;
+    bbool num;
+    if (!isliteral(e1) || !isliteral(e2)) {
+        return bfalse;
+    }
+    literal2value(e1, &a);
+    literal2value(e2, &b);
+    num = var_isnumber(&a) && var_isnumber(&b);
+    switch (op) {
+    case OptEQ: var_setbool(&res, be_vm_iseq(vm, &a, &b)); break;
+    case OptNE: var_setbool(&res, be_vm_isneq(vm, &a, &b)); break;
+    case OptLT: case OptLE: case OptGT: case OptGE:
+        if (!num && !(var_isstr(&a) && var_isstr(&b))) {
+            return bfalse;
+        }
+        var_setbool(&res, op == OptLT ? be_vm_islt(vm, &a, &b) :
+            op == OptLE ? be_vm_isle(vm, &a, &b) :
+            op == OptGT ? be_vm_isgt(vm, &a, &b) : be_vm_isge(vm, &a, &b));
+        break;
+    case OptAdd: case OptConnect:
+        if (var_isstr(&a) && var_isstr(&b)) {
+            bstring *s = be_strcat(vm, var_tostr(&a), var_tostr(&b));
+            var_setstr(&res, be_lexer_cachestr(finfo->lexer, s));
+            break;
+        }
+        if (op == OptConnect) {
+            return bfalse;
+        }
+        /* fall through */
+    default:
+        if (var_isint(&a) && var_isint(&b)) {
+            if (!fold_int(op, var_toint(&a), var_toint(&b), &res)) {
+                return bfalse;
+            }
+        } else if (!num || !fold_real(op, value2real(&a), value2real(&b), &res)) {
+            return bfalse;
+        }
+        break;
+    }
+    value2literal(&res, e1);
+    return btrue;
+}
+
 void be_code_prebinop(bfuncinfo *finfo, int op, bexpdesc *e)
 {
     switch (op) {
     case OptAnd:
-        be_code_jumpbool(finfo, e, bfalse);
+        jumpbool(finfo, e, bfalse, bfalse);
         break;
     case OptOr:
-        be_code_jumpbool(finfo, e, btrue);
+        jumpbool(finfo, e, btrue, bfalse);
         break;
     default:
-        exp2anyreg(finfo, e);
+        if (!isliteral(e)) { /* literals are kept for constant folding */
+            exp2anyreg(finfo, e);
+        }
         break;
     }
 }
@@ -553,12 +734,28 @@ void be_code_binop(bfuncinfo *finfo, int op, bexpdesc *e1, bexpdesc *e2, int dst
     case OptNE: case OptGT: case OptGE: case OptConnect:
     case OptBitAnd: case OptBitOr: case OptBitXor:
     case OptShiftL: case OptShiftR:
-        binaryexp(finfo, (bopcode)(op - OptAdd), e1, e2, dst);
+        if (!fold_binop(finfo, op, e1, e2)) {
+            binaryexp(finfo, (bopcode)(op - OptAdd), e1, e2, dst);
+        }
         break;
     default: break;
     }
 }
 
+/* Apply `..` to e1 and e2 when e1 holds the result of the previous `..` of
+ * the same chain (`a .. b .. c`), result in e1. The temporary string in e1 is
+ * not visible to anything else so APPEND may extend it in place. */
+void be_code_append(bfuncinfo *finfo, bexpdesc *e1, bexpdesc *e2)
+{
+    if (e1->type != ETREG || hasjump(e1)) {
+        be_code_binop(finfo, OptConnect, e1, e2, -1);
+        return;
+    }
+    binaryexp(finfo, OP_APPEND, e1, e2, -1);
+    be_assert(IGET_RA(*(binstruction*)be_vector_end(&finfo->code)) ==
+              IGET_RKB(*(binstruction*)be_vector_end(&finfo->code)));
+}
+
 /* Apply unary operator and return register number */
 /* If input is register, change in place or allocate new register */
 static void unaryexp(bfuncinfo *finfo, bopcode op, bexpdesc *e)
@@ -583,7 +780,7 @@ static void code_not(bfuncinfo *finfo, bexpdesc *e)
     case ETREAL: e->v.i = e->v.r == cast(breal, 0); break;
     case ETNIL: e->v.i = 1; break;
     case ETBOOL: e->v.i = !e->v.i; break;
-    case ETSTRING: e->v.i = 0; break;
+    case ETSTRING: e->v.i = str_len(e->v.s) == 0; break;
     default: {
         unaryexp(finfo, OP_MOVE, e);
         int temp = e->t;
@@ -600,7 +797,7 @@ static void code_not(bfuncinfo *finfo, bexpdesc *e)
 static int code_neg(bfuncinfo *finfo, bexpdesc *e)
 {
     switch (e->type) {
-    case ETINT: e->v.i = -e->v.i; break;
+    case ETINT: e->v.i = int_wrap(-, 0, e->v.i); break;
     case ETREAL: e->v.r = -e->v.r; break;
     case ETNIL: case ETBOOL: case ETSTRING:
         return 1; /* error */
@@ -660,7 +857,12 @@ static void setsupvar(bfuncinfo *finfo, bopcode op, bexpdesc *e1, int src)
 static void setsfxvar(bfuncinfo *finfo, bopcode op, bexpdesc *e1, int src)
 {
     int obj = e1->v.ss.obj;
+    int slot = op == OP_SETMBR ? self_slot(finfo, e1) : -1;
     free_suffix(finfo, e1);
+    if (slot >= 0) { /* `self.<var> = ...`: self.members[slot] <- RK(src) */
+        codeABC(finfo, OP_SETSMBR, slot, e1->v.ss.idx, src);
+        return;
+    }
     if (isK(obj)) { /* move const to register */
         code_move(finfo, finfo->freereg, obj);
         obj = finfo->freereg;
@@ -749,6 +951,7 @@ int be_code_proto(bfuncinfo *finfo, bproto *proto)
     be_vector_push_c(finfo->lexer->vm, &finfo->pvec, &proto);
     finfo->proto->ptab = be_vector_data(&finfo->pvec);
     finfo->proto->nproto = be_vector_capacity(&finfo->pvec);
+    be_gc_barrier(finfo->lexer->vm, finfo->proto);
     return idx;
 }
 
@@ -780,18 +983,15 @@ void be_code_close(bfuncinfo *finfo, int isret)
     }
 }
 
-static void leave_function(bfuncinfo *finfo)
+static bbool in_except_block(bfuncinfo *finfo)
 {
-    int try_depth = 0; /* count of exception catch blocks */
     bblockinfo *binfo = finfo->binfo;
     for (; binfo; binfo = binfo->prev) {
         if (binfo->type & BLOCK_EXCEPT) {
-            ++try_depth; /* leave the exception catch block */
+            return btrue;
         }
     }
-    if (try_depth) { /* exception catch blocks that needs to leave */
-        be_code_exblk(finfo, try_depth);
-    }
+    return bfalse;
 }
 
 void be_code_ret(bfuncinfo *finfo, bexpdesc *e)
@@ -803,9 +1003,16 @@ void be_code_ret(bfuncinfo *finfo, bexpdesc *e)
         finfo->flags |= FUNC_RET_FLAG;
     }
     if (e) {
-        int reg = exp2anyreg(finfo, e);
+        int reg = exp2anyreg(finfo, e), pc = finfo->pc;
         be_code_close(finfo, 1);
-        leave_function(finfo);
+        /* `return f(...)` with no upvalue to close and outside of exception
+         * blocks: mark the call as a tail call, RET is kept for native calls */
+        if (pc && finfo->pc == pc && !in_except_block(finfo)) {
+            binstruction *i = be_vector_end(&finfo->code);
+            if (IGET_OP(*i) == OP_CALL && IGET_RA(*i) == reg) {
+                *i = (*i & ~IRKC_MASK) | ISET_RKC(1);
+            }
+        }
         codeABC(finfo, OP_RET, e->type != ETVOID, reg, 0);
         free_expreg(finfo, e);
     } else {
@@ -891,13 +1098,119 @@ void be_code_import(bfuncinfo *finfo, bexpdesc *m, bexpdesc *v)
     }
 }
 
-int be_code_exblk(bfuncinfo *finfo, int depth)
+/* check if an instruction in [from, pc) jumps to the current pc */
+static bbool is_jump_target(bfuncinfo *finfo, int from)
 {
-    if (depth == 0) {
-        return appendjump(finfo, OP_EXBLK, NULL);
+    for (; from < finfo->pc; ++from) {
+        binstruction ins = *(binstruction*)be_vector_at(&finfo->code, from);
+        if (isjumpop(IGET_OP(ins)) && get_jump(finfo, from) == finfo->pc) {
+            return btrue;
+        }
     }
-    codeABx(finfo, OP_EXBLK, 1, depth);
-    return 0;
+    return bfalse;
+}
+
+/* Emit FORPREP for the iterable in register `base`, its code starts at `beginpc` */
+/* If the iterable is a `lower .. upper` expression, the CONNECT instruction is
+ * replaced so that integer ranges are iterated without creating a `range` */
+void be_code_forprep(bfuncinfo *finfo, int base, int beginpc)
+{
+    if (finfo->pc > beginpc) {
+        binstruction *i = be_vector_end(&finfo->code); /* get the last instruction */
+        if (IGET_OP(*i) == OP_CONNECT && IGET_RA(*i) == base &&
+            !is_jump_target(finfo, beginpc)) {
+            *i = (*i & ~IOP_MASK) | ISET_OP(OP_FORPREP);
+            return;
+        }
+    }
+    codeABC(finfo, OP_FORPREP, base, base, base);
+}
+
+/* Emit FORLOOP for the iteration state in `base`, the exit jump is added to `list` */
+void be_code_forloop(bfuncinfo *finfo, int base, int *list)
+{
+    int pc = codeABx(finfo, OP_FORLOOP, base, NO_JUMP + IsBx_MAX);
+    be_code_conjump(finfo, list, pc);
+}
+
+/* cut the jump list `*list` before its first jump at or after `pc` */
+static void cutjumplist(bfuncinfo *finfo, int *list, int pc)
+{
+    int l = *list, next;
+    if (l == NO_JUMP || l >= pc) {
+        *list = NO_JUMP;
+        return;
+    }
+    while ((next = get_jump(finfo, l)) != NO_JUMP && next < pc) {
+        l = next;
+    }
+    if (next != NO_JUMP) {
+        binstruction *p = be_vector_at(&finfo->code, l);
+        *p = (*p & ~IBx_MASK) | ISET_sBx(NO_JUMP);
+    }
+}
+
+/* Drop the code generated from `pc`, it is never run (e.g. the block of
+ * `if false`). Nothing before `pc` may jump into that code, the jumps of
+ * `break` and `continue` it contains are removed from the loop blocks,
+ * as are the functions, `try` blocks and debug information it defined. */
+void be_code_discard(bfuncinfo *finfo, int pc, int nproto)
+{
+    bvm *vm = finfo->lexer->vm;
+    bblockinfo *binfo;
+    for (binfo = finfo->binfo; binfo; binfo = binfo->prev) {
+        if (binfo->type & BLOCK_LOOP) {
+            cutjumplist(finfo, &binfo->breaklist, pc);
+            cutjumplist(finfo, &binfo->continuelist, pc);
+        }
+    }
+    be_vector_resize(vm, &finfo->code, pc);
+    finfo->pc = pc;
+    discard_calls(finfo, pc);
+    be_vector_resize(vm, &finfo->pvec, nproto);
+    while (be_vector_count(&finfo->tryvec) &&
+           cast(btryrange*, be_vector_end(&finfo->tryvec))->beginpc >= pc) {
+        be_vector_remove_end(&finfo->tryvec);
+    }
+#if BE_DEBUG_RUNTIME_INFO
+    while (be_vector_count(&finfo->linevec) > 1 && /* keep lines of code before `pc` */
+           cast(blineinfo*, be_vector_end(&finfo->linevec))[-1].endpc >= pc - 1) {
+        be_vector_remove_end(&finfo->linevec);
+    }
+    if (be_vector_count(&finfo->linevec)) {
+        blineinfo *li = be_vector_end(&finfo->linevec);
+        if (pc == 0) {
+            be_vector_remove_end(&finfo->linevec);
+        } else if (li->endpc >= pc) {
+            li->endpc = pc - 1;
+        }
+    }
+#endif
+#if BE_DEBUG_VAR_INFO
+    while (be_vector_count(&finfo->varvec) &&
+           cast(bvarinfo*, be_vector_end(&finfo->varvec))->beginpc >= pc) {
+        be_vector_remove_end(&finfo->varvec);
+    }
+#endif
+}
+
+/* Emit the EXBLK that starts a `try` block, it jumps to the `except` chain */
+int be_code_exblk(bfuncinfo *finfo)
+{
+    return appendjump(finfo, OP_EXBLK, NULL);
+}
+
+/* Record the body of the `try` block started by the EXBLK at `beginpc`, it
+ * ends at the current pc. Blocks are closed from the inside out, so inner
+ * blocks come first in the table. */
+void be_code_tryrange(bfuncinfo *finfo, int beginpc)
+{
+    btryrange range;
+    range.beginpc = beginpc;
+    range.endpc = finfo->pc;
+    be_vector_push_c(finfo->lexer->vm, &finfo->tryvec, &range);
+    finfo->proto->tryranges = be_vector_data(&finfo->tryvec);
+    finfo->proto->ntryranges = be_vector_capacity(&finfo->tryvec);
 }
 
 void be_code_catch(bfuncinfo *finfo, int base, int ecnt, int vcnt, int *jmp)
@@ -927,4 +1240,498 @@ void be_code_raise(bfuncinfo *finfo, bexpdesc *e1, bexpdesc *e2)
     free_expreg(finfo, e2);
 }
 
+/* Code of a function whose body is compiled on its first call, the
+ * constants are the items of `k` (see be_parser_lazy()) */
+void be_code_lazy(bfuncinfo *finfo, blist *k)
+{
+    bvalue *v = be_list_data(k), *end = v + be_list_count(k);
+    for (; v < end; ++v) {
+        newconst(finfo, v);
+    }
+    codeABC(finfo, OP_COMPILE, 0, 0, 0);
+}
+
+/* flags of the instructions during the peephole pass */
+#define PH_TARGET               (1 << 0)    /* an instruction may jump here */
+#define PH_FIXED                (1 << 1)    /* may be skipped, must be kept as is */
+#define PH_REMOVED              (1 << 2)
+
+/* follow the chain of unconditional jumps starting at `dst` */
+static int jump_final(binstruction *code, int dst)
+{
+    int count = 0;
+    /* the count stops on jump cycles, e.g. nested empty `while true` */
+    while (IGET_OP(code[dst]) == OP_JMP && count++ < 16) {
+        int next = dst + 1 + IGET_sBx(code[dst]);
+        if (next == dst) {
+            break;
+        }
+        dst = next;
+    }
+    return dst;
+}
+
+/* Return the register written by an instruction which does nothing else:
+ * it can neither raise, run code or jump. Return -1 for other instructions. */
+static int plain_store(binstruction ins)
+{
+    switch (IGET_OP(ins)) {
+    case OP_LDBOOL:
+        return IGET_RKC(ins) ? -1 : IGET_RA(ins);
+    case OP_LDNIL: case OP_LDINT: case OP_LDCONST:
+    case OP_MOVE: case OP_GETUPV: case OP_GETGBL:
+        return IGET_RA(ins);
+    default:
+        return -1;
+    }
+}
+
+/* is `ins` a plain store to R(reg) that does not read R(reg)? */
+static bbool overwrites(binstruction ins, int reg)
+{
+    if (reg < 0 || plain_store(ins) != reg) {
+        return bfalse;
+    }
+    return IGET_OP(ins) != OP_MOVE || isKB(ins) || IGET_RKB(ins) != reg;
+}
+
+/* do the two instructions copy the same pair of registers? */
+static bbool same_move(binstruction i1, binstruction i2)
+{
+    int a1 = IGET_RA(i1), b1 = IGET_RKB(i1), a2 = IGET_RA(i2), b2 = IGET_RKB(i2);
+    if (IGET_OP(i1) != OP_MOVE || isKB(i1) || isKB(i2)) {
+        return bfalse;
+    }
+    return (a1 == a2 && b1 == b2) || (a1 == b2 && b1 == a2);
+}
+
+/* thread the jumps over unconditional jumps and set the flags of the
+ * instructions for the peephole rules */
+static void peephole_mark(bfuncinfo *finfo, int *flags)
+{
+    binstruction *code = be_vector_data(&finfo->code);
+    int pc, size = finfo->pc;
+    for (pc = 0; pc < size; ++pc) {
+        flags[pc] = 0;
+    }
+    for (pc = 0; pc < size; ++pc) {
+        binstruction ins = code[pc];
+        if (isjumpop(IGET_OP(ins))) {
+            int dst = jump_final(code, get_jump(finfo, pc));
+            setjump(finfo, pc, dst);
+            flags[dst] |= PH_TARGET;
+        } else if (isskipop(ins) && pc + 2 < size) {
+            flags[pc + 1] |= PH_FIXED;
+            flags[pc + 2] |= PH_TARGET;
+        }
+    }
+}
+
+/* Apply the peephole rules to the instructions, the removed instructions
+ * are flagged and the others may be rewritten in place:
+ *  - `JMP` to the next instruction is removed
+ *  - `JMPF R x; JMP y; x:` becomes `JMPT R y`, the same for `JMPT`
+ *  - `MOVE R R` and the second `MOVE` of `MOVE A B; MOVE B A` are removed
+ *  - a store overwritten by the next instruction is removed */
+static bbool peephole_apply(bfuncinfo *finfo, int *flags)
+{
+    binstruction *code = be_vector_data(&finfo->code);
+    int pc, size = finfo->pc;
+    bbool changed = bfalse;
+    for (pc = 0; pc < size; ++pc) {
+        binstruction ins = code[pc];
+        bopcode op = IGET_OP(ins);
+        int next = pc + 1 < size ? flags[pc + 1] : PH_FIXED;
+        if (flags[pc] & PH_FIXED) {
+            continue;
+        }
+        if (op == OP_JMP && get_jump(finfo, pc) == pc + 1) {
+            flags[pc] |= PH_REMOVED;
+        } else if ((op == OP_JMPT || op == OP_JMPF) && get_jump(finfo, pc) == pc + 2 &&
+                   !(next & (PH_TARGET | PH_FIXED)) && IGET_OP(code[pc + 1]) == OP_JMP) {
+            code[pc] = (ins & ~IOP_MASK) | ISET_OP(op == OP_JMPT ? OP_JMPF : OP_JMPT);
+            setjump(finfo, pc, get_jump(finfo, pc + 1));
+            flags[++pc] |= PH_REMOVED; /* the `JMP` is not checked */
+        } else if (op == OP_MOVE && !isKB(ins) && IGET_RA(ins) == IGET_RKB(ins)) {
+            flags[pc] |= PH_REMOVED;
+        } else if (op == OP_MOVE && pc > 0 && !(flags[pc] & PH_TARGET) &&
+                   !(flags[pc - 1] & PH_REMOVED) && same_move(code[pc - 1], ins)) {
+            flags[pc] |= PH_REMOVED;
+        } else if (!(next & (PH_TARGET | PH_FIXED)) && overwrites(code[pc + 1], plain_store(ins))) {
+            flags[pc] |= PH_REMOVED;
+        } else {
+            continue;
+        }
+        changed = btrue;
+    }
+    return changed;
+}
+
+/* the jump `ins` at `pc` moved to map[pc], to the new pc of its destination */
+static binstruction move_jump(binstruction ins, int pc, int *map)
+{
+    int dst = map[pc + 1 + IGET_sBx(ins)];
+    return (ins & ~IBx_MASK) | ISET_sBx(dst - (map[pc] + 1));
+}
+
+/* Move the `try` blocks and the debug information of the `size` former
+ * instructions to the new pc given by `map` */
+static void move_pcinfo(bfuncinfo *finfo, int *map, int size)
+{
+    btryrange *tr = be_vector_data(&finfo->tryvec);
+    btryrange *trend = tr + be_vector_count(&finfo->tryvec);
+    (void)size; /* unused variable (no debugging) */
+    for (; tr < trend; ++tr) {
+        tr->beginpc = map[tr->beginpc];
+        tr->endpc = map[tr->endpc];
+    }
+#if BE_DEBUG_RUNTIME_INFO
+    { /* the last pc of each line, the lines left without code are removed */
+        blineinfo *li = be_vector_data(&finfo->linevec);
+        int i, n = 0, nline = be_vector_count(&finfo->linevec);
+        for (i = 0; i < nline; ++i) {
+            int endpc = map[min(li[i].endpc + 1, size)] - 1;
+            if (endpc >= 0 && (n == 0 || endpc > li[n - 1].endpc)) {
+                li[n].linenumber = li[i].linenumber;
+                li[n++].endpc = endpc;
+            }
+        }
+        be_vector_resize(finfo->lexer->vm, &finfo->linevec, n);
+    }
+#endif
+#if BE_DEBUG_VAR_INFO
+    {
+        bvarinfo *vi = be_vector_data(&finfo->varvec);
+        bvarinfo *viend = be_vector_end(&finfo->varvec);
+        for (; vi <= viend; ++vi) {
+            vi->beginpc = map[min(vi->beginpc, size)];
+            vi->endpc = map[min(vi->endpc, size)];
+        }
+    }
+#endif
+}
+
+/* Remove the flagged instructions: `flags` becomes the map from the old to
+ * the new pc, a removed instruction maps to the next one kept. The jumps,
+ * the `try` blocks and the debug information are moved to the new pc. */
+static void peephole_compact(bfuncinfo *finfo, int *flags)
+{
+    binstruction *code = be_vector_data(&finfo->code);
+    int pc, count = 0, size = finfo->pc;
+    for (pc = 0; pc < size; ++pc) {
+        int removed = flags[pc] & PH_REMOVED;
+        flags[pc] = count;
+        count += !removed;
+    }
+    flags[size] = count;
+    for (pc = 0; pc < size; ++pc) {
+        if (flags[pc] != flags[pc + 1]) { /* kept */
+            binstruction ins = code[pc];
+            if (isjumpop(IGET_OP(ins))) {
+                ins = move_jump(ins, pc, flags);
+            }
+            code[flags[pc]] = ins; /* never moved forward */
+        }
+    }
+    be_vector_resize(finfo->lexer->vm, &finfo->code, count);
+    finfo->pc = count;
+    move_pcinfo(finfo, flags, size);
+}
+
+/* Peephole optimiser run on the finished code of a function, it is enabled
+ * by the `COMP_OPTIMIZE` compiler option. The rules are applied again until
+ * nothing changes since removing instructions may expose new patterns. */
+void be_code_optimize(bfuncinfo *finfo)
+{
+    bvm *vm = finfo->lexer->vm;
+    int size = finfo->pc;
+    int *flags = be_malloc(vm, sizeof(int) * (size + 1));
+    peephole_mark(finfo, flags);
+    while (peephole_apply(finfo, flags)) {
+        peephole_compact(finfo, flags);
+        peephole_mark(finfo, flags);
+    }
+    be_free(vm, flags, sizeof(int) * (size + 1));
+}
+
+/* Inlining of small functions, enabled by the `COMP_OPTIMIZE` compiler
+ * option: a call is replaced by a copy of the code of the function when the
+ * function is known at compile time. This is the case of
+ *  - the static methods `C.f(...)` of the class `C` being compiled, the
+ *    copy is made at once (see class_func() in be_parser.c)
+ *  - the local functions, defined by `def f` or `var f = def ...`, which are
+ *    never assigned. The assignments are only known at the end of the
+ *    function, so the calls are recorded then replaced by
+ *    be_code_inlinecalls(). A function captured by a closure may still be
+ *    inlined, unless the closure assigns it.
+ * The entries of `finfo->localfn` are the register of a local function in
+ * scope -> its proto, and -(pc + 1) of the MOVE loading the function of a
+ * recorded call -> the proto, or `false` once the function is assigned. */
+
+/* kinds of the operands of the instructions copied by inline_code() */
+#define INL_A                   0   /* R(A), the other operands are kept */
+#define INL_AB                  1   /* R(A), RK(B) */
+#define INL_ABC                 2   /* R(A), RK(B), RK(C) */
+#define INL_ABX                 3   /* R(A), K(Bx) */
+#define INL_RET                 4
+
+/* instructions of an inlined function, its final `RET` excepted, this is
+ * also the maximum number of arguments */
+#define INLINE_MAX_CODE         8
+#define INLINE_MAX_SIZE         (INLINE_MAX_CODE * 2 + 1) /* size of a copy */
+
+/* Return the kind of operands of `ins`, or -1 if the instruction cannot be
+ * copied: it jumps, skips, uses upvalues or the tables of the function */
+static int inline_kind(binstruction ins)
+{
+    bopcode op = IGET_OP(ins);
+    if (op <= OP_CONNECT) {
+        return INL_ABC;
+    }
+    switch (op) {
+    case OP_GETMBR: case OP_GETMET: case OP_SETMBR:
+    case OP_GETIDX: case OP_SETIDX: case OP_APPEND:
+        return INL_ABC;
+    case OP_NEG: case OP_FLIP: case OP_MOVE:
+    case OP_GETNGBL: case OP_SETNGBL:
+        return INL_AB;
+    case OP_LDBOOL:
+        return IGET_RKC(ins) ? -1 : INL_A;
+    case OP_LDNIL: case OP_LDINT: case OP_GETGBL:
+    case OP_SETGBL: case OP_CALL:
+        return INL_A;
+    case OP_LDCONST:
+        return INL_ABX;
+    case OP_RET:
+        return INL_RET;
+    default:
+        return -1;
+    }
+}
+
+/* does `ins` only store the result of an expression in R(A)? */
+static bbool inline_result(binstruction ins)
+{
+    bopcode op = IGET_OP(ins);
+    return op <= OP_FLIP || op == OP_GETMBR || op == OP_GETIDX ||
+        op == OP_GETNGBL || plain_store(ins) >= 0;
+}
+
+/* Can the calls of `p` be replaced by a copy of its code? It must be a small
+ * function with fixed arguments and no upvalue, made of straight code up to
+ * its first `RET`. The constants of `p` are added to the current function. */
+static bbool inlinable(bfuncinfo *finfo, bproto *p)
+{
+    int pc, i;
+    if (p->varg || p->nupvals || p->argc > INLINE_MAX_CODE ||
+        finfo->freereg + p->nstack >= 255) {
+        return bfalse;
+    }
+    for (pc = 0; pc < p->codesize && inline_kind(p->code[pc]) != INL_RET; ++pc) {
+        if (pc >= INLINE_MAX_CODE || inline_kind(p->code[pc]) < 0) {
+            return bfalse;
+        }
+    }
+    if (pc == p->codesize) {
+        return bfalse;
+    }
+    for (i = 0; i < p->nconst; ++i) {
+        bvalue *k = p->ktab + i;
+        if (!(var_isint(k) || var_isreal(k) || var_isstr(k)) || kindex(finfo, k) >= 256) {
+            return bfalse;
+        }
+    }
+    return btrue;
+}
+
+/* the RK operand `v` of an instruction of `p` with its registers from R(arg) */
+static int inline_rk(bfuncinfo *finfo, bproto *p, int v, int arg)
+{
+    return isK(v) ? setK(findconst(finfo, p->ktab + KR2idx(v))) : arg + v;
+}
+
+/* Copy to `out` the code of a call of `p` accepted by inlinable():
+ * the registers of `p` are moved to R(arg) where the `argc` arguments are,
+ * the result is left in R(base). Return the number of instructions. */
+static int inline_code(bfuncinfo *finfo, bproto *p, int base, int arg, int argc, binstruction *out)
+{
+    binstruction *code = p->code, *start = out;
+    int src;
+    for (; argc < p->argc; ++argc) { /* the missing arguments are nil */
+        *out++ = ISET_OP(OP_LDNIL) | ISET_RA(arg + argc);
+    }
+    for (; inline_kind(*code) != INL_RET; ++code) {
+        binstruction ins = *code;
+        switch (inline_kind(ins)) {
+        case INL_ABC:
+            ins = (ins & ~IRKC_MASK) | ISET_RKC(inline_rk(finfo, p, IGET_RKC(ins), arg));
+            /* fall through */
+        case INL_AB:
+            ins = (ins & ~IRKB_MASK) | ISET_RKB(inline_rk(finfo, p, IGET_RKB(ins), arg));
+            break;
+        case INL_ABX:
+            ins = (ins & ~IBx_MASK) | ISET_Bx(findconst(finfo, p->ktab + IGET_Bx(ins)));
+            break;
+        default:
+            break;
+        }
+        if (IGET_OP(ins) == OP_CALL) {
+            ins &= ~IRKC_MASK; /* a tail call would leave the current function */
+        }
+        *out++ = (ins & ~IRA_MASK) | ISET_RA(arg + IGET_RA(ins));
+    }
+    if (IGET_RA(*code) == 0) { /* `RET 0` returns nil */
+        *out++ = ISET_OP(OP_LDNIL) | ISET_RA(base);
+    } else if ((src = inline_rk(finfo, p, IGET_RKB(*code), arg)) != base) {
+        if (isK(src)) {
+            *out++ = ISET_OP(OP_LDCONST) | ISET_RA(base) | ISET_Bx(KR2idx(src));
+        } else if (out > start && IGET_RA(out[-1]) == src && inline_result(out[-1])) {
+            out[-1] = (out[-1] & ~IRA_MASK) | ISET_RA(base); /* store the result at once */
+        } else {
+            *out++ = ISET_OP(OP_MOVE) | ISET_RA(base) | ISET_RKB(src);
+        }
+    }
+    return cast_int(out - start);
+}
+
+/* Record that the local variable in R(reg) holds a closure of `p`, or
+ * forget the variable when `p` is NULL since its register is reused */
+void be_code_localfn(bfuncinfo *finfo, int reg, bproto *p)
+{
+    bvm *vm = finfo->lexer->vm;
+    bvalue key;
+    var_setint(&key, reg);
+    if (p) {
+        bvalue v;
+        var_setproto(&v, p);
+        be_map_insert(vm, finfo->localfn, &key, &v);
+    } else if (be_map_count(finfo->localfn)) {
+        be_map_remove(vm, finfo->localfn, &key);
+    }
+}
+
+/* The local variable in R(reg) is assigned, the calls of the function it
+ * held are not inlined */
+void be_code_localfn_assigned(bfuncinfo *finfo, int reg)
+{
+    bvm *vm = finfo->lexer->vm;
+    bvalue key, *v;
+    bmapnode *node;
+    bmapiter iter = be_map_iter();
+    void *p;
+    var_setint(&key, reg);
+    if (!be_map_count(finfo->localfn) || (v = be_map_find(vm, finfo->localfn, &key)) == NULL) {
+        return;
+    }
+    p = var_toobj(v);
+    be_map_remove(vm, finfo->localfn, &key);
+    while ((node = be_map_next(finfo->localfn, &iter)) != NULL) {
+        if (var_isproto(&node->value) && var_toobj(&node->value) == p) {
+            var_setbool(&node->value, bfalse);
+        }
+    }
+}
+
+/* The function of a call was just loaded from the local variable in
+ * R(reg), record the call if the function may be inlined */
+void be_code_localcall(bfuncinfo *finfo, int reg)
+{
+    bvm *vm = finfo->lexer->vm;
+    bvalue key, fn, *v;
+    binstruction *ins = be_vector_end(&finfo->code);
+    var_setint(&key, reg);
+    if (!be_map_count(finfo->localfn) || (v = be_map_find(vm, finfo->localfn, &key)) == NULL) {
+        return;
+    }
+    if (finfo->pc && IGET_OP(*ins) == OP_MOVE && IGET_RA(*ins) == finfo->freereg - 1 &&
+        IGET_RKB(*ins) == reg && inlinable(finfo, var_toobj(v))) {
+        fn = *v; /* the insertion may move the nodes */
+        var_setint(&key, -finfo->pc); /* -(pc + 1) of the MOVE */
+        be_map_insert(vm, finfo->localfn, &key, &fn);
+    }
+}
+
+/* the code from `pc` is dropped, so are the calls it recorded */
+static void discard_calls(bfuncinfo *finfo, int pc)
+{
+    bmapnode *node;
+    bmapiter iter = be_map_iter();
+    while ((node = be_map_next(finfo->localfn, &iter)) != NULL) {
+        bvalue key;
+        be_map_key2value(&key, node);
+        if (var_toint(&key) < -pc) {
+            var_setbool(&node->value, bfalse);
+        }
+    }
+}
+
+/* Replace the recorded calls of the local functions that were not assigned
+ * by a copy of their code, see be_code_localcall(). The MOVE loading the
+ * function is removed and the CALL is replaced by the copy. */
+void be_code_inlinecalls(bfuncinfo *finfo)
+{
+    bvm *vm = finfo->lexer->vm;
+    binstruction *code = be_vector_data(&finfo->code), *out;
+    int pc, count = 0, size = finfo->pc;
+    bproto **fn = be_malloc(vm, sizeof(bproto*) * size);
+    int *map;
+    bmapnode *node;
+    bmapiter iter = be_map_iter();
+    for (pc = 0; pc < size; ++pc) {
+        fn[pc] = NULL;
+    }
+    while ((node = be_map_next(finfo->localfn, &iter)) != NULL) {
+        bvalue key;
+        be_map_key2value(&key, node);
+        if (var_toint(&key) < 0 && var_isproto(&node->value)) {
+            int move = cast_int(-var_toint(&key)) - 1, base = IGET_RA(code[move]);
+            for (pc = move + 1; pc < size; ++pc) { /* the CALL of the function */
+                if (IGET_OP(code[pc]) == OP_CALL && IGET_RA(code[pc]) == base) {
+                    fn[move] = fn[pc] = var_toobj(&node->value);
+                    ++count;
+                    break;
+                }
+            }
+        }
+    }
+    if (count == 0) { /* all the functions are assigned */
+        be_free(vm, fn, sizeof(bproto*) * size);
+        return;
+    }
+    map = be_malloc(vm, sizeof(int) * (size + 1));
+    for (pc = 0, count = 0; pc < size; ++pc) { /* new pc of the instructions */
+        binstruction buf[INLINE_MAX_SIZE];
+        map[pc] = count;
+        if (fn[pc] == NULL) {
+            ++count;
+        } else if (IGET_OP(code[pc]) == OP_CALL) {
+            int base = IGET_RA(code[pc]);
+            count += inline_code(finfo, fn[pc], base, base + 1, IGET_RKB(code[pc]), buf);
+        }
+    }
+    map[size] = count;
+    out = be_malloc(vm, sizeof(binstruction) * count);
+    for (pc = 0; pc < size; ++pc) {
+        binstruction ins = code[pc];
+        if (fn[pc] == NULL) {
+            out[map[pc]] = isjumpop(IGET_OP(ins)) ? move_jump(ins, pc, map) : ins;
+        } else if (IGET_OP(ins) == OP_CALL) {
+            int base = IGET_RA(ins), nstack = base + 1 + fn[pc]->nstack;
+            inline_code(finfo, fn[pc], base, base + 1, IGET_RKB(ins), out + map[pc]);
+            if (nstack > finfo->proto->nstack) {
+                finfo->proto->nstack = (bbyte)nstack;
+            }
+        }
+    }
+    be_vector_resize(vm, &finfo->code, count);
+    memcpy(be_vector_data(&finfo->code), out, sizeof(binstruction) * count);
+    finfo->proto->code = be_vector_data(&finfo->code);
+    finfo->proto->codesize = be_vector_capacity(&finfo->code);
+    finfo->pc = count;
+    move_pcinfo(finfo, map, size);
+    be_free(vm, out, sizeof(binstruction) * count);
+    be_free(vm, map, sizeof(int) * (size + 1));
+    be_free(vm, fn, sizeof(bproto*) * size);
+}
+
 #endif
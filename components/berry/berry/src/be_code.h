@@ -15,12 +15,14 @@
 int be_code_allocregs(bfuncinfo *finfo, int count);
 void be_code_prebinop(bfuncinfo *finfo, int op, bexpdesc *e);
 void be_code_binop(bfuncinfo *finfo, int op, bexpdesc *e1, bexpdesc *e2, int dst);
+void be_code_append(bfuncinfo *finfo, bexpdesc *e1, bexpdesc *e2);
 int be_code_unop(bfuncinfo *finfo, int op, bexpdesc *e);
 int be_code_setvar(bfuncinfo *finfo, bexpdesc *e1, bexpdesc *e2);
 int be_code_nextreg(bfuncinfo *finfo, bexpdesc *e);
 int be_code_jump(bfuncinfo *finfo);
 void be_code_jumpto(bfuncinfo *finfo, int dst);
 void be_code_jumpbool(bfuncinfo *finfo, bexpdesc *e, int jumptrue);
+int be_code_constcond(bexpdesc *e);
 void be_code_conjump(bfuncinfo *finfo, int *list, int jmp);
 void be_code_patchlist(bfuncinfo *finfo, int list, int dst);
 void be_code_patchjump(bfuncinfo *finfo, int jmp);
@@ -36,8 +38,18 @@ void be_code_member(bfuncinfo *finfo, bexpdesc *e1, bexpdesc *e2);
 void be_code_index(bfuncinfo *finfo, bexpdesc *c, bexpdesc *k);
 void be_code_setsuper(bfuncinfo *finfo, bexpdesc *c, bexpdesc *s);
 void be_code_import(bfuncinfo *finfo, bexpdesc *m, bexpdesc *v);
-int be_code_exblk(bfuncinfo *finfo, int depth);
+void be_code_forprep(bfuncinfo *finfo, int base, int beginpc);
+void be_code_forloop(bfuncinfo *finfo, int base, int *list);
+void be_code_discard(bfuncinfo *finfo, int pc, int nproto);
+int be_code_exblk(bfuncinfo *finfo);
+void be_code_tryrange(bfuncinfo *finfo, int beginpc);
 void be_code_catch(bfuncinfo *finfo, int base, int ecnt, int vcnt, int *jmp);
 void be_code_raise(bfuncinfo *finfo, bexpdesc *e1, bexpdesc *e2);
+void be_code_lazy(bfuncinfo *finfo, blist *k);
+void be_code_localfn(bfuncinfo *finfo, int reg, bproto *p);
+void be_code_localfn_assigned(bfuncinfo *finfo, int reg);
+void be_code_localcall(bfuncinfo *finfo, int reg);
+void be_code_inlinecalls(bfuncinfo *finfo);
+void be_code_optimize(bfuncinfo *finfo);
 
 #endif
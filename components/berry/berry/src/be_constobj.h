@@ -38,6 +38,104 @@ extern "C" {
         .s = _s                                                 \
     }
 
+#if BE_USE_NAN_BOXING
+
+#define be_const_key(_str, _next) {                             \
+    .u = be_vbox(&be_const_str_##_str, BE_STRING),              \
+    .next = (uint32_t)(_next) & 0xFFFFFF                        \
+}
+
+/* try to use the predefined string in strtab, but don't create an instance if none is present */
+/* the behavior is exactly the same as `be_const_key()` but it not detected by coc */
+#define be_const_key_weak(_str, _next) {                        \
+    .u = be_vbox(&be_const_str_##_str, BE_STRING),              \
+    .next = (uint32_t)(_next) & 0xFFFFFF                        \
+}
+
+#define be_const_key_literal(_str, _next) {                     \
+    .u = be_vbox(be_str_literal(#_str), BE_STRING),             \
+    .next = (uint32_t)(_next) & 0xFFFFFF                        \
+}
+
+#define be_const_key_int(_i, _next) {                           \
+    .u = be_vtag(BE_INT) | (uint32_t)(_i),                      \
+    .next = (uint32_t)(_next) & 0xFFFFFF                        \
+}
+
+#define be_const_func(_func) {                                  \
+    .u = be_vbox(_func, BE_NTVFUNC)                             \
+}
+
+#define be_const_static_func(_func) {                           \
+    .u = be_vbox(_func, BE_NTVFUNC | BE_STATIC)                 \
+}
+
+#define be_const_leaf_func(_func) {                             \
+    .u = be_vbox(_func, BE_LEAF_FUNC)                           \
+}
+
+#define be_const_nil() {                                        \
+    .u = be_vtag(BE_NIL)                                        \
+}
+
+#define be_const_int(_val) {                                    \
+    .u = be_vtag(BE_INT) | (uint32_t)(bint)(_val)               \
+}
+
+#define be_const_var(_val) {                                    \
+    .u = be_vtag(BE_INDEX) | (uint32_t)(bint)(_val)             \
+}
+
+#define be_const_real(_val) {                                   \
+    .r = (breal)(_val)                                          \
+}
+
+#define be_const_real_hex(_val) {                               \
+    .u = (uint64_t)(_val)                                       \
+}
+
+#define be_const_bool(_val) {                                   \
+    .u = be_vtag(BE_BOOL) | (uint64_t)(bbool)(_val)             \
+}
+
+#define be_const_str(_str) {                                    \
+    .u = be_vbox(_str, BE_STRING)                               \
+}
+
+#define be_const_comptr(_val) {                                 \
+    .u = be_vbox(_val, BE_COMPTR)                               \
+}
+
+#define be_const_class(_class) {                                \
+    .u = be_vbox(&(_class), BE_CLASS)                           \
+}
+
+#define be_const_closure(_closure) {                            \
+    .u = be_vbox(&(_closure), BE_CLOSURE)                       \
+}
+
+#define be_const_static_closure(_closure) {                     \
+    .u = be_vbox(&(_closure), BE_CLOSURE | BE_STATIC)           \
+}
+
+#define be_const_module(_module) {                              \
+    .u = be_vbox(&(_module), BE_MODULE)                         \
+}
+
+#define be_const_simple_instance(_instance) {                   \
+    .u = be_vbox(_instance, BE_INSTANCE)                        \
+}
+
+#define be_const_map(_map) {                                    \
+    .u = be_vbox(&(_map), BE_MAP)                               \
+}
+
+#define be_const_list(_list) {                                  \
+    .u = be_vbox(&(_list), BE_LIST)                             \
+}
+
+#else
+
 #define be_const_key(_str, _next) {                             \
     .v.c = &be_const_str_##_str,                                \
     .type = BE_STRING,                                          \
@@ -74,6 +172,11 @@ extern "C" {
     .type = BE_NTVFUNC | BE_STATIC                              \
 }
 
+#define be_const_leaf_func(_func) {                             \
+    .v.nf = (_func),                                            \
+    .type = BE_LEAF_FUNC                                        \
+}
+
 #define be_const_nil() {                                        \
     .v.i = 0,                                                   \
     .type = BE_NIL                                              \
@@ -149,6 +252,8 @@ extern "C" {
     .type = BE_LIST                                             \
 }
 
+#endif
+
 #define be_define_const_map_slots(_name)                        \
 const bmapnode _name##_slots[] =
 
@@ -249,6 +354,35 @@ const bntvmodule be_native_module(_module) = {                  \
     .data = _items                                              \
   }
 
+#define be_str_literal(_str)                                    \
+  be_nested_const_str(_str, 0, sizeof(_str)-1 )
+
+#define be_str_weak(_str)                                       \
+  (bstring*) &be_const_str_##_str
+
+#if BE_USE_NAN_BOXING
+
+#define be_nested_str(_name_)                                   \
+  { .u = be_vbox(&be_const_str_##_name_, BE_STRING) }
+
+/* variant that does not trigger strtab */
+#define be_nested_str_weak(_name_)                              \
+  { .u = be_vbox(&be_const_str_##_name_, BE_STRING) }
+
+#define be_nested_str_literal(_name_)                           \
+  { .u = be_vbox(be_nested_const_str(_name_, _hash, sizeof(_name_)-1 ), BE_STRING) }
+
+#define be_nested_string(_str, _hash, _len)                     \
+  { .u = be_vbox(be_nested_const_str(_str, _hash, _len ), BE_STRING) }
+
+#define be_nested_key(_str, _hash, _len, _next)                 \
+  {                                                             \
+    .u = be_vbox(be_nested_const_str(_str, _hash, _len ), BE_STRING), \
+    .next = (uint32_t)(_next) & 0xFFFFFF                        \
+  }
+
+#else
+
 #define be_nested_str(_name_)                                   \
   {                                                             \
     { .s=((bstring*)&be_const_str_##_name_) },                  \
@@ -269,12 +403,6 @@ const bntvmodule be_native_module(_module) = {                  \
     BE_STRING                                                   \
   }
 
-#define be_str_literal(_str)                                    \
-  be_nested_const_str(_str, 0, sizeof(_str)-1 )
-
-#define be_str_weak(_str)                                       \
-  (bstring*) &be_const_str_##_str
-
 #define be_nested_string(_str, _hash, _len)                     \
   {                                                             \
     { .s=(be_nested_const_str(_str, _hash, _len ))              \
@@ -289,8 +417,14 @@ const bntvmodule be_native_module(_module) = {                  \
     (uint32_t)(_next) & 0xFFFFFF                                \
   }
 
+#endif
+
 #else
 
+#if BE_USE_NAN_BOXING
+  #error "BE_USE_NAN_BOXING does not support the C++ constant tables."
+#endif
+
 #define be_define_const_str_weak(_name, _s, _len)               \
 const bcstring be_const_str_##_name = {                         \
     NULL,                                                       \
@@ -332,6 +466,11 @@ const bcstring be_const_str_##_name = {                         \
     BE_NTVFUNC | BE_STATIC                                      \
 }
 
+#define be_const_leaf_func(_func) {                             \
+    bvaldata(_func),                                            \
+    BE_LEAF_FUNC                                                \
+}
+
 #define be_const_nil() {                                        \
     bvaldata(0),                                                \
     BE_NIL                                                      \
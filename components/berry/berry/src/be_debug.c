@@ -50,8 +50,10 @@ static const char* opc2str(bopcode op)
 void be_print_inst(binstruction ins, int pc, void* fout)
 {
     char __lbuf[INST_BUF_SIZE];
-    bopcode op = IGET_OP(ins);
+    bopcode op;
 
+    ins = be_vm_unquicken(ins);
+    op = IGET_OP(ins);
     logbuf("  %.4X  ", pc);
     if (fout) {
         be_fwrite(fout, __lbuf, strlen(__lbuf));
@@ -64,11 +66,21 @@ void be_print_inst(binstruction ins, int pc, void* fout)
     case OP_NE:  case OP_GT:  case OP_GE: case OP_CONNECT:
     case OP_GETMBR: case OP_SETMBR:  case OP_GETMET:
     case OP_GETIDX: case OP_SETIDX: case OP_AND:
-    case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR:
+    case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR: case OP_FORPREP:
+    case OP_APPEND:
         logbuf("%s\tR%d\t%c%d\t%c%d", opc2str(op), IGET_RA(ins),
                 isKB(ins) ? 'K' : 'R', IGET_RKB(ins) & KR_MASK,
                 isKC(ins) ? 'K' : 'R', IGET_RKC(ins) & KR_MASK);
         break;
+    case OP_GETSMBR:
+        logbuf("%s\tR%d\tM%d\tK%d", opc2str(op), IGET_RA(ins),
+                IGET_RKB(ins), IGET_RKC(ins) & KR_MASK);
+        break;
+    case OP_SETSMBR:
+        logbuf("%s\tM%d\tK%d\t%c%d", opc2str(op), IGET_RA(ins),
+                IGET_RKB(ins) & KR_MASK,
+                isKC(ins) ? 'K' : 'R', IGET_RKC(ins) & KR_MASK);
+        break;
     case OP_GETNGBL: case OP_SETNGBL:
         logbuf("%s\tR%d\t%c%d", opc2str(op), IGET_RA(ins),
                 isKB(ins) ? 'K' : 'R', IGET_RKB(ins) & KR_MASK);
@@ -83,7 +95,7 @@ void be_print_inst(binstruction ins, int pc, void* fout)
     case OP_JMP:
         logbuf("%s\t\t#%.4X", opc2str(op), IGET_sBx(ins) + pc + 1);
         break;
-    case OP_JMPT: case OP_JMPF:
+    case OP_JMPT: case OP_JMPF: case OP_FORLOOP:
         logbuf("%s\tR%d\t#%.4X", opc2str(op), IGET_RA(ins), IGET_sBx(ins) + pc + 1);
         break;
     case OP_LDINT:
@@ -107,7 +119,11 @@ void be_print_inst(binstruction ins, int pc, void* fout)
         logbuf("%s\tR%d\tK%d", opc2str(op), IGET_RA(ins), IGET_Bx(ins));
         break;
     case OP_CALL:
-        logbuf("%s\tR%d\t%d", opc2str(op), IGET_RA(ins), IGET_RKB(ins));
+        if (IGET_RKC(ins)) {
+            logbuf("%s\tR%d\t%d\t%d", opc2str(op), IGET_RA(ins), IGET_RKB(ins), IGET_RKC(ins));
+        } else {
+            logbuf("%s\tR%d\t%d", opc2str(op), IGET_RA(ins), IGET_RKB(ins));
+        }
         break;
     case OP_CLOSURE:
         logbuf("%s\tR%d\tP%d", opc2str(op), IGET_RA(ins), IGET_Bx(ins));
@@ -124,11 +140,7 @@ void be_print_inst(binstruction ins, int pc, void* fout)
                 isKC(ins) ? 'K' : 'R', IGET_RKC(ins) & KR_MASK);
         break;
     case OP_EXBLK:
-        if (IGET_RA(ins)) {
-            logbuf("%s\t%d\t%d", opc2str(op), IGET_RA(ins), IGET_Bx(ins));
-        } else {
-            logbuf("%s\t%d\t#%.4X", opc2str(op), IGET_RA(ins), IGET_sBx(ins) + pc + 1);
-        }
+        logbuf("%s\t%d\t#%.4X", opc2str(op), IGET_RA(ins), IGET_sBx(ins) + pc + 1);
         break;
     case OP_CATCH:
         logbuf("%s\tR%d\t%d\t%d", opc2str(op), IGET_RA(ins), IGET_RKB(ins), IGET_RKC(ins));
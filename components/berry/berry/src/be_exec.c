@@ -21,7 +21,11 @@
   #error no compiler or bytecode loader enabled.
 #endif
 
-#define FILE_BUFFER_SIZE    256
+#if BE_USE_BYTECODE_CACHE && !(BE_USE_BYTECODE_SAVER && BE_USE_BYTECODE_LOADER)
+  #error the bytecode cache requires the bytecode saver and loader.
+#endif
+
+#define FILE_BUFFER_SIZE    1024
 
 #define __STR(s)            #s
 #define STR(s)              __STR(s)
@@ -254,10 +258,170 @@ static int load_bytecode(bvm *vm, const char *name)
     return res;
 }
 
+struct bytecode_buffer {
+    const char *name;
+    const void *data;
+    size_t len;
+    bbool inplace;
+};
+
+static void bytecode_mem_loader(bvm *vm, void *data)
+{
+    struct bytecode_buffer *bb = cast(struct bytecode_buffer*, data);
+    bclosure *cl = be_bytecode_load_mem(vm, bb->name, bb->data, bb->len, bb->inplace);
+    var_setclosure(vm->top, cl);
+    be_incrtop(vm);
+}
+
+static int load_bytecode_mem(bvm *vm, struct bytecode_buffer *bb)
+{
+    int res;
+    struct vmstate state;
+    vm_state_save(vm, &state);
+    res = be_execprotected(vm, bytecode_mem_loader, bb);
+    if (res) { /* restore call stack */
+        vm_state_restore(vm, &state, res);
+    }
+    return res;
+}
+
+/* load the bytecode image in `buffer`, the closure is pushed on success */
+BERRY_API int be_loadbytecode(bvm *vm,
+    const char *name, const void *buffer, size_t length)
+{
+    struct bytecode_buffer bb;
+    bb.name = name;
+    bb.data = buffer;
+    bb.len = length;
+    bb.inplace = bfalse;
+    return load_bytecode_mem(vm, &bb);
+}
+
+/* like be_loadbytecode(), but the instructions are executed from `image`
+ * when its layout allows it (e.g. an image in a flash partition): it must
+ * stay mapped and unchanged while the loaded functions are alive */
+BERRY_API int be_mapbytecode(bvm *vm,
+    const char *name, const void *image, size_t length)
+{
+    struct bytecode_buffer bb;
+    bb.name = name;
+    bb.data = image;
+    bb.len = length;
+    bb.inplace = btrue;
+    return load_bytecode_mem(vm, &bb);
+}
+
 #else
 #define load_bytecode(vm, name) BE_SYNTAX_ERROR
 #endif /* BE_USE_BYTECODE_LOADER */
 
+#if BE_USE_BYTECODE_CACHE
+/* the cached bytecode is only valid for the same instruction set */
+static const char* const opcode_names[] = {
+    #define OPCODE(opc) #opc
+    #include "be_opcodes.h"
+    #undef OPCODE
+};
+
+struct cachesave {
+    const char *name;
+    const bcodestamp *stamp;
+};
+
+static uint32_t stamp_hash(uint32_t h, const void *data, size_t len)
+{
+    const bbyte *p = data;
+    while (len--) {
+        h = (h ^ *p++) * 16777619u; /* FNV-1a */
+    }
+    return h;
+}
+
+/* Compute the stamp of the source file `name`: its size and the hash of
+ * its content, of the compile options and of the instruction set */
+static bbool source_stamp(bvm *vm, const char *name, bcodestamp *stamp)
+{
+    size_t i, len;
+    uint32_t h = 2166136261u;
+    struct filebuf *fbuf = be_malloc(vm, sizeof(struct filebuf));
+    fbuf->fp = be_fopen(name, "r");
+    if (fbuf->fp == NULL) {
+        be_free(vm, fbuf, sizeof(struct filebuf));
+        return bfalse;
+    }
+    stamp->size = 0;
+    while ((len = be_fread(fbuf->fp, fbuf->buf, sizeof(fbuf->buf))) > 0) {
+        h = stamp_hash(h, fbuf->buf, len);
+        stamp->size += (uint32_t)len;
+    }
+    be_fclose(fbuf->fp);
+    be_free(vm, fbuf, sizeof(struct filebuf));
+    h = stamp_hash(h, &vm->compopt, sizeof(vm->compopt));
+    for (i = 0; i < array_count(opcode_names); ++i) {
+        h = stamp_hash(h, opcode_names[i], strlen(opcode_names[i]));
+    }
+    stamp->hash = h;
+    return btrue;
+}
+
+static void cache_save(bvm *vm, void *data)
+{
+    struct cachesave *cs = data;
+    bclosure *cl = var_toobj(vm->top - 1);
+    be_bytecode_save_stamp(vm, cs->name, cl->proto, cs->stamp);
+}
+
+/* Load the source file `name` through the compiled copy kept next to it,
+ * `name` followed by 'c'. The copy is used if it was made from the same
+ * source with the same compile options, otherwise the source is compiled
+ * and the copy is written again; a bytecode file that was not made by the
+ * cache still has priority over the source. Only the code compiled with
+ * named globals is cached, the indexes of the other globals depend on the
+ * globals defined before the import. Returns BE_IO_ERROR if `name` cannot
+ * be read. */
+int be_loadcached(bvm *vm, const char *name)
+{
+    int res, top = cast_int(vm->top - vm->stack);
+    bcodestamp src, bec;
+    size_t size = strlen(name) + 2;
+    struct cachesave cs;
+    char *becname;
+    if (!source_stamp(vm, name, &src)) {
+        return BE_IO_ERROR;
+    }
+    becname = be_malloc(vm, size);
+    strcpy(becname, name);
+    strcat(becname, "c");
+    if (!be_bytecode_stamp(becname, &bec)) { /* not a copy of the cache */
+        res = load_bytecode(vm, becname);
+        if (res != BE_SYNTAX_ERROR) { /* a bytecode file was found */
+            be_free(vm, becname, size);
+            return res;
+        }
+    } else if (comp_is_named_gbl(vm) &&
+               bec.size == src.size && bec.hash == src.hash) {
+        if (load_bytecode(vm, becname) == BE_OK) {
+            be_free(vm, becname, size);
+            return BE_OK;
+        }
+        vm->top = vm->stack + top; /* discard the error, compile the source */
+    }
+    res = fileparser(vm, name, btrue);
+    if (res == BE_OK && comp_is_named_gbl(vm)) {
+        struct vmstate state;
+        cs.name = becname;
+        cs.stamp = &src;
+        vm_state_save(vm, &state);
+        if (be_execprotected(vm, cache_save, &cs)) {
+            /* the copy cannot be written, e.g. read-only file system */
+            vm_state_restore(vm, &state, BE_OK);
+        }
+    }
+    be_free(vm, becname, size);
+    return res;
+}
+#endif /* BE_USE_BYTECODE_CACHE */
+
 BERRY_API int be_loadmode(bvm *vm, const char *name, bbool islocal)
 {
     int res = load_bytecode(vm, name);
@@ -346,7 +510,19 @@ BERRY_API void be_stack_require(bvm *vm, int count)
         be_stack_expansion(vm, count);
     }
 #else
-    be_stack_expansion(vm, vm->top - vm->stacktop + count);     /* force exact resize each time */
+    /* force exact resize each time, but keep the registers of the suspended
+     * frames: a callee (e.g. the compiler of a lazy function) may run below
+     * the top of its caller */
+    bvalue *top = vm->top;
+    bcallframe *cf = be_stack_base(&vm->callstack);
+    bcallframe *end = be_stack_top(&vm->callstack);
+    for (; cf <= end; ++cf) {
+        top = cf->top > top ? cf->top : top;
+    }
+    if (vm->cf == &vm->leafcf && vm->leafcf.top > top) {
+        top = vm->leafcf.top;
+    }
+    be_stack_expansion(vm, top - vm->stacktop + count);
 #endif
 }
 
@@ -360,6 +536,11 @@ static void update_callstack(bvm *vm, intptr_t offset)
         fixup_ptr(cf->top, offset);
         fixup_ptr(cf->reg, offset);
     }
+    if (vm->cf == &vm->leafcf) { /* a leaf native function is running */
+        fixup_ptr(vm->leafcf.func, offset);
+        fixup_ptr(vm->leafcf.top, offset);
+        fixup_ptr(vm->leafcf.reg, offset);
+    }
     fixup_ptr(vm->top, offset);
     fixup_ptr(vm->reg, offset);
 }
@@ -414,87 +595,48 @@ void be_stack_expansion(bvm *vm, int n)
     stack_resize(vm, size + n);
 }
 
-static void fixup_exceptstack(bvm* vm, struct bexecptframe* lbase)
-{
-    struct bexecptframe *base = be_stack_base(&vm->exceptstack);
-    if (lbase != base) { /* the address has changed when the stack is expanded */
-        struct bexecptframe *top = be_stack_top(&vm->exceptstack);
-        bbyte *begin = (bbyte*)&lbase->errjmp;
-        bbyte *end = (bbyte*)&(lbase + (top - base))->errjmp;
-        intptr_t offset = ptr_offset(base, lbase);
-        struct blongjmp *errjmp = vm->errjmp;
-        while (errjmp) {
-            bbyte *prev = (bbyte*)errjmp->prev;
-            if (prev >= begin && prev < end) {
-                fixup_ptr(prev, offset); /* fixup the prev pointer */
-                errjmp->prev = (struct blongjmp*)prev;
+/* find the `try` block that catches an exception raised while the frames
+ * from `depth` of the call stack were running. The blocks are looked up by
+ * the instruction pointer of each frame in the ranges recorded by the
+ * compiler, so entering and leaving a `try` block costs nothing. If a block
+ * is found, the VM state is restored to its frame, the exception is copied
+ * to the top of this frame and the execution resumes at the `except` chain.
+ * `refcount` is the size of the object reference stack in these frames. */
+bbool be_except_block_resume(bvm *vm, int depth, int refcount)
+{
+    binstruction *ip = vm->ip;
+    int level = be_stack_count(&vm->callstack);
+    while (level-- > depth) {
+        bcallframe *cf = be_vector_at(&vm->callstack, level);
+        if (!(cf->status & PRIM_FUNC)) { /* native frames keep `vm->ip` */
+            bproto *proto = cast(bclosure*, var_toobj(cf->func))->proto;
+            int i, pc = cast_int(ip - proto->code) - 1;
+            for (i = 0; i < proto->ntryranges; ++i) {
+                btryrange *range = proto->tryranges + i;
+                if (pc > range->beginpc && pc < range->endpc) {
+                    binstruction *exblk = proto->code + range->beginpc;
+                    bvalue e1 = vm->top[0], e2 = vm->top[1]; /* the frames may overlap */
+                    if (level + 1 < be_stack_count(&vm->callstack)) {
+                        bcallframe *callee = cf + 1;
+                        vm->top = callee->top;
+                        vm->reg = callee->reg;
+                        be_vector_resize(vm, &vm->callstack, level + 1);
+                    } else if (vm->cf == &vm->leafcf) { /* raised by a leaf native function */
+                        vm->top = vm->leafcf.top;
+                        vm->reg = vm->leafcf.reg;
+                    }
+                    vm->cf = be_vector_at(&vm->callstack, level);
+                    be_vector_resize(vm, &vm->refstack, refcount);
+                    vm->top[0] = e1; /* exception value */
+                    vm->top[1] = e2; /* exception argument */
+                    vm->ip = exblk + 1 + IGET_sBx(*exblk);
+                    return btrue;
+                }
             }
-            errjmp = (struct blongjmp*)prev;
+            ip = cf->ip; /* the caller was suspended at `cf->ip` */
         }
     }
-}
-
-/* set an exception handling recovery point. To do this, we have to
- * push some VM states into the exception stack. */
-void be_except_block_setup(bvm *vm)
-{
-    struct bexecptframe *frame;
-    struct bexecptframe *lbase = be_stack_base(&vm->exceptstack);
-    be_stack_push(vm, &vm->exceptstack, NULL);
-    frame = be_stack_top(&vm->exceptstack);
-    frame->depth = be_stack_count(&vm->callstack); /* the call stack depth */
-    frame->ip = vm->ip; /* OP_EXBLK's next instruction pointer */
-    /* set longjmp() jump point */
-    frame->errjmp.status = 0;
-    frame->errjmp.prev = vm->errjmp; /* save long jump list */
-    frame->refcount = vm->refstack.count; /* save reference pointer */
-    vm->errjmp = &frame->errjmp;
-    fixup_exceptstack(vm, lbase);
-}
-
-/* resumes to the state of the previous frame when an exception occurs. */
-void be_except_block_resume(bvm *vm)
-{
-    int errorcode = vm->errjmp->status;
-    struct bexecptframe *frame = be_stack_top(&vm->exceptstack);
-    if (errorcode == BE_EXCEPTION) {
-        vm->errjmp = vm->errjmp->prev;
-        be_vector_resize(vm, &vm->refstack, frame->refcount);
-        /* jump to except instruction */
-        vm->ip = frame->ip + IGET_sBx(frame->ip[-1]);
-        if (be_stack_count(&vm->callstack) > frame->depth) {
-            bvalue *top = vm->top;
-            bcallframe *cf = be_vector_at(&vm->callstack, frame->depth);
-            vm->top = cf->top;
-            vm->reg = cf->reg;
-            vm->cf = frame->depth ? cf - 1 : NULL;
-            be_vector_resize(vm, &vm->callstack, frame->depth);
-            /* copy the exception value and argument to the top of
-             * the current function */
-            vm->top[0] = top[0]; /* exception value */
-            vm->top[1] = top[1]; /* exception argument */
-        }
-        be_stack_pop(&vm->exceptstack);
-    } else { /* other errors cannot be catch by the except block */
-        /* find the next error handling location */
-        while (vm->errjmp == &frame->errjmp) {
-            vm->errjmp = vm->errjmp->prev;
-            be_stack_pop(&vm->exceptstack);
-            frame = be_stack_top(&vm->exceptstack);
-        }
-        be_throw(vm, errorcode); /* rethrow this exception */
-    }
-}
-
-/* only close the except block, no other operations */
-void be_except_block_close(bvm *vm, int count)
-{
-    struct bexecptframe *frame;
-    int size = be_stack_count(&vm->exceptstack);
-    be_assert(count > 0 && count <= size);
-    frame = be_vector_at(&vm->exceptstack, size - count);
-    vm->errjmp = frame->errjmp.prev;
-    be_vector_resize(vm, &vm->exceptstack, size - count);
+    return bfalse;
 }
 
 void be_save_stacktrace(bvm *vm)
@@ -41,23 +41,15 @@ struct blongjmp {
     volatile int status; /* error code */
 };
 
-struct bexecptframe {
-    struct blongjmp errjmp; /* long jump information */
-    int depth; /* function call stack depth */
-    binstruction *ip; /* instruction pointer */
-    int refcount; /* save object reference stack */
-};
-
 void be_throw(bvm *vm, int errorcode);
 int be_execprotected(bvm *vm, bpfunc f, void *data);
 int be_protectedparser(bvm *vm, const char *fname,
     breader reader, void *data, bbool islocal);
+int be_loadcached(bvm *vm, const char *name);
 int be_protectedcall(bvm *vm, bvalue *v, int argc);
 void be_stackpush(bvm *vm);
 void be_stack_expansion(bvm *vm, int n);
-void be_except_block_setup(bvm *vm);
-void be_except_block_resume(bvm *vm);
-void be_except_block_close(bvm *vm, int count);
+bbool be_except_block_resume(bvm *vm, int depth, int refcount);
 void be_save_stacktrace(bvm *vm);
 
 #endif
@@ -63,6 +63,8 @@ void be_upvals_close(bvm *vm, bvalue *level)
             } else {
                 node->u.value = *node->value; /* move value to upvalue slot */
                 node->value = &node->u.value;
+                /* the stack is not scanned again for this value */
+                be_gc_barriervar(vm, node->value);
             }
             *prev = next;   /* remove from linked list */
         } else {
@@ -117,6 +119,14 @@ bproto* be_newproto(bvm *vm)
         p->varinfo = NULL;
         p->nvarinfo = 0;
 #endif
+#if BE_USE_INLINE_CACHE
+        p->icache = NULL;
+        p->icindex = NULL;
+        p->nicache = 0;
+#endif
+        p->tryranges = NULL;
+        p->ntryranges = 0;
+        p->cls = NULL;
     }
     return p;
 }
@@ -16,6 +16,14 @@
 #define be_ntvclos_upval(cc, n) \
     (((bupval**)((size_t)cc + sizeof(bntvclos)))[n])
 
+/* exmark of a proto whose instructions and `try` blocks are read in place
+ * from a bytecode image, they are not owned by the proto */
+#define BE_PROTO_INPLACE    1
+
+/* the instructions of a solidified or in-place proto are never rewritten */
+#define proto_isreadonly(p) \
+    (gc_isconst(p) || (gc_exmark(p) & BE_PROTO_INPLACE))
+
 void be_initupvals(bvm *vm, bclosure *cl);
 void be_upvals_close(bvm *vm, bvalue *level);
 void be_release_upvalues(bvm *vm, bclosure *cl);
@@ -18,29 +18,55 @@
 #include "be_module.h"
 #include "be_exec.h"
 #include "be_debug.h"
+#include <time.h>
 
 #define GC_PAUSE    (1 << 0) /* GC will not be executed automatically */
 #define GC_HALT     (1 << 1) /* GC completely stopped */
 #define GC_ALLOC    (1 << 2) /* GC in alloc */
 
+/* 1 in GC_PACE_SAMPLE of the incremental steps is timed for the pacer,
+ * reading the clock may cost as much as a step */
+#define GC_PACE_SAMPLE      8
+
+#define gc_clock()          ((unsigned long)clock())
+
 #define gc_try(expr)        be_assert(expr); if (expr)
-#define gc_setdark_safe(o)  if (o) gc_setdark(o)
 
 #define next_threshold(gc)  ((gc).usage * ((size_t)(gc).steprate + 100) / 100)
+/* the nursery grows with the heap so the scans of the remembered set
+ * are paid by the allocations */
+#define next_minor(gc)      ((gc).usage + ((gc).nursery > (gc).usage / 4 ? (gc).nursery : (gc).usage / 4))
 
 #define link_gray(vm, obj)     {    \
     (obj)->gray = (vm)->gc.gray;    \
     (vm)->gc.gray = gc_object(obj); \
 }
 
+#define link_grayagain(vm, obj)     {   \
+    (obj)->gray = (vm)->gc.grayagain;   \
+    (vm)->gc.grayagain = gc_object(obj); \
+}
+
 static void destruct_object(bvm *vm, bgcobject *obj);
 static void free_object(bvm *vm, bgcobject *obj);
 
 void be_gc_init(bvm *vm)
 {
     vm->gc.usage = sizeof(bvm);
+    vm->gc.stepsize = BE_GC_STEP_SIZE;
+    vm->gc.promoteage = BE_GC_PROMOTE_AGE;
+    vm->gc.nursery = BE_GC_NURSERY_SIZE;
     be_gc_setsteprate(vm, 200);
+    vm->gc.pace.pacer = be_gc_pace;
+    vm->gc.pace.limit = BE_GC_HEAP_LIMIT;
+    vm->gc.pace.cpushare = BE_GC_CPU_SHARE;
+    vm->gc.pace.survival = 1000;
+    vm->gc.pace.clock = gc_clock();
     be_gc_init_memory_pools(vm);
+    be_vector_init(vm, &vm->gc.remembered, sizeof(bgcobject*));
+    be_vector_init(vm, &vm->gc.youngstr, sizeof(bstring*));
+    vm->gc.minorthreshold = next_minor(vm->gc);
+    vm->gc.pace.live = vm->gc.usage;
 }
 
 void be_gc_deleteall(bvm *vm)
@@ -58,6 +84,8 @@ void be_gc_deleteall(bvm *vm)
         next = node->next;
         free_object(vm, node);
     }
+    be_vector_delete(vm, &vm->gc.remembered);
+    be_vector_delete(vm, &vm->gc.youngstr);
     /* delete open upvalue list */
     for (uv = vm->upvalist; uv; uv = uvnext) {
         uvnext = uv->u.next;
@@ -72,6 +100,26 @@ void be_gc_setsteprate(bvm *vm, int rate)
     vm->gc.threshold = next_threshold(vm->gc);
 }
 
+/* set the ceiling of the memory in use (0 for none) and the maximum
+ * share of the time spent by the GC in percent (0 for none), the next
+ * cycle starts at the ceiling if it is lower than the threshold */
+void be_gc_setpace(bvm *vm, size_t limit, int cpushare)
+{
+    be_assert(cpushare >= 0 && cpushare < 100);
+    vm->gc.pace.limit = limit;
+    vm->gc.pace.cpushare = (bbyte)cpushare;
+    if (limit && vm->gc.state == GC_SPAUSE && vm->gc.threshold > limit) {
+        vm->gc.threshold = limit;
+    }
+}
+
+/* set the function computing the threshold of the next cycle, NULL
+ * restores be_gc_pace() */
+void be_gc_setpacer(bvm *vm, bgcpacer pacer)
+{
+    vm->gc.pace.pacer = pacer ? pacer : be_gc_pace;
+}
+
 void be_gc_setpause(bvm *vm, int pause)
 {
     if (pause) {
@@ -85,10 +133,13 @@ bgcobject* be_newgcobj(bvm *vm, int type, size_t size)
 {
     bgcobject *obj = be_malloc(vm, size);
     be_gc_auto(vm);
-    var_settype(obj, (bbyte)type); /* mark the object type */
+    obj->type = (bbyte)type; /* mark the object type */
     obj->marked = GC_WHITE; /* default gc object type is white */
     obj->next = vm->gc.list; /* link to the next field */
     vm->gc.list = obj; /* insert to head */
+    if (vm->gc.sweep == &vm->gc.list) { /* the new objects are not swept */
+        vm->gc.sweep = &obj->next;
+    }
     return obj;
 }
 
@@ -100,16 +151,22 @@ bgcobject* be_gc_newstr(bvm *vm, size_t size, int islong)
     }
     obj = be_malloc(vm, size);
     be_gc_auto(vm);
-    var_settype(obj, BE_STRING); /* mark the object type to BE_STRING */
-    obj->marked = GC_WHITE; /* default string type is white */
+    obj->type = BE_STRING; /* mark the object type to BE_STRING */
+    /* default string type is white, the string table is swept after the
+     * atomic phase so the strings created since then are kept */
+    obj->marked = vm->gc.state > GC_SATOMIC ? GC_DARK : GC_WHITE;
     return obj;
 }
 
+static void mark_gray(bvm *vm, bgcobject *obj);
+
 void be_gc_fix(bvm *vm, bgcobject *obj)
 {
-    (void)vm;
     if (!gc_isconst(obj)) {
         gc_setfixed(obj);
+        if (vm->gc.state == GC_SPROPAGATE) { /* the search of the fixed objects may be done */
+            mark_gray(vm, obj);
+        }
     }
 }
 
@@ -123,11 +180,13 @@ void be_gc_unfix(bvm *vm, bgcobject *obj)
 
 bbool be_gc_fix_set(bvm *vm, bgcobject *obj, bbool fix)
 {
-    (void)vm;
     bbool was_fixed = gc_isfixed(obj);
     if (!gc_isconst(obj)) {
         if (fix) {
             gc_setfixed(obj);
+            if (vm->gc.state == GC_SPROPAGATE) {
+                mark_gray(vm, obj);
+            }
         } else {
             gc_clearfixed(obj);
         }
@@ -135,23 +194,35 @@ bbool be_gc_fix_set(bvm *vm, bgcobject *obj, bbool fix)
     return was_fixed;
 }
 
+static void link_object(bvm *vm, bgcobject *obj)
+{
+    gc_setgray(obj);
+    switch (obj->type) {
+    case BE_STRING: gc_setdark(obj); break; /* just set dark */
+    case BE_CLASS: link_gray(vm, cast_class(obj)); break;
+    case BE_PROTO: link_gray(vm, cast_proto(obj)); break;
+    case BE_INSTANCE: link_gray(vm, cast_instance(obj)); break;
+    case BE_MAP: link_gray(vm, cast_map(obj)); break;
+    case BE_LIST: link_gray(vm, cast_list(obj)); break;
+    case BE_CLOSURE: link_gray(vm, cast_closure(obj)); break;
+    case BE_NTVCLOS: link_gray(vm, cast_ntvclos(obj)); break;
+    case BE_MODULE: link_gray(vm, cast_module(obj)); break;
+    case BE_COMOBJ: gc_setdark(obj); break; /* just set dark */
+    default: break;
+    }
+}
+
 static void mark_gray(bvm *vm, bgcobject *obj)
 {
-    if (obj && gc_iswhite(obj) && !gc_isconst(obj)) {
-        gc_setgray(obj);
-        be_assert(!var_isstatic(obj));
-        switch (var_primetype(obj)) {
-        case BE_STRING: gc_setdark(obj); break; /* just set dark */
-        case BE_CLASS: link_gray(vm, cast_class(obj)); break;
-        case BE_PROTO: link_gray(vm, cast_proto(obj)); break;
-        case BE_INSTANCE: link_gray(vm, cast_instance(obj)); break;
-        case BE_MAP: link_gray(vm, cast_map(obj)); break;
-        case BE_LIST: link_gray(vm, cast_list(obj)); break;
-        case BE_CLOSURE: link_gray(vm, cast_closure(obj)); break;
-        case BE_NTVCLOS: link_gray(vm, cast_ntvclos(obj)); break;
-        case BE_MODULE: link_gray(vm, cast_module(obj)); break;
-        case BE_COMOBJ: gc_setdark(obj); break; /* just set dark */
-        default: break;
+    if (obj && !gc_isconst(obj)) {
+        if (vm->gc.state == GC_SMINOR) {
+            if (gc_isold(obj)) {
+                return; /* a minor collection keeps the old objects */
+            }
+            vm->gc.youngref = btrue;
+        }
+        if (gc_iswhite(obj)) {
+            link_object(vm, obj);
         }
     }
 }
@@ -208,14 +279,17 @@ static void mark_proto(bvm *vm, bgcobject *obj)
         for (count = p->nproto; count--; ++ptab) {
             mark_gray(vm, gc_object(*ptab));
         }
-        gc_setdark_safe(p->name);
-        gc_setdark_safe(p->source);
+        mark_gray(vm, gc_object(p->name));
+        mark_gray(vm, gc_object(p->source));
+        if (p->cls) {
+            mark_gray(vm, gc_object(p->cls));
+        }
 #if BE_DEBUG_VAR_INFO
         if (p->nvarinfo) {
             bvarinfo *vinfo = p->varinfo;
             be_assert(vinfo != NULL);
             for (count = p->nvarinfo; count--; ++vinfo) {
-                gc_setdark_safe(vinfo->name);
+                mark_gray(vm, gc_object(vinfo->name));
             }
         }
 #endif
@@ -298,12 +372,21 @@ static void free_proto(bvm *vm, bgcobject *obj)
         be_free(vm, proto->upvals, proto->nupvals * sizeof(bupvaldesc));
         be_free(vm, proto->ktab, proto->nconst * sizeof(bvalue));
         be_free(vm, proto->ptab, proto->nproto * sizeof(bproto*));
-        be_free(vm, proto->code, proto->codesize * sizeof(binstruction));
+        if (!(gc_exmark(proto) & BE_PROTO_INPLACE)) {
+            be_free(vm, proto->code, proto->codesize * sizeof(binstruction));
+            be_free(vm, proto->tryranges, proto->ntryranges * sizeof(btryrange));
+        }
 #if BE_DEBUG_RUNTIME_INFO
         be_free(vm, proto->lineinfo, proto->nlineinfo * sizeof(blineinfo));
 #endif
 #if BE_DEBUG_VAR_INFO
         be_free(vm, proto->varinfo, proto->nvarinfo * sizeof(bvarinfo));
+#endif
+#if BE_USE_INLINE_CACHE
+        if (proto->icache) {
+            be_free(vm, proto->icache, proto->nicache * sizeof(bicache)
+                + proto->codesize * sizeof(uint16_t));
+        }
 #endif
         be_free(vm, proto, sizeof(bproto));
     }
@@ -337,10 +420,19 @@ static void free_lstring(bvm *vm, bgcobject *obj)
 {
     blstring *ls = gc_cast(obj, BE_STRING, blstring);
     gc_try (ls != NULL)  {
-        be_free(vm, ls, sizeof(blstring) + ls->llen + 1);
+        be_global_cache_forget(vm, cast(bstring*, ls));
+        be_free(vm, ls, sizeof(blstring) + ls->lcap + 1);
     }
 }
 
+static void free_class(bvm *vm, bgcobject *obj)
+{
+#if BE_USE_INLINE_CACHE
+    be_icache_invalidate(vm); /* the address may be reused by a new class */
+#endif
+    be_free(vm, obj, sizeof(bclass));
+}
+
 static void free_instance(bvm *vm, bgcobject *obj)
 {
     binstance *o = cast_instance(obj);
@@ -350,9 +442,9 @@ static void free_instance(bvm *vm, bgcobject *obj)
 
 static void free_object(bvm *vm, bgcobject *obj)
 {
-    switch (var_primetype(obj)) {
+    switch (obj->type) {
     case BE_STRING: free_lstring(vm, obj); break; /* long string */
-    case BE_CLASS: be_free(vm, obj, sizeof(bclass)); break;
+    case BE_CLASS: free_class(vm, obj); break;
     case BE_INSTANCE: free_instance(vm, obj); break;
     case BE_MAP: be_map_delete(vm, cast_map(obj)); break;
     case BE_LIST: be_list_delete(vm, cast_list(obj)); break;
@@ -417,40 +509,147 @@ static void premark_tracestack(bvm *vm)
     }
 }
 
-static void premark_fixed(bvm *vm)
+/* search the fixed objects from the start of the cycle, the objects fixed
+ * during the cycle are marked by be_gc_fix(), returns the work done */
+static size_t premark_fixed(bvm *vm, size_t budget)
 {
-    bgcobject *node = vm->gc.list;
-    for (; node; node = node->next) {
+    size_t work = 0;
+    bgcobject *node = vm->gc.cursor;
+    for (; node && work < budget; node = node->next, ++work) {
         if (gc_isfixed(node) && gc_iswhite(node)) {
             mark_gray(vm, node);
         }
     }
+    vm->gc.cursor = node;
+    return work;
 }
 
-static void mark_unscanned(bvm *vm)
+/* scan the object at the head of the gray list, returns the work done */
+static size_t scan_gray(bvm *vm)
 {
-    while (vm->gc.gray) {
-        bgcobject *obj = vm->gc.gray;
-        if (obj && !gc_isdark(obj) && !gc_isconst(obj)) {
-            gc_setdark(obj);
-            be_assert(!var_isstatic(obj));
-            switch (var_primetype(obj)) {
-            case BE_CLASS: mark_class(vm, obj); break;
-            case BE_PROTO: mark_proto(vm, obj); break;
-            case BE_INSTANCE: mark_instance(vm, obj); break;
-            case BE_MAP: mark_map(vm, obj); break;
-            case BE_LIST: mark_list(vm, obj); break;
-            case BE_CLOSURE: mark_closure(vm, obj); break;
-            case BE_NTVCLOS: mark_ntvclos(vm, obj); break;
-            case BE_MODULE: mark_module(vm, obj); break;
-            default:
-                be_assert(0); /* error */
-                break;
-            }
+    bgcobject *obj = vm->gc.gray;
+    be_assert(!gc_isdark(obj) && !gc_isconst(obj));
+    gc_setdark(obj);
+    switch (obj->type) {
+    case BE_CLASS:
+        mark_class(vm, obj);
+        return 4;
+    case BE_PROTO:
+        mark_proto(vm, obj);
+        return 1 + (size_t)cast_proto(obj)->nconst + cast_proto(obj)->nproto;
+    case BE_INSTANCE:
+        mark_instance(vm, obj);
+        return 1 + (size_t)be_instance_member_count(cast_instance(obj));
+    case BE_MAP:
+        mark_map(vm, obj);
+        return 1 + (size_t)cast_map(obj)->size;
+    case BE_LIST:
+        mark_list(vm, obj);
+        return 1 + (size_t)be_list_count(cast_list(obj));
+    case BE_CLOSURE:
+        mark_closure(vm, obj);
+        return 1 + (size_t)cast_closure(obj)->nupvals;
+    case BE_NTVCLOS:
+        mark_ntvclos(vm, obj);
+        return 1 + (size_t)cast_ntvclos(obj)->nupvals;
+    case BE_MODULE:
+        mark_module(vm, obj);
+        return 2;
+    default:
+        be_assert(0); /* error */
+        return 1;
+    }
+}
+
+/* scan the gray objects until `budget` work is done, returns the work done */
+static size_t propagate(bvm *vm, size_t budget)
+{
+    size_t work = 0;
+    while (vm->gc.gray && work < budget) {
+        work += scan_gray(vm);
+    }
+    return work;
+}
+
+/* add an old object to the remembered set, its references to the young
+ * objects are then scanned by the next minor collections */
+static void remember(bvm *vm, bgcobject *obj)
+{
+    if (!gc_istouched(obj) && obj->type != BE_STRING && obj->type != BE_COMOBJ) {
+        obj->marked |= GC_TOUCHED;
+        be_vector_push(vm, &vm->gc.remembered, &obj);
+    }
+}
+
+/* forget the remembered set, done once the major cycle has marked the
+ * whole heap */
+static void forget_remembered(bvm *vm)
+{
+    bgcobject **obj = be_vector_data(&vm->gc.remembered);
+    bgcobject **end = obj + be_vector_count(&vm->gc.remembered);
+    for (; obj < end; ++obj) {
+        (*obj)->marked &= ~GC_TOUCHED;
+    }
+    be_vector_clear(&vm->gc.remembered);
+}
+
+void be_gc_barrierback(bvm *vm, bgcobject *obj)
+{
+    if (vm->gc.state == GC_SPROPAGATE) {
+        be_assert(gc_isdark(obj));
+        gc_setmark(obj, GC_AGAIN);
+        switch (obj->type) {
+        case BE_CLASS: link_grayagain(vm, cast_class(obj)); break;
+        case BE_PROTO: link_grayagain(vm, cast_proto(obj)); break;
+        case BE_INSTANCE: link_grayagain(vm, cast_instance(obj)); break;
+        case BE_MAP: link_grayagain(vm, cast_map(obj)); break;
+        case BE_LIST: link_grayagain(vm, cast_list(obj)); break;
+        case BE_CLOSURE: link_grayagain(vm, cast_closure(obj)); break;
+        case BE_NTVCLOS: link_grayagain(vm, cast_ntvclos(obj)); break;
+        case BE_MODULE: link_grayagain(vm, cast_module(obj)); break;
+        default: break;
+        }
+    } else if (vm->gc.promoteage) {
+        /* the object is old or kept by the cycle in progress, which then
+         * promotes it, but the destructors may also change unreachable
+         * old objects and the dark young objects of a minor collection */
+        if (vm->gc.state == GC_SDESTRUCT ? gc_isdark(obj)
+                : vm->gc.state != GC_SMINOR || gc_isold(obj)) {
+            remember(vm, obj);
         }
     }
 }
 
+void be_gc_markvar(bvm *vm, bvalue *v)
+{
+    mark_gray_var(vm, v);
+}
+
+/* the marking is completed at once: the roots may have changed since the
+ * start of the cycle and the objects changed after their scan are scanned
+ * again, returns the work done */
+static size_t atomic(bvm *vm)
+{
+    size_t work;
+    vm->gc.state = GC_SATOMIC;
+    be_assert(vm->gc.gray == NULL);
+    vm->gc.gray = vm->gc.grayagain;
+    vm->gc.grayagain = NULL;
+    premark_internal(vm);
+    premark_global(vm);
+    premark_stack(vm);
+    premark_tracestack(vm);
+    work = propagate(vm, (size_t)-1);
+    forget_remembered(vm); /* all the reachable objects are marked */
+    be_vector_clear(&vm->gc.youngstr); /* swept with the string table */
+    /* the objects created from now on are inserted before the ones of
+     * the cycle and are kept until the next cycle */
+    vm->gc.sweep = &vm->gc.list;
+    vm->gc.cursor = vm->gc.list;
+    vm->gc.state = GC_SDESTRUCT;
+    return work;
+}
+
 static void destruct_object(bvm *vm, bgcobject *obj)
 {
     if (vm->gc.status & GC_ALLOC) {
@@ -472,39 +671,70 @@ static void destruct_object(bvm *vm, bgcobject *obj)
     }
 }
 
-static void destruct_white(bvm *vm)
+/* call the destructors of the unreachable objects, returns the work done */
+static size_t destruct_white(bvm *vm, size_t budget)
 {
-    bgcobject *node = vm->gc.list;
-    /* since the destructor may allocate objects, we must first suspend the GC */
-    vm->gc.status |= GC_HALT; /* mark GC is halt */
-    while (node) {
+    size_t work = 0;
+    bgcobject *node = vm->gc.cursor;
+    for (; node && work < budget; node = node->next, ++work) {
         if (gc_iswhite(node)) {
             destruct_object(vm, node);
         }
-        node = node->next;
     }
-    vm->gc.status &= ~GC_HALT; /* reset GC halt flag */
+    vm->gc.cursor = node;
+    return work;
 }
 
-static void delete_white(bvm *vm)
+/* free the unreachable objects, the objects keep their order in the list
+ * since an instance is freed with the help of its class, returns the work
+ * done */
+static size_t delete_white(bvm *vm, size_t budget)
 {
-    bgcobject *node, *prev, *next;
-    for (node = vm->gc.list, prev = node; node; node = next) {
-        next = node->next;
+    size_t work = 0;
+    bgcobject *node;
+    while ((node = *vm->gc.sweep) != NULL && work < budget) {
         if (gc_iswhite(node)) {
-            if (node == vm->gc.list) { /* first node */
-                vm->gc.list = node->next;
-                prev = node->next;
-            } else { /* not first node */
-                prev->next = next;
-            }
+            *vm->gc.sweep = node->next;
             free_object(vm, node);
 #if BE_USE_PERF_COUNTERS
             vm->counter_gc_freed++;
 #endif
         } else {
-            gc_setwhite(node);
-            prev = node;
+            be_gc_survive(vm, node);
+            vm->gc.sweep = &node->next;
+        }
+        ++work;
+    }
+    return work;
+}
+
+/* the closures with upvalues are kept in the remembered set since the
+ * closed upvalues change without a barrier */
+static bbool has_upvals(bgcobject *obj)
+{
+    return (obj->type == BE_CLOSURE && cast_closure(obj)->nupvals)
+        || (obj->type == BE_NTVCLOS && cast_ntvclos(obj)->nupvals);
+}
+
+/* reset an object kept by a collection and count the collections it has
+ * survived. An object promoted by a minor collection may still reference
+ * younger objects, it is remembered until the next minor collection. */
+void be_gc_survive(bvm *vm, bgcobject *obj)
+{
+    gc_setwhite(obj);
+    if (vm->gc.promoteage) {
+        if (vm->gc.state != GC_SMINOR) { /* all the survivors of a major cycle */
+            gc_setage(obj, GC_OLD_AGE);
+            if (has_upvals(obj)) {
+                remember(vm, obj);
+            }
+        } else if (!gc_isold(obj)) {
+            if (gc_age(obj) + 1 < vm->gc.promoteage) {
+                gc_setage(obj, gc_age(obj) + 1);
+            } else {
+                gc_setage(obj, GC_OLD_AGE);
+                remember(vm, obj);
+            }
         }
     }
 }
@@ -519,15 +749,289 @@ static void reset_fixedlist(bvm *vm)
     }
 }
 
+/* step 1: set root-set reference objects to unscanned */
+static void start_cycle(bvm *vm)
+{
+#if BE_USE_PERF_COUNTERS
+    be_gc_memory_pools_info(vm, &vm->gc_slots_used_before, &vm->gc_slots_allocated_before, NULL);
+    vm->counter_gc_kept = 0;
+    vm->counter_gc_freed = 0;
+#endif
+    if (vm->obshook != NULL) (*vm->obshook)(vm, BE_OBS_GC_START, vm->gc.usage);
+    vm->gc.pace.start = vm->gc.usage;
+    vm->gc.pace.startfreed = vm->gc.pace.freed;
+    vm->gc.state = GC_SPROPAGATE;
+    vm->gc.cursor = vm->gc.list; /* search of the fixed objects */
+    premark_internal(vm); /* object internal the VM */
+    premark_global(vm); /* global objects */
+    premark_stack(vm); /* stack objects */
+    premark_tracestack(vm); /* trace stack objects */
+}
+
+static void finish_cycle(bvm *vm)
+{
+    vm->gc.state = GC_SPAUSE;
+    /* reset the fixed objects */
+    reset_fixedlist(vm);
+    vm->gc.minorthreshold = next_minor(vm->gc);
+}
+
+/* the default pacer: the heap grows by `steprate` percent of the memory
+ * in use, or more if the GC would take more than `cpushare` of the time,
+ * but not beyond the ceiling */
+size_t be_gc_pace(bvm *vm)
+{
+    struct bgcpace *pace = &vm->gc.pace;
+    size_t live = vm->gc.usage;
+    size_t growth = next_threshold(vm->gc) - live;
+    if (pace->cpushare && pace->gctime && pace->elapsed > pace->gctime) {
+        /* the heap grows by the allocation surviving the minor collections,
+         * the next cycle must start after at least gctime * (100 - cpushare)
+         * / cpushare of time out of the GC */
+        double rate = (double)pace->allocated * pace->survival / 1000
+            / (double)(pace->elapsed - pace->gctime);
+        double least = rate * (double)pace->gctime
+            * (100 - pace->cpushare) / pace->cpushare;
+        if (least > (double)growth) {
+            growth = least < (double)((size_t)-1 - live) ? (size_t)least : (size_t)-1 - live;
+        }
+    }
+    if (pace->limit) { /* keep room for the allocation during the cycle */
+        size_t room = pace->limit > live + pace->cyclealloc ?
+            pace->limit - live - pace->cyclealloc : 0;
+        if (growth > room) {
+            growth = room;
+        }
+    }
+    /* the live objects may leave no room under the ceiling */
+    if (growth < vm->gc.nursery) {
+        growth = vm->gc.nursery;
+    }
+    return live + growth;
+}
+
+/* account a GC pause to the current period: the memory it freed and its
+ * time, measured from `start` if `scale` is not 0 and scaled for the
+ * steps not timed */
+static void pace_pause(bvm *vm, size_t usage, unsigned long start, int scale)
+{
+    struct bgcpace *pace = &vm->gc.pace;
+    if (usage > vm->gc.usage) {
+        pace->freed += usage - vm->gc.usage;
+    }
+    if (scale) {
+        unsigned long time = gc_clock() - start;
+        pace->curgctime += time * (unsigned long)scale;
+        if (time > pace->curmaxpause) {
+            pace->curmaxpause = time;
+        }
+    }
+}
+
+/* end the period with the cycle: the measures are saved and the pacer
+ * computes the next threshold */
+static void end_cycle(bvm *vm)
+{
+    struct bgcpace *pace = &vm->gc.pace;
+    unsigned long now = gc_clock();
+    size_t last = pace->live, usage = vm->gc.usage;
+    /* the allocation of the period before the start of the cycle, the
+     * memory freed out of the GC is not counted */
+    size_t before = pace->start + pace->startfreed > last ?
+        pace->start + pace->startfreed - last : 0;
+    pace->allocated = usage + pace->freed > last ? usage + pace->freed - last : 0;
+    pace->cyclealloc = pace->allocated > before ? pace->allocated - before : 0;
+    pace->survival = pace->start <= last ? 0 : before == 0 ? 1000 :
+        (unsigned int)((double)(pace->start - last) * 1000 / (double)before);
+    pace->elapsed = now - pace->clock;
+    pace->gctime = pace->curgctime;
+    pace->maxpause = pace->curmaxpause;
+    pace->live = usage;
+    pace->freed = pace->startfreed = 0;
+    pace->curgctime = pace->curmaxpause = 0;
+    pace->clock = now;
+    vm->gc.threshold = pace->pacer(vm);
+#if BE_USE_PERF_COUNTERS
+    size_t slors_used_after_gc, slots_allocated_after_gc;
+    be_gc_memory_pools_info(vm, &slors_used_after_gc, &slots_allocated_after_gc, NULL);
+    if (vm->obshook != NULL) (*vm->obshook)(vm, BE_OBS_GC_END, vm->gc.usage, vm->counter_gc_kept, vm->counter_gc_freed,
+                                            vm->gc_slots_used_before, vm->gc_slots_allocated_before,
+                                            slors_used_after_gc, slots_allocated_after_gc);
+#else
+    if (vm->obshook != NULL) (*vm->obshook)(vm, BE_OBS_GC_END, vm->gc.usage);
+#endif
+}
+
+/* do `budget` work of the current cycle, or less if the cycle completes */
+static void gc_step(bvm *vm, size_t budget)
+{
+    size_t work = 0;
+    while (work < budget && vm->gc.state != GC_SPAUSE) {
+        switch (vm->gc.state) {
+        case GC_SPROPAGATE: /* step 2: set unscanned objects to black */
+            if (vm->gc.cursor) {
+                work += premark_fixed(vm, budget - work);
+            } else if (vm->gc.gray) {
+                work += propagate(vm, budget - work);
+            } else {
+                work += atomic(vm);
+            }
+            break;
+        case GC_SDESTRUCT: /* step 3: destruct and delete unreachable objects */
+            if (vm->gc.cursor) {
+                work += destruct_white(vm, budget - work);
+            } else {
+                vm->gc.state = GC_SSWEEP;
+            }
+            break;
+        case GC_SSWEEP:
+            if (*vm->gc.sweep) {
+                work += delete_white(vm, budget - work);
+            } else {
+                vm->gc.sweep = NULL;
+                vm->gc.state = GC_SSWEEPSTR;
+                vm->gc.strpos = 0;
+            }
+            break;
+        case GC_SSWEEPSTR: {
+            size_t count = budget - work < 0x4000 ? budget - work : 0x4000;
+            vm->gc.strpos = be_gcstrtab(vm, vm->gc.strpos, (int)count);
+            work += count;
+            if (vm->gc.strpos == 0) {
+                finish_cycle(vm);
+            }
+            break;
+        }
+        default:
+            be_assert(0);
+            break;
+        }
+    }
+}
+
+/* collect the young objects, which are the head of the object list: the
+ * old objects are kept and only the ones of the remembered set are
+ * scanned, so the work is bounded by the live young objects */
+static void minor_collect(bvm *vm)
+{
+    bgcobject *node, **obj, **end, **keep;
+    size_t usage = vm->gc.usage;
+    vm->gc.state = GC_SMINOR;
+    /* scan the remembered objects, the ones that no longer reference
+     * young objects are forgotten */
+    obj = keep = be_vector_data(&vm->gc.remembered);
+    end = obj + be_vector_count(&vm->gc.remembered);
+    for (; obj < end; ++obj) {
+        be_assert(gc_iswhite(*obj) && gc_istouched(*obj));
+        vm->gc.youngref = bfalse;
+        link_object(vm, *obj);
+        scan_gray(vm);
+        gc_setwhite(*obj);
+        if (vm->gc.youngref || has_upvals(*obj)) {
+            *keep++ = *obj;
+        } else {
+            (*obj)->marked &= ~GC_TOUCHED;
+        }
+    }
+    be_vector_resize(vm, &vm->gc.remembered,
+        (int)(keep - (bgcobject**)be_vector_data(&vm->gc.remembered)));
+    premark_internal(vm);
+    premark_global(vm);
+    premark_stack(vm);
+    premark_tracestack(vm);
+    for (node = vm->gc.list; node && !gc_isold(node); node = node->next) {
+        if (gc_isfixed(node) && gc_iswhite(node)) {
+            mark_gray(vm, node);
+        }
+    }
+    propagate(vm, (size_t)-1);
+    /* the objects created by the destructors are inserted before the
+     * young objects and are kept */
+    vm->gc.sweep = &vm->gc.list;
+    for (node = vm->gc.list; node && !gc_isold(node); node = node->next) {
+        if (gc_iswhite(node)) {
+            destruct_object(vm, node);
+        }
+    }
+    while ((node = *vm->gc.sweep) != NULL && !gc_isold(node)) {
+        if (gc_iswhite(node)) {
+            *vm->gc.sweep = node->next;
+            free_object(vm, node);
+        } else {
+            be_gc_survive(vm, node);
+            vm->gc.sweep = &node->next;
+        }
+    }
+    vm->gc.sweep = NULL;
+    be_gcyoungstr(vm);
+    reset_fixedlist(vm);
+    vm->gc.state = GC_SPAUSE;
+    vm->gc.minorthreshold = next_minor(vm->gc);
+    if (vm->obshook != NULL) (*vm->obshook)(vm, BE_OBS_GC_MINOR, usage, vm->gc.usage);
+}
+
+static void gc_minor(bvm *vm)
+{
+    if (!(vm->gc.status & GC_HALT)) {
+        size_t usage = vm->gc.usage;
+        unsigned long start = gc_clock();
+        vm->gc.status |= GC_HALT;
+        minor_collect(vm);
+        pace_pause(vm, usage, start, 1);
+        vm->gc.status &= ~GC_HALT;
+    }
+}
+
+/* do `budget` work of the current cycle, a cycle is started if none is in
+ * progress, the pause is timed for the pacer if `scale` is not 0 */
+static void gc_pause(bvm *vm, size_t budget, int scale)
+{
+    size_t usage = vm->gc.usage;
+    unsigned long start = scale ? gc_clock() : 0;
+    if (vm->gc.state == GC_SPAUSE) {
+        start_cycle(vm);
+    }
+    gc_step(vm, budget);
+    pace_pause(vm, usage, start, scale);
+    if (vm->gc.state == GC_SPAUSE) {
+        end_cycle(vm);
+    }
+}
+
+/* an allocation scope wraps a call whose temporaries become garbage
+ * when it returns: a minor collection at the end of the scope releases
+ * them at once, the values still reachable, such as the results of the
+ * call, survive and are promoted as by any minor collection */
+size_t be_gc_scope_begin(bvm *vm)
+{
+    return vm->gc.usage;
+}
+
+void be_gc_scope_end(bvm *vm, size_t mark)
+{
+    /* nothing to do when the scope did not allocate memory, a major cycle
+     * in progress will release the temporaries */
+    if (vm->gc.promoteage && vm->gc.state == GC_SPAUSE && vm->gc.usage > mark) {
+        gc_minor(vm);
+    }
+}
+
 void be_gc_auto(bvm *vm)
 {
 #if BE_USE_DEBUG_GC
     if (vm->gc.status & GC_PAUSE) { /* force gc each time it's possible */
+        if (vm->gc.promoteage && vm->gc.state == GC_SPAUSE) {
+            gc_minor(vm);
+        }
         be_gc_collect(vm);
     }
 #else
-    if (vm->gc.status & GC_PAUSE && vm->gc.usage > vm->gc.threshold) {
-        be_gc_collect(vm);
+    if (vm->gc.status & GC_PAUSE) {
+        if (vm->gc.state != GC_SPAUSE || vm->gc.usage > vm->gc.threshold) {
+            be_gc_step(vm);
+        } else if (vm->gc.promoteage && vm->gc.usage > vm->gc.minorthreshold) {
+            gc_minor(vm);
+        }
     }
 #endif
 }
@@ -537,42 +1041,44 @@ size_t be_gc_memcount(bvm *vm)
     return vm->gc.usage;
 }
 
+/* collect all the unreachable objects at once */
 void be_gc_collect(bvm *vm)
 {
     if (vm->gc.status & GC_HALT) {
         return; /* the GC cannot run for some reason */
     }
-#if BE_USE_PERF_COUNTERS
-    size_t slors_used_before_gc, slots_allocated_before_gc;
-    be_gc_memory_pools_info(vm, &slors_used_before_gc, &slots_allocated_before_gc);
-    vm->counter_gc_kept = 0;
-    vm->counter_gc_freed = 0;
-#endif
-    if (vm->obshook != NULL) (*vm->obshook)(vm, BE_OBS_GC_START, vm->gc.usage);
-    /* step 1: set root-set reference objects to unscanned */
-    premark_internal(vm); /* object internal the VM */
-    premark_global(vm); /* global objects */
-    premark_stack(vm); /* stack objects */
-    premark_tracestack(vm); /* trace stack objects */
-    premark_fixed(vm); /* fixed objects */
-    /* step 2: set unscanned objects to black */
-    mark_unscanned(vm);
-    /* step 3: destruct and delete unreachable objects */
-    destruct_white(vm);
-    delete_white(vm);
-    be_gcstrtab(vm);
-    /* step 4: reset the fixed objects */
-    reset_fixedlist(vm);
-    /* step 5: calculate the next GC threshold */
-    vm->gc.threshold = next_threshold(vm->gc);
-    be_gc_memory_pools(vm); /* free unsued memory pools */
-#if BE_USE_PERF_COUNTERS
-    size_t slors_used_after_gc, slots_allocated_after_gc;
-    be_gc_memory_pools_info(vm, &slors_used_after_gc, &slots_allocated_after_gc);
-    if (vm->obshook != NULL) (*vm->obshook)(vm, BE_OBS_GC_END, vm->gc.usage, vm->counter_gc_kept, vm->counter_gc_freed,
-                                            slors_used_before_gc, slots_allocated_before_gc,
-                                            slors_used_after_gc, slots_allocated_after_gc);
-#else
-    if (vm->obshook != NULL) (*vm->obshook)(vm, BE_OBS_GC_END, vm->gc.usage);
-#endif
+    /* the destructors must not start the GC again */
+    vm->gc.status |= GC_HALT;
+    if (vm->gc.state != GC_SPAUSE) { /* complete the cycle in progress */
+        gc_pause(vm, (size_t)-1, 1);
+    }
+    gc_pause(vm, (size_t)-1, 1);
+    /* the empty slabs are released out of the incremental steps, sorting
+     * them takes time */
+    be_gc_memory_pools(vm);
+    vm->gc.status &= ~GC_HALT;
+}
+
+/* do an incremental step, a cycle is started if none is in progress,
+ * returns true when the cycle is completed */
+bbool be_gc_step(bvm *vm)
+{
+    if (vm->gc.status & GC_HALT) {
+        return bfalse;
+    }
+    vm->gc.status |= GC_HALT;
+    if (vm->gc.stepsize && !(vm->gc.pace.limit && vm->gc.usage > vm->gc.pace.limit)) {
+        gc_pause(vm, vm->gc.stepsize,
+            vm->gc.pace.steps++ % GC_PACE_SAMPLE ? 0 : GC_PACE_SAMPLE);
+    } else { /* over the ceiling the cycle is completed at once */
+        gc_pause(vm, (size_t)-1, 1);
+        be_gc_memory_pools(vm);
+    }
+    vm->gc.status &= ~GC_HALT;
+    return vm->gc.state == GC_SPAUSE;
+}
+
+void be_gc_setstepsize(bvm *vm, size_t size)
+{
+    vm->gc.stepsize = size;
 }
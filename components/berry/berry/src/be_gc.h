@@ -26,6 +26,7 @@
 #define gc_iswhite(o)       gc_ismark((o), GC_WHITE)
 #define gc_isgray(o)        gc_ismark((o), GC_GRAY)
 #define gc_isdark(o)        gc_ismark((o), GC_DARK)
+#define gc_isagain(o)       gc_ismark((o), GC_AGAIN)
 
 #define gc_setmark(o, m) \
 if (!gc_isconst(o)) { \
@@ -44,8 +45,12 @@ if (!gc_isconst(o)) { \
 #define gc_setfixed(o)      ((o)->marked |= GC_FIXED)
 #define gc_clearfixed(o)    ((o)->marked &= ~GC_FIXED)
 #define gc_isconst(o)       (((o)->marked & GC_CONST) != 0)
-#define gc_exmark(o)        (((o)->marked >> 4) & 0x0F)
+#define gc_exmark(o)        (((o)->marked >> 4) & 0x01)
 #define gc_setexmark(o, k)  ((o)->marked |= (k) << 4)
+#define gc_age(o)           (((o)->marked >> 5) & 0x03)
+#define gc_setage(o, a)     ((o)->marked = (bbyte)(((o)->marked & ~0x60) | ((a) << 5)))
+#define gc_isold(o)         (((o)->marked & 0x60) == (GC_OLD_AGE << 5))
+#define gc_istouched(o)     (((o)->marked & GC_TOUCHED) != 0)
 
 #define be_isgcobj(o)       (var_primetype(o) >= BE_GCOBJECT && var_primetype(o) < BE_GCOBJECT_MAX)
 #define be_gcnew(v, t, s)   be_newgcobj((v), (t), sizeof(s))
@@ -53,20 +58,62 @@ if (!gc_isconst(o)) { \
 #define set_fixed(s)        bbool _was_fixed = be_gc_fix_set(vm, cast(bgcobject*, (s)), 1)
 #define restore_fixed(s)    be_gc_fix_set(vm, cast(bgcobject*, (s)), _was_fixed);
 
-/* the GC mark uses bit4:0 of the `object->marked` field,
- * so other bits can be used for special flags (ex-mark). */
+/* Write barriers of the incremental GC. While the GC marks, an object that
+ * was already scanned must not get a reference to an unmarked object:
+ * be_gc_barrier() must follow the store of a collectable value in the
+ * object `o` (or precede it with no allocation in between), `o` is then
+ * scanned again by the atomic phase. Out of the marking, an old object
+ * (or one kept by the cycle in progress) that is changed is added to the
+ * remembered set scanned by the minor collections. be_gc_barriervar()
+ * marks the value `v` stored out of any object, e.g. in a closed upvalue. */
+#define be_gc_barrier(vm, o) \
+    if ((vm)->gc.state == GC_SPROPAGATE ? gc_isdark(o) : \
+            (gc_isold(o) || gc_isdark(o)) && !gc_istouched(o)) { \
+        be_gc_barrierback((vm), gc_object(o)); \
+    }
+
+#define be_gc_barriervar(vm, v) \
+    if ((vm)->gc.state == GC_SPROPAGATE && be_isgcobj(v)) { \
+        be_gc_markvar((vm), (v)); \
+    }
+
+/* the GC mark uses bit3:0 of the `object->marked` field, bit4 is used
+ * for special flags (ex-mark), bit6:5 hold the age of the object in the
+ * generational mode and bit7 is set while it is in the remembered set. */
 typedef enum {
     GC_WHITE = 0x00, /* unreachable object */
     GC_GRAY = 0x01,  /* unscanned object */
     GC_DARK = 0x02,  /* scanned object */
+    GC_AGAIN = 0x03, /* changed after its scan, in the `grayagain` list */
     GC_FIXED = 0x04, /* disable collection mark */
-    GC_CONST = 0x08  /* constant object mark */
+    GC_CONST = 0x08, /* constant object mark */
+    GC_TOUCHED = 0x80 /* object in the remembered set */
 } bgcmark;
 
+#define GC_OLD_AGE          3 /* age of the objects left to the major cycles */
+
+/* phases of a GC cycle, all the phases but the atomic one are done by
+ * steps of bounded work interleaved with the program */
+typedef enum {
+    GC_SPAUSE = 0,   /* no cycle in progress */
+    GC_SPROPAGATE,   /* scanning the objects reached from the roots */
+    GC_SATOMIC,      /* scanning the roots again and the changed objects */
+    GC_SDESTRUCT,    /* calling the destructors of the unreachable objects */
+    GC_SSWEEP,       /* freeing the unreachable objects */
+    GC_SSWEEPSTR,    /* freeing the unreachable short strings */
+    GC_SMINOR        /* collecting the young objects only */
+} bgcstate;
+
+/* returns the threshold of the next major cycle, see be_gc_pace() */
+typedef size_t (*bgcpacer)(bvm *vm);
+
 void be_gc_init(bvm *vm);
 void be_gc_deleteall(bvm *vm);
 void be_gc_setsteprate(bvm *vm, int rate);
 void be_gc_setpause(bvm *vm, int pause);
+void be_gc_setpace(bvm *vm, size_t limit, int cpushare);
+void be_gc_setpacer(bvm *vm, bgcpacer pacer);
+size_t be_gc_pace(bvm *vm);
 size_t be_gc_memcount(bvm *vm);
 bgcobject *be_newgcobj(bvm *vm, int type, size_t size);
 bgcobject* be_gc_newstr(bvm *vm, size_t size, int islong);
@@ -74,6 +121,13 @@ void be_gc_fix(bvm *vm, bgcobject *obj);
 void be_gc_unfix(bvm *vm, bgcobject *obj);
 bbool be_gc_fix_set(bvm *vm, bgcobject *obj, bbool fix);
 void be_gc_collect(bvm *vm);
+bbool be_gc_step(bvm *vm);
 void be_gc_auto(bvm *vm);
+void be_gc_setstepsize(bvm *vm, size_t size);
+void be_gc_barrierback(bvm *vm, bgcobject *obj);
+void be_gc_markvar(bvm *vm, bvalue *v);
+void be_gc_survive(bvm *vm, bgcobject *obj);
+size_t be_gc_scope_begin(bvm *vm);
+void be_gc_scope_end(bvm *vm, size_t mark);
 
 #endif
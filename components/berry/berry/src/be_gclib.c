@@ -7,6 +7,9 @@
 ********************************************************************/
 #include "be_object.h"
 #include "be_gc.h"
+#include "be_mem.h"
+#include "be_vm.h"
+#include <time.h>
 
 #if BE_USE_GC_MODULE
 
@@ -27,10 +30,120 @@ static int m_collect(bvm *vm)
     be_return_nil(vm);
 }
 
+/* do an incremental step, returns true when the cycle is completed */
+static int m_step(bvm *vm)
+{
+    be_pushbool(vm, be_gc_step(vm));
+    be_return(vm);
+}
+
+/* call the function of the first argument with the other arguments in an
+ * allocation scope, the temporaries of the call are released on return */
+static int m_scope(bvm *vm)
+{
+    int i, argc = be_top(vm);
+    size_t mark;
+    if (argc < 1 || !be_isfunction(vm, 1)) {
+        be_raise(vm, "type_error", "the first argument must be a function");
+    }
+    mark = be_gc_scope_begin(vm);
+    for (i = 1; i <= argc; ++i) {
+        be_pushvalue(vm, i);
+    }
+    be_call(vm, argc - 1);
+    be_pop(vm, argc - 1); /* the result is at top */
+    be_gc_scope_end(vm, mark);
+    be_return(vm);
+}
+
+static void map_insert(bvm *vm, const char *key, size_t value)
+{
+    be_pushstring(vm, key);
+    be_pushint(vm, (bint)value);
+    be_data_insert(vm, -3);
+    be_pop(vm, 2);
+}
+
+/* returns a list of the statistics of the memory pools, one map per size class */
+static int m_pools(bvm *vm)
+{
+    int i;
+    bmempoolinfo pools[BE_MEM_POOLS];
+    be_gc_memory_pools_info(vm, NULL, NULL, pools);
+    be_newobject(vm, "list");
+    for (i = 0; i < BE_MEM_POOLS; ++i) {
+        be_newobject(vm, "map");
+        map_insert(vm, "size", pools[i].size);
+        map_insert(vm, "used", pools[i].used);
+        map_insert(vm, "allocated", pools[i].allocated);
+        be_pop(vm, 1);
+        be_data_push(vm, -2);
+        be_pop(vm, 1);
+    }
+    be_pop(vm, 1);
+    be_return(vm);
+}
+
+static void map_insert_real(bvm *vm, const char *key, breal value)
+{
+    be_pushstring(vm, key);
+    be_pushreal(vm, value);
+    be_data_insert(vm, -3);
+    be_pop(vm, 2);
+}
+
+/* clock ticks to microseconds */
+static size_t micros(unsigned long ticks)
+{
+    return (size_t)((double)ticks * 1000000 / CLOCKS_PER_SEC);
+}
+
+/* `gc.pacer([limit [, cpushare]])` sets the ceiling of the memory in use
+ * and the maximum share of the time spent by the GC if they are given,
+ * returns a map of the settings and the measures of the last period */
+static int m_pacer(bvm *vm)
+{
+    struct bgcpace *pace = &vm->gc.pace;
+    int argc = be_top(vm);
+    if (argc >= 1) {
+        size_t limit = pace->limit;
+        int cpushare = pace->cpushare;
+        if (!be_isnil(vm, 1)) {
+            if (!be_isint(vm, 1) || be_toint(vm, 1) < 0) {
+                be_raise(vm, "value_error", "the limit must be a positive integer");
+            }
+            limit = (size_t)be_toint(vm, 1);
+        }
+        if (argc >= 2 && !be_isnil(vm, 2)) {
+            if (!be_isint(vm, 2) || be_toint(vm, 2) < 0 || be_toint(vm, 2) > 99) {
+                be_raise(vm, "value_error", "the share must be an integer from 0 to 99");
+            }
+            cpushare = be_toint(vm, 2);
+        }
+        be_gc_setpace(vm, limit, cpushare);
+    }
+    be_newobject(vm, "map");
+    map_insert(vm, "limit", pace->limit);
+    map_insert(vm, "cpushare", pace->cpushare);
+    map_insert(vm, "threshold", vm->gc.threshold);
+    map_insert(vm, "live", pace->live);
+    map_insert(vm, "allocated", pace->allocated);
+    map_insert_real(vm, "survival", (breal)pace->survival / 1000);
+    map_insert(vm, "elapsed", micros(pace->elapsed));
+    map_insert(vm, "gctime", micros(pace->gctime));
+    map_insert(vm, "maxpause", micros(pace->maxpause));
+    be_pop(vm, 1);
+    be_return(vm);
+}
+
 #if !BE_USE_PRECOMPILED_OBJECT
 be_native_module_attr_table(gc){
     be_native_module_function("allocated", m_allocated),
-    be_native_module_function("collect", m_collect)
+    be_native_module_function("collect", m_collect),
+    be_native_module_function("step", m_step),
+    be_native_module_function("scope", m_scope),
+    be_native_module_function("pacer", m_pacer),
+    be_native_module_function("pools", m_pools)
 };
 
 be_define_native_module(gc, NULL);
@@ -39,6 +152,10 @@ be_define_native_module(gc, NULL);
 module gc (scope: global, depend: BE_USE_GC_MODULE) {
     allocated, func(m_allocated)
     collect, func(m_collect)
+    step, func(m_step)
+    scope, func(m_scope)
+    pacer, func(m_pacer)
+    pools, func(m_pools)
 }
 @const_object_info_end */
 #include "../generate/be_fixed_gc.h"
@@ -8,11 +8,11 @@
 #include "be_lexer.h"
 #include "be_string.h"
 #include "be_mem.h"
-#include "be_gc.h"
 #include "be_exec.h"
 #include "be_map.h"
 #include "be_vm.h"
 #include "be_strlib.h"
+#include <string.h>
 
 #define SHORT_STR_LEN       32
 #define EOS                 '\0' /* end of source */
@@ -24,7 +24,8 @@
 #define setstr(lex, v)      ((lex)->token.u.s = (v))
 #define setint(lex, v)      ((lex)->token.u.i = (v))
 #define setreal(lex, v)     ((lex)->token.u.r = (v))
-#define match(lex, pattern) while (pattern(lgetc(lex))) { save(lex); }
+#define match(lex, pattern) match_span(lex, pattern, btrue)
+#define skip(lex, pattern)  match_span(lex, pattern, bfalse)
 
 #if BE_USE_SCRIPT_COMPILER
 
@@ -51,23 +52,32 @@ void be_lexerror(blexer *lexer, const char *msg)
     be_raise(vm, "syntax_error", error);
 }
 
-static void keyword_registe(bvm *vm)
-{
-    int i;
-    for (i = KeyIf; i < type_count(); ++i) {
-        bstring *s = be_newstr(vm, kwords_tab[i]);
-        be_gc_fix(vm, gc_object(s));
-        be_str_setextra(s, i);
-    }
-}
+/* perfect hash of the keywords: each keyword has its own slot, the slot
+ * holds its token type and the other slots are TokenNone */
+#define keyword_hash(s, len) \
+    (((bbyte)(s)[0] + (bbyte)(s)[(len) - 1] + ((len) << 3)) & 63)
+
+static const bbyte kwords_hash[64] = {
+    [0] = KeyVar, [4] = KeyWhile, [5] = KeyTry, [6] = KeyStatic,
+    [8] = KeyContinue, [9] = KeyExcept, [13] = KeyImport, [16] = KeyReturn,
+    [31] = KeyIf, [33] = KeyEnd, [34] = KeyDef, [35] = KeyDo, [36] = KeyAs,
+    [42] = KeyElse, [43] = KeyElif, [48] = KeyFor, [50] = KeyNil,
+    [51] = KeyFalse, [53] = KeyBreak, [57] = KeyTrue, [62] = KeyClass,
+    [63] = KeyRaise
+};
 
-static void keyword_unregiste(bvm *vm)
+/* return the keyword token of the word `s` or TokenNone, the identifiers
+ * are only turned into strings when they are not keywords */
+static btokentype keyword_type(const char *s, size_t len)
 {
-    int i;
-    for (i = KeyIf; i < type_count(); ++i) {
-        bstring *s = be_newstr(vm, kwords_tab[i]);
-        be_gc_unfix(vm, gc_object(s));
+    if (len >= 2 && len <= 8) { /* length of the keywords */
+        btokentype type = (btokentype)kwords_hash[keyword_hash(s, len)];
+        const char *kw = kwords_tab[type];
+        if (type != TokenNone && !strncmp(kw, s, len) && kw[len] == '\0') {
+            return type;
+        }
     }
+    return TokenNone;
 }
 
 static bstring* cache_string(blexer *lexer, bstring *s)
@@ -97,6 +107,36 @@ bstring* be_lexer_newstr(blexer *lexer, const char *str)
     return cache_string(lexer, be_newstr(lexer->vm, str));
 }
 
+/* keep a string created during the compilation alive until its end */
+bstring* be_lexer_cachestr(blexer *lexer, bstring *s)
+{
+    return cache_string(lexer, s);
+}
+
+static void buf_push(blexer *lexer, struct blexerbuf *buf, int ch)
+{
+    if (buf->len >= buf->size) {
+        size_t size = buf->size << 1;
+        buf->s = be_realloc(lexer->vm, buf->s, buf->size, size);
+        buf->size = size;
+    }
+    buf->s[buf->len++] = (char)ch;
+}
+
+static void buf_append(blexer *lexer, struct blexerbuf *buf, const char *s, size_t len)
+{
+    if (buf->len + len > buf->size) {
+        size_t size = buf->size << 1;
+        while (size < buf->len + len) {
+            size <<= 1;
+        }
+        buf->s = be_realloc(lexer->vm, buf->s, buf->size, size);
+        buf->size = size;
+    }
+    memcpy(buf->s + buf->len, s, len);
+    buf->len += len;
+}
+
 static int next(blexer *lexer)
 {
     struct blexerreader *lr = &lexer->reader;
@@ -107,6 +147,9 @@ static int next(blexer *lexer)
         --lr->len;
     }
     lexer->cursor = *lr->s++;
+    if (lexer->capture.s) {
+        buf_push(lexer, &lexer->capture, lexer->cursor);
+    }
     return lexer->cursor;
 }
 
@@ -118,17 +161,58 @@ static void clear_buf(blexer *lexer)
 /* save and next */
 static int save(blexer *lexer)
 {
-    int ch = lgetc(lexer);
-    struct blexerbuf *buf = &lexer->buf;
-    if (buf->len >= buf->size) {
-        size_t size = buf->size << 1;
-        buf->s = be_realloc(lexer->vm, buf->s, buf->size, size);
-        buf->size = size;
-    }
-    buf->s[buf->len++] = (char)ch;
+    buf_push(lexer, &lexer->buf, lgetc(lexer));
     return next(lexer);
 }
 
+/* Skip the current character and the following ones while they match
+ * `pattern`, they are saved to the token buffer if `keep` is set. The
+ * characters of the block returned by the reader are scanned in place
+ * and copied at once, next() is only called at the end of a run. */
+static void match_span(blexer *lexer, int (*pattern)(int), bbool keep)
+{
+    struct blexerreader *lr = &lexer->reader;
+    while (pattern(lgetc(lexer))) {
+        const char *s = lr->s, *p = s, *end = s + lr->len;
+        while (p < end && pattern(*p)) {
+            ++p;
+        }
+        if (keep) {
+            buf_push(lexer, &lexer->buf, lgetc(lexer));
+            buf_append(lexer, &lexer->buf, s, p - s);
+        }
+        if (lexer->capture.s) {
+            buf_append(lexer, &lexer->capture, s, p - s);
+        }
+        lr->len -= p - s;
+        lr->s = p;
+        next(lexer);
+    }
+}
+
+/* Start recording the source text, from the character following the
+ * current token */
+void be_lexer_capture(blexer *lexer)
+{
+    struct blexerbuf *buf = &lexer->capture;
+    be_assert(buf->s == NULL);
+    buf->size = SHORT_STR_LEN;
+    buf->s = be_malloc(lexer->vm, buf->size);
+    buf->len = 0;
+    buf_push(lexer, buf, lgetc(lexer));
+}
+
+/* Stop recording and return the source text up to the end of the current
+ * token, the character read ahead is not part of it */
+bstring* be_lexer_captured(blexer *lexer)
+{
+    struct blexerbuf *buf = &lexer->capture;
+    bstring *s = lexer_newstrn(lexer, buf->s, buf->len - 1);
+    be_free(lexer->vm, buf->s, buf->size);
+    buf->s = NULL;
+    return s;
+}
+
 static bstring* buf_tostr(blexer *lexer)
 {
     struct blexerbuf *buf = &lexer->buf;
@@ -160,6 +244,28 @@ static int is_word(int c)
     return is_letter(c) || is_digit(c);
 }
 
+static int is_space(int c)
+{
+    return c == ' ' || c == '\t' || c == '\f' || c == '\v';
+}
+
+/* characters of a line comment */
+static int is_comment(int c)
+{
+    return !is_newline(c) && c != EOS;
+}
+
+/* characters of a string that need no special handling */
+static int is_dqstr(int c)
+{
+    return c != '"' && c != '\\' && c != EOS;
+}
+
+static int is_sqstr(int c)
+{
+    return c != '\'' && c != '\\' && c != EOS;
+}
+
 static int check_next(blexer *lexer, int c)
 {
     if (lgetc(lexer) == c) {
@@ -265,9 +371,7 @@ static void skip_comment(blexer *lexer)
         } while (!(mark && c == '#') && c != EOS);
         next(lexer); /* skip '#' */
     } else { /* line comment */
-        while (!is_newline(lgetc(lexer)) && lgetc(lexer)) {
-            next(lexer);
-        }
+        skip(lexer, is_comment);
     }
 }
 
@@ -375,17 +479,13 @@ static btokentype scan_numeral(blexer *lexer)
 
 static btokentype scan_identifier(blexer *lexer)
 {
-    int type;
-    bstring *s;
-    save(lexer);
+    btokentype type;
     match(lexer, is_word);
-    s = buf_tostr(lexer);
-    type = str_extra(s);
-    if (type >= KeyIf && type < type_count()) {
-        lexer->token.type = (btokentype)type;
-        return lexer->token.type;
+    type = keyword_type(lexbuf(lexer), lexer->buf.len);
+    if (type != TokenNone) {
+        return type;
     }
-    setstr(lexer, s); /* set identifier name */
+    setstr(lexer, buf_tostr(lexer)); /* set identifier name */
     return TokenId;
 }
 
@@ -396,8 +496,8 @@ static int skip_delimiter(blexer *lexer) {
     while (1) {
         if (c == '\r' || c == '\n') {
             skip_newline(lexer);
-        } else if (c == ' ' || c == '\t' || c == '\f' || c ==  '\v') {
-            next(lexer);
+        } else if (is_space(c)) {
+            skip(lexer, is_space);
         } else {
             break;
         }
@@ -413,11 +513,13 @@ static btokentype scan_string(blexer *lexer)
         int c;
         int end = lgetc(lexer);     /* string delimiter, either '"' or '\'' */
         next(lexer); /* skip '"' or '\'' */
-        while ((c = lgetc(lexer)) != EOS && (c != end)) {
-            save(lexer);
-            if (c == '\\') {
-                save(lexer); /* skip '\\.' */
+        for (;;) {
+            match(lexer, end == '"' ? is_dqstr : is_sqstr);
+            if ((c = lgetc(lexer)) != '\\') {
+                break;
             }
+            save(lexer);
+            save(lexer); /* skip '\\.' */
         }
         if (c == EOS) {
             be_lexerror(lexer, "unfinished string");
@@ -511,7 +613,7 @@ static btokentype lexer_next(blexer *lexer)
             skip_newline(lexer);
             break;
         case ' ': case '\t': case '\f': case '\v': /* spaces */
-            next(lexer);
+            skip(lexer, is_space);
             break;
         case '#': /* comment */
             skip_comment(lexer);
@@ -581,8 +683,8 @@ void be_lexer_init(blexer *lexer, bvm *vm,
     lexer->reader.readf = reader;
     lexer->reader.data = data;
     lexer->reader.len = 0;
+    lexer->capture.s = NULL;
     lexerbuf_init(lexer);
-    keyword_registe(vm);
     lexer->strtab = be_map_new(vm);
     var_setmap(vm->top, lexer->strtab);
     be_stackpush(vm); /* save string to cache */
@@ -592,7 +694,10 @@ void be_lexer_init(blexer *lexer, bvm *vm,
 void be_lexer_deinit(blexer *lexer)
 {
     be_free(lexer->vm, lexer->buf.s, lexer->buf.size);
-    keyword_unregiste(lexer->vm);
+    if (lexer->capture.s) { /* error while recording */
+        be_free(lexer->vm, lexer->capture.s, lexer->capture.size);
+        lexer->capture.s = NULL;
+    }
 }
 
 int be_lexer_scan_next(blexer *lexer)
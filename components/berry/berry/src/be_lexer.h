@@ -120,6 +120,7 @@ typedef struct blexer {
     int lastline;
     btokentype cacheType;
     struct blexerbuf buf;
+    struct blexerbuf capture; /* source text being recorded, see be_lexer_capture() */
     struct blexerreader reader;
     bmap *strtab;
     bvm *vm;
@@ -132,6 +133,9 @@ void be_lexer_deinit(blexer *lexer);
 void be_lexerror(blexer *lexer, const char *msg);
 int be_lexer_scan_next(blexer *lexer);
 bstring* be_lexer_newstr(blexer *lexer, const char *str);
+bstring* be_lexer_cachestr(blexer *lexer, bstring *s);
+void be_lexer_capture(blexer *lexer);
+bstring* be_lexer_captured(blexer *lexer);
 const char *be_token2str(bvm *vm, btoken *token);
 const char* be_tokentype2str(btokentype type);
 
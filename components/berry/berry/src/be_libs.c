@@ -14,6 +14,7 @@ extern void be_load_maplib(bvm *vm);
 extern void be_load_rangelib(bvm *vm);
 extern void be_load_filelib(bvm *vm);
 extern void be_load_byteslib(bvm *vm);
+extern void be_load_strbuilderlib(bvm *vm);
 
 void be_loadlibs(bvm *vm)
 {
@@ -25,5 +26,6 @@ void be_loadlibs(bvm *vm)
     be_load_filelib(vm);
     be_load_byteslib(vm);
     be_load_baselib_next(vm);
+    be_load_strbuilderlib(vm);
 #endif
 }
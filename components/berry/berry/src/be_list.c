@@ -74,6 +74,7 @@ bvalue* be_list_push(bvm *vm, blist *list, bvalue *value)
         list->capacity = newcap;
     }
     slot = list->data + list->count++;
+    be_gc_barrier(vm, list); /* the slot is written by the caller otherwise */
     if (value != NULL) {
         *slot = *value;
     }
@@ -101,6 +102,7 @@ bvalue* be_list_insert(bvm *vm, blist *list, int index, bvalue *value)
         data[i] = data[i - 1];
     }
     data = list->data + index;
+    be_gc_barrier(vm, list);
     if (value != NULL) {
         *data = *value;
     }
@@ -159,6 +161,7 @@ void be_list_merge(bvm *vm, blist *list, const blist *other)
         }
         memcpy(list->data + dst_len, other->data, src_len * sizeof(bvalue));
         list->count = length;
+        be_gc_barrier(vm, list);
     }
 }
 
@@ -187,12 +190,13 @@ int be_list_pool_alloc(bvm *vm, blist *list, bvalue *src)
     int id = var_toidx(head); /* get the first free node */
     if (id) {
         node = head + id;
-        head->v.i = var_toint(node); /* link the next free node to head */
+        var_setint(head, var_toint(node)); /* link the next free node to head */
     } else {
         id = be_list_count(list);
         node = be_list_push(vm, list, NULL);
     }
     *node = *src;
+    be_gc_barrier(vm, list);
     return id;
 }
 
@@ -203,5 +207,5 @@ void be_list_pool_free(blist *list, int id)
     be_assert(id > 0 && id < list->count);
     /* insert a new free node to head */
     *node = *head;
-    head->v.i = id;
+    var_setint(head, id);
 }
@@ -292,7 +292,7 @@ static int iter_closure(bvm *vm)
     if (next >= be_list_end(list)) {
         be_stop_iteration(vm);
     }
-    var_toobj(uv1) = next; /* set upvale[1] (iter value) */
+    var_setobj(uv1, BE_COMPTR, next); /* set upvale[1] (iter value) */
     /* push next value to top */
     var_setval(vm->top, next);
     be_incrtop(vm);
@@ -528,7 +528,7 @@ class be_class_list (scope: global, name: list) {
     item, func(m_item)
     find, func(m_find)
     setitem, func(m_setitem)
-    size, func(m_size)
+    size, leaf_func(m_size)
     resize, func(m_resize)
     clear, func(m_clear)
     iter, func(m_iter)
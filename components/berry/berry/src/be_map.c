@@ -20,14 +20,17 @@
 #define isnil(node)         var_isnil(key(node))
 #define setnil(node)        var_setnil(key(node))
 #define hash2slot(m, h)     ((m)->slots + (h) % (m)->size)
-#define hashcode(_v)        _hashcode(vm, (_v)->type, (_v)->v)
-#define keytype(key)        ((signed char)(key)->type)
+#define hashcode(_v)        _hashcode(vm, _v)
 
 #define next(node)          ((node)->key.next)
 #define pos2slot(map, n)    ((n) != LASTNODE ? ((map)->slots + (n)) : NULL)
 #define pos(map, node)      ((int)((node) - (map)->slots))
+#if BE_USE_NAN_BOXING
+#define setkey(node, _v)    { (node)->key.u = (_v)->u; }
+#else
 #define setkey(node, _v)    { (node)->key.type = (bbyte)(_v)->type; \
                               (node)->key.v = (_v)->v; }
+#endif
 
 #define datasize(size)      ((size) * sizeof(bmapnode))
 
@@ -48,14 +51,28 @@ static uint32_t hashptr(void *p)
     return (uint32_t)((i ^ (i >> 16)) & 0xFFFFFFFF);
 }
 
+/* the low bits of short reals are all zero, mix the high bits into them
+ * since large maps have power of two sizes */
+static uint32_t hashmix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    return h ^ (h >> 16);
+}
+
 #if BE_USE_SINGLE_FLOAT
-#define hashreal(v)     ((uint32_t)((v).i))
+static uint32_t hashreal(breal r)
+{
+    union { breal r; uint32_t i; } u;
+    u.r = r;
+    return hashmix(u.i);
+}
 #else
-static uint32_t hashreal(union bvaldata v)
+static uint32_t hashreal(breal r)
 {
     union { breal r; uint32_t i[2]; } u;
-    u.r = v.r;
-    return u.i[0] ^ u.i[1];
+    u.r = r;
+    return hashmix(u.i[0] ^ u.i[1]);
 }
 #endif
 
@@ -81,19 +98,19 @@ static uint32_t hashins(bvm *vm, binstance *obj)
 }
 #endif
 
-static uint32_t _hashcode(bvm *vm, int type, union bvaldata v)
+static uint32_t _hashcode(bvm *vm, bvalue *v)
 {
     (void)vm;
-    switch (type) {
+    switch (var_type(v)) {
     case BE_NIL: return 0;
-    case BE_BOOL: return (uint32_t)v.b;
-    case BE_INT: return (uint32_t)v.i;
-    case BE_REAL: return hashreal(v);
-    case BE_STRING: return be_strhash(v.s);
+    case BE_BOOL: return (uint32_t)var_tobool(v);
+    case BE_INT: return (uint32_t)var_toint(v);
+    case BE_REAL: return hashreal(var_toreal(v));
+    case BE_STRING: return be_strhash(var_tostr(v));
 #if BE_USE_OVERLOAD_HASH
-    case BE_INSTANCE: return hashins(vm, v.p);
+    case BE_INSTANCE: return hashins(vm, var_toobj(v));
 #endif
-    default: return hashptr(v.p);
+    default: return hashptr(var_toobj(v));
     }
 }
 
@@ -101,21 +118,19 @@ static int eqnode(bvm *vm, bmapnode *node, bvalue *key, uint32_t hash)
 {
     (void)vm;
     if (!var_isnil(key)) {
-        bmapkey *k = key(node);
+        bvalue kv;
+        be_map_key2value(&kv, node);
 #if BE_USE_OVERLOAD_HASH
         if (var_isinstance(key)) {
-            bvalue kv;
-            kv.type = k->type;
-            kv.v = k->v;
             return be_vm_iseq(vm, key, &kv);
         }
 #endif
-        if(keytype(k) == key->type && hashcode(k) == hash) {
-            switch (key->type) {
-            case BE_INT: return var_toint(key) == var_toint(k);
-            case BE_REAL: return var_toreal(key) == var_toreal(k);
-            case BE_STRING: return be_eqstr(var_tostr(key), var_tostr(k));
-            default: return var_toobj(key) == var_toobj(k);
+        if(var_type(&kv) == var_type(key) && hashcode(&kv) == hash) {
+            switch (var_type(key)) {
+            case BE_INT: return var_toint(key) == var_toint(&kv);
+            case BE_REAL: return var_toreal(key) == var_toreal(&kv);
+            case BE_STRING: return be_eqstr(var_tostr(key), var_tostr(&kv));
+            default: return var_toobj(key) == var_toobj(&kv);
             }
         }
     }
@@ -155,7 +170,10 @@ static bmapnode* insert(bvm *vm, bmap *map, bvalue *key, uint32_t hash)
         setkey(slot, key);
         next(slot) = LASTNODE;
     } else {
-        uint32_t h = hashcode(key(slot)); /* get the hashcode of the exist node */
+        bvalue kv;
+        uint32_t h;
+        be_map_key2value(&kv, slot);
+        h = hashcode(&kv); /* get the hashcode of the exist node */
         bmapnode *mainslot = hash2slot(map, h); /* get the main-slot */
         bmapnode *new = nextfree(map); /* get a free slot */
         if (mainslot == slot) { /* old is main slot */
@@ -214,8 +232,7 @@ static void resize(bvm *vm, bmap *map, int size)
         if (!isnil(node)) {
             bvalue v;
             bmapnode *newslot;
-            v.type = node->key.type;
-            v.v = node->key.v;
+            be_map_key2value(&v, node);
             newslot = insert(vm, map, &v, hashcode(&v));
             newslot->value = node->value;
         }
@@ -265,6 +282,7 @@ bvalue* be_map_insert(bvm *vm, bmap *map, bvalue *key, bvalue *value)
     if (value) {
         entry->value = *value;
     }
+    be_gc_barrier(vm, map); /* the value is written by the caller otherwise */
     return value(entry);
 }
 
@@ -10,11 +10,18 @@
 
 #include "be_object.h"
 
+#if BE_USE_NAN_BOXING
+typedef struct bmapkey {
+    uint64_t u; /* boxed key, see bvalue */
+    uint32_t next:24;
+} bmapkey;
+#else
 typedef struct bmapkey {
     union bvaldata v;
     uint32_t type:8;
     uint32_t next:24;
 } bmapkey;
+#endif
 
 typedef struct bmapnode {
     bmapkey key;
@@ -41,10 +48,16 @@ typedef bmapnode *bmapiter;
 #define be_map_count(map)   ((map)->count)
 #define be_map_size(map)    (map->size)
 
+#if BE_USE_NAN_BOXING
+#define be_map_key2value(dst, node) do { \
+    (dst)->u = (node)->key.u;            \
+} while (0);
+#else
 #define be_map_key2value(dst, node) do { \
     (dst)->type = (node)->key.type;      \
     (dst)->v = (node)->key.v;            \
 } while (0);
+#endif
 
 bmap* be_map_new(bvm *vm);
 void be_map_delete(bvm *vm, bmap *map);
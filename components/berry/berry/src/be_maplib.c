@@ -196,7 +196,7 @@ static int keys_iter_closure(bvm *vm)
     }
     var_setobj(uv1, BE_COMPTR, iter); /* set upvale[1] (iter value) */
     /* push next value to top */
-    var_setobj(vm->top, next->key.type, next->key.v.p);
+    be_map_key2value(vm->top, next);
     be_incrtop(vm);
     be_return(vm);
 }
@@ -316,27 +316,27 @@ be_define_native_module(math, NULL);
 #else
 /* @const_object_info_begin
 module math (scope: global, depend: BE_USE_MATH_MODULE) {
-    isnan, func(m_isnan)
-    abs, func(m_abs)
-    ceil, func(m_ceil)
-    floor, func(m_floor)
-    sin, func(m_sin)
-    cos, func(m_cos)
-    tan, func(m_tan)
-    asin, func(m_asin)
-    acos, func(m_acos)
-    atan, func(m_atan)
-    atan2, func(m_atan2)
-    sinh, func(m_sinh)
-    cosh, func(m_cosh)
-    tanh, func(m_tanh)
-    sqrt, func(m_sqrt)
-    exp, func(m_exp)
-    log, func(m_log)
-    log10, func(m_log10)
-    deg, func(m_deg)
-    rad, func(m_rad)
-    pow, func(m_pow)
+    isnan, leaf_func(m_isnan)
+    abs, leaf_func(m_abs)
+    ceil, leaf_func(m_ceil)
+    floor, leaf_func(m_floor)
+    sin, leaf_func(m_sin)
+    cos, leaf_func(m_cos)
+    tan, leaf_func(m_tan)
+    asin, leaf_func(m_asin)
+    acos, leaf_func(m_acos)
+    atan, leaf_func(m_atan)
+    atan2, leaf_func(m_atan2)
+    sinh, leaf_func(m_sinh)
+    cosh, leaf_func(m_cosh)
+    tanh, leaf_func(m_tanh)
+    sqrt, leaf_func(m_sqrt)
+    exp, leaf_func(m_exp)
+    log, leaf_func(m_log)
+    log10, leaf_func(m_log10)
+    deg, leaf_func(m_deg)
+    rad, leaf_func(m_rad)
+    pow, leaf_func(m_pow)
     srand, func(m_srand)
     rand, func(m_rand)
     pi, real(M_PI)
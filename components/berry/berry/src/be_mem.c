@@ -29,8 +29,14 @@
 static void* malloc_from_pool(bvm *vm, size_t size);
 static void free_from_pool(bvm *vm, void* ptr, size_t old_size);
 
-#define POOL16_SIZE     16
-#define POOL32_SIZE     32
+#define POOL_MAX_SIZE   128     /* larger blocks are allocated by the system */
+
+/* size class of the blocks of (size + 7) / 8 words of 8 bytes */
+static const uint8_t pool_class[POOL_MAX_SIZE / 8 + 1] = {
+    0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7
+};
+
+#define pool_index(size)    pool_class[((size) + 7) >> 3]
 
 BERRY_API void* be_os_malloc(size_t size)
 {
@@ -75,13 +81,10 @@ BERRY_API void* be_realloc(bvm *vm, void *ptr, size_t old_size, size_t new_size)
 
         /* Case 3: reallocate with a different size */
         else if (new_size && old_size) {        // TODO we already know they are not null TODO
-            if (new_size <= POOL32_SIZE || old_size <=POOL32_SIZE) {
+            if (BE_USE_MEM_POOLS && (new_size <= POOL_MAX_SIZE || old_size <= POOL_MAX_SIZE)) {
                 /* complex case with different pools */
-                if (new_size <= POOL16_SIZE && old_size <= POOL16_SIZE) {
-                    // no change of slot
-                    block = ptr;
-                    break;
-                } else if (new_size > POOL16_SIZE && old_size > POOL16_SIZE && new_size <= POOL32_SIZE && old_size <= POOL32_SIZE) {
+                if (new_size <= POOL_MAX_SIZE && old_size <= POOL_MAX_SIZE
+                        && pool_index(new_size) == pool_index(old_size)) {
                     // no change of slot
                     block = ptr;
                     break;
@@ -124,7 +127,7 @@ BERRY_API void* be_move_to_aligned(bvm *vm, void *ptr, size_t size) {
     (void)vm;
     (void)size;
 #if BE_USE_MEM_ALIGNED
-    if (size <= POOL32_SIZE) {
+    if (BE_USE_MEM_POOLS && size <= POOL_MAX_SIZE) {
         return ptr;     /* if in memory pool, don't move it so be_free() will continue to work */
     }
     void* iram = berry_malloc32(size);
@@ -137,220 +140,197 @@ BERRY_API void* be_move_to_aligned(bvm *vm, void *ptr, size_t size) {
     return ptr;
 }
 
-/* Special allocator for structures under 32 bytes */
-typedef uint8_t mem16[16];      /* memory line of 16 bytes */
-typedef uint8_t mem32[32];      /* memory line of 32 bytes */
-#define POOL16_SLOTS   31
-#define POOL16_BITMAP_FULL  ((1UL<<POOL16_SLOTS)-1)      /* 31 bits set to 1 - 0x7FFFFFFF */
-#define POOL32_SLOTS   15
-#define POOL32_BITMAP_FULL  ((1UL<<POOL32_SLOTS)-1)      /* 15 bits set to 1 - 0x7FFF*/
+/* Slab allocator for the blocks of 128 bytes or less. Each size class
+ * has its own pool of slabs of SLAB_SIZE bytes, the free slots of all
+ * the slabs of a class are linked in a single list, so allocating and
+ * freeing a slot only take the head of this list. The slabs left empty
+ * are released by be_gc_memory_pools() after the full collections, not
+ * by the incremental steps. */
+#define SLAB_SIZE       1024
+#define SLAB_HEADER     ((sizeof(bslab) + 7) & ~(size_t)7)
+
+typedef struct bslab {
+    struct bslab *next;     /* next slab of the same size class */
+    size_t nfree;           /* free slots, only counted by be_gc_memory_pools() */
+} bslab;
 
-typedef struct gc16_t {
-    uint32_t bitmap;            /* bitmap or allocated lines, 0 is free */
-    struct gc16_t*  next;
-    mem16    lines[POOL16_SLOTS];
-} gc16_t;
+static const uint8_t pool_size[BE_MEM_POOLS] = { 8, 16, 24, 32, 48, 64, 96, 128 };
 
-typedef struct gc32_t {
-    uint32_t bitmap;            /* bitmap or allocated lines, 0 is free */
-    struct gc32_t*  next;
-    mem32    lines[POOL32_SLOTS];
-} gc32_t;
+#define pool_slots(i)       ((SLAB_SIZE - SLAB_HEADER) / pool_size[i])
+#define slab_slot(s, i, n)  ((uint8_t*)(s) + SLAB_HEADER + (size_t)(n) * pool_size[i])
 
-static void* malloc_from_pool(bvm *vm, size_t size) {
+static void* malloc_from_pool(bvm *vm, size_t size)
+{
     if (size == 0) return NULL;
-    if (size <= POOL16_SIZE) {
-        /* allocate in pool 16 */
-        gc16_t* pool16 = vm->gc.pool16;
-        while (pool16)  {
-            /* look for an empty slot */
-            if (pool16->bitmap != 0x0000) {
-                /* there is a free slot */
-#ifdef __GNUC__
-                int bit = __builtin_ffs(pool16->bitmap) - 1;
-#else
-                int bit = ffs(pool16->bitmap) - 1;
-#endif
-                if (bit >= 0) {
-                    /* we found a free slot */
-                    // bitClear(pool16->bitmap, bit);
-                    pool16->bitmap &= ~(1UL << bit);
-                    // serial_debug("malloc_from_pool found slot in pool %p, bit %i, ptr=%p\n", pool16, bit, &pool16->lines[bit]);
-                    return &pool16->lines[bit];
-                }
+#if BE_USE_MEM_POOLS
+    if (size <= POOL_MAX_SIZE) {
+        int index = pool_index(size);
+        struct bmempool *pool = &vm->gc.pools[index];
+        void *slot = pool->free;
+        if (slot == NULL) { /* no free slot, a new slab is allocated */
+            size_t n = pool_slots(index);
+            bslab *slab = (bslab*)malloc(SLAB_SIZE);
+            if (!slab) { return NULL; } /* out of memory */
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->nslabs++;
+            while (n--) { /* link the slots to allocate them in order */
+                void **p = (void**)slab_slot(slab, index, n);
+                *p = slot;
+                slot = p;
             }
-            pool16 = pool16->next;
         }
-        /* no slot available, we allocate a new pool */
-        pool16 = (gc16_t*) malloc(sizeof(gc16_t));
-        if (!pool16) { return NULL; } /* out of memory */
-        pool16->next = vm->gc.pool16;
-        pool16->bitmap = POOL16_BITMAP_FULL - 1;      /* allocate first line */
-        vm->gc.pool16 = pool16;          /* insert at head of linked list */
-        // serial_debug("malloc_from_pool allocated new pool %p, size=%i p=%p\n", pool16, sizeof(gc16_t), &pool16->lines[0]);
-        return &pool16->lines[0];
+        pool->free = *(void**)slot;
+        pool->used++;
+        return slot;
     }
+#else
+    (void)vm;
+#endif
+    return malloc(size);    /* default to system malloc */
+}
 
-    if (size <= POOL32_SIZE) {
-        /* allocate in pool 32 */
-        gc32_t* pool32 = vm->gc.pool32;
-        while (pool32)  {
-            /* look for an empty slot */
-            if (pool32->bitmap != 0x0000) {
-                /* there is a free slot */
-#ifdef __GNUC__
-                int bit = __builtin_ffs(pool32->bitmap) - 1;
+static void free_from_pool(bvm *vm, void* ptr, size_t old_size)
+{
+#if BE_USE_MEM_POOLS
+    if (old_size <= POOL_MAX_SIZE) {
+        struct bmempool *pool = &vm->gc.pools[pool_index(old_size)];
+        *(void**)ptr = pool->free;
+        pool->free = ptr;
+        pool->used--;
+        return;
+    }
 #else
-                int bit = ffs(pool32->bitmap) - 1;
+    (void)vm;
+    (void)old_size;
 #endif
-                if (bit >= 0) {
-                    /* we found a free slot */
-                    // bitClear(pool32->bitmap, bit);
-                    pool32->bitmap &= ~(1UL << bit);
-                    // serial_debug("malloc_from_pool found slot in pool %p, bit %i, ptr=%p\n", pool32, bit, &pool32->lines[bit]);
-                    return &pool32->lines[bit];
-                }
-            }
-            pool32 = pool32->next;
+    free(ptr);
+}
+
+#if BE_USE_MEM_POOLS
+static int slab_compare(const void *a, const void *b)
+{
+    const uint8_t *sa = *(const uint8_t* const*)a, *sb = *(const uint8_t* const*)b;
+    return sa < sb ? -1 : sa > sb;
+}
+
+/* find the slab of a slot in the slabs sorted by address */
+static bslab* slab_find(bslab **slabs, size_t count, void *slot)
+{
+    size_t lo = 0, hi = count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) >> 1;
+        if ((uint8_t*)slabs[mid] <= (uint8_t*)slot) {
+            lo = mid;
+        } else {
+            hi = mid;
         }
-        /* no slot available, we allocate a new pool */
-        pool32 = (gc32_t*) malloc(sizeof(gc32_t));
-        if (!pool32) { return NULL; } /* out of memory */
-        pool32->next = vm->gc.pool32;
-        pool32->bitmap = POOL32_BITMAP_FULL - 1;      /* allocate first line */
-        vm->gc.pool32 = pool32;          /* insert at head of linked list */
-        // serial_debug("malloc_from_pool allocated new pool %p, size=%i p=%p\n", pool32, sizeof(gc32_t), &pool32->lines[0]);
-        return &pool32->lines[0];
     }
-
-    return malloc(size);    /* default to system malloc */
+    return slabs[lo];
 }
 
-static void free_from_pool(bvm *vm, void* ptr, size_t old_size) {
-    if (old_size <= POOL16_SIZE) {
-        gc16_t* pool16 = vm->gc.pool16;
-        while (pool16) {
-            int32_t offset = (uint8_t*)ptr - (uint8_t*) &pool16->lines[0];
-            // serial_debug("free_from_pool ptr=%p pool=%p offset=%i\n", ptr,pool16, offset);
-            if ((offset >= 0) && (offset < POOL16_SLOTS*16) && ((offset & 0x0F) == 0)) {
-                int bit = offset >> 4;
-                // serial_debug("free_from_pool ptr=%p fond pool=%p bit=%i\n", ptr, pool16, bit);
-                // bitSet(pool16->bitmap, bit);
-                pool16->bitmap |= 1UL << bit;
-                return;
-            }
-            pool16 = pool16->next;
+/* release the empty slabs of a pool, returns false if the slabs could
+ * not be sorted */
+static bbool release_slabs(struct bmempool *pool, size_t nslots)
+{
+    bslab *slab, **slabs, **prev;
+    void **slot, **link;
+    size_t i = 0, empty = 0;
+    slabs = (bslab**)malloc(pool->nslabs * sizeof(bslab*));
+    if (slabs == NULL) {
+        return bfalse;
+    }
+    for (slab = pool->slabs; slab; slab = slab->next) {
+        slab->nfree = 0;
+        slabs[i++] = slab;
+    }
+    qsort(slabs, pool->nslabs, sizeof(bslab*), slab_compare);
+    for (slot = (void**)pool->free; slot; slot = (void**)*slot) {
+        slab = slab_find(slabs, pool->nslabs, slot);
+        if (++slab->nfree == nslots) {
+            ++empty;
         }
     }
-    else if (old_size <= POOL32_SIZE) {
-        gc32_t* pool32 = vm->gc.pool32;
-        while (pool32) {
-            int32_t offset = (uint8_t*)ptr - (uint8_t*) &pool32->lines[0];
-            // serial_debug("free_from_pool pool=%p offset=%i\n", pool32, offset);
-            if ((offset >= 0) && (offset < POOL16_SLOTS*16) && ((offset & 0x1F) == 0)) {
-                int bit = offset >> 5;
-                // serial_debug("free_from_pool ptr=%p fond pool=%p bit=%i\n", ptr, pool32, bit);
-                // bitSet(pool32->bitmap, bit);
-                pool32->bitmap |= 1UL << bit;
-                return;
+    if (empty) {
+        /* unlink the free slots of the empty slabs */
+        for (link = &pool->free; *link; ) {
+            slot = (void**)*link;
+            if (slab_find(slabs, pool->nslabs, slot)->nfree == nslots) {
+                *link = *slot;
+            } else {
+                link = slot;
+            }
+        }
+        for (prev = &pool->slabs; (slab = *prev) != NULL; ) {
+            if (slab->nfree == nslots) {
+                *prev = slab->next;
+                free(slab);
+                pool->nslabs--;
+            } else {
+                prev = &slab->next;
             }
-            pool32 = pool32->next;
         }
     }
-    else {
-        // serial_debug("free_from_pool free=%p\n", ptr);
-        free(ptr);
-    }
+    free(slabs);
+    return btrue;
 }
+#endif
 
-BERRY_API void be_gc_memory_pools(bvm *vm) {
-    gc16_t** prev16 = &vm->gc.pool16;
-    gc16_t* pool16 = vm->gc.pool16;
-    while (pool16) {
-        if (pool16->bitmap == POOL16_BITMAP_FULL) {
-            /* pool is empty, we can free it */
-            *prev16 = pool16->next;
-            gc16_t* pool_to_freed = pool16;
-            pool16 = pool16->next;  /* move to next */
-            free(pool_to_freed);
-        } else {
-            prev16 = &pool16->next;
-            pool16 = pool16->next;  /* move to next */
-        }
-    }
-    gc32_t** prev32 = &vm->gc.pool32;
-    gc32_t* pool32 = vm->gc.pool32;
-    while (pool32) {
-        if (pool32->bitmap == POOL32_BITMAP_FULL) {
-            /* pool is empty, we can free it */
-            *prev32 = pool32->next;
-            gc32_t* pool_to_freed = pool32;
-            pool32 = pool32->next;  /* move to next */
-            free(pool_to_freed);
-        } else {
-            prev32 = &pool32->next;
-            pool32 = pool32->next;  /* move to next */
+BERRY_API void be_gc_memory_pools(bvm *vm)
+{
+#if BE_USE_MEM_POOLS
+    int i;
+    for (i = 0; i < BE_MEM_POOLS; ++i) {
+        struct bmempool *pool = &vm->gc.pools[i];
+        size_t nslots = pool_slots(i);
+        /* some slabs may be empty if there are enough free slots */
+        if (pool->nslabs * nslots - pool->used >= nslots) {
+            release_slabs(pool, nslots);
         }
     }
+#else
+    (void)vm;
+#endif
 }
 
-BERRY_API void be_gc_init_memory_pools(bvm *vm) {
-    vm->gc.pool16 = NULL;
-    vm->gc.pool32 = NULL;
+BERRY_API void be_gc_init_memory_pools(bvm *vm)
+{
+    memset(vm->gc.pools, 0, sizeof(vm->gc.pools));
 }
 
-BERRY_API void be_gc_free_memory_pools(bvm *vm) {
-    gc16_t* pool16 = vm->gc.pool16;
-    while (pool16) {
-        gc16_t* pool_to_freed = pool16;
-        pool16 = pool16->next;
-        be_os_free(pool_to_freed);
-    }
-    vm->gc.pool16 = NULL;
-
-    gc32_t* pool32 = vm->gc.pool32;
-    while (pool32) {
-        gc32_t* pool_to_freed = pool32;
-        pool32 = pool32->next;
-        be_os_free(pool_to_freed);
+BERRY_API void be_gc_free_memory_pools(bvm *vm)
+{
+    int i;
+    for (i = 0; i < BE_MEM_POOLS; ++i) {
+        struct bmempool *pool = &vm->gc.pools[i];
+        bslab *slab = pool->slabs;
+        while (slab) {
+            bslab *slab_to_freed = slab;
+            slab = slab->next;
+            be_os_free(slab_to_freed);
+        }
+        pool->slabs = NULL;
+        pool->free = NULL;
+        pool->nslabs = 0;
     }
-    vm->gc.pool32 = NULL;
-}
-
-/* https://github.com/hcs0/Hackers-Delight/blob/master/pop.c.txt - count number of 1-bits */
-static int pop0(uint32_t n) __attribute__((unused));
-static int pop0(uint32_t n) {
-    n = (n & 0x55555555u) + ((n >> 1) & 0x55555555u);
-    n = (n & 0x33333333u) + ((n >> 2) & 0x33333333u);
-    n = (n & 0x0f0f0f0fu) + ((n >> 4) & 0x0f0f0f0fu);
-    n = (n & 0x00ff00ffu) + ((n >> 8) & 0x00ff00ffu);
-    n = (n & 0x0000ffffu) + ((n >>16) & 0x0000ffffu);
-    return n;
 }
 
-#ifdef __GNUC__
-  #define count_bits_1(v)   __builtin_popcount(v)
-#else
-  #define count_bits_1(v)   pop0(v)
-#endif
-
-
-BERRY_API void be_gc_memory_pools_info(bvm *vm, size_t* slots_used, size_t* slots_allocated) {
+/* get the slots used and allocated by all the pools and, if `pools` is
+ * not NULL, the statistics of each of the BE_MEM_POOLS size classes */
+BERRY_API void be_gc_memory_pools_info(bvm *vm, size_t* slots_used, size_t* slots_allocated, bmempoolinfo *pools)
+{
     size_t used = 0;
     size_t allocated = 0;
-
-    gc16_t* pool16 = vm->gc.pool16;
-    while (pool16) {
-        allocated += POOL16_SLOTS;
-        used += POOL16_SLOTS - count_bits_1(pool16->bitmap);
-        pool16 = pool16->next;
-    }
-
-    gc32_t* pool32 = vm->gc.pool32;
-    while (pool32) {
-        allocated += POOL32_SLOTS;
-        used += POOL32_SLOTS - count_bits_1(pool32->bitmap);
-        pool32 = pool32->next;
+    int i;
+    for (i = 0; i < BE_MEM_POOLS; ++i) {
+        struct bmempool *pool = &vm->gc.pools[i];
+        used += pool->used;
+        allocated += pool->nslabs * pool_slots(i);
+        if (pools) {
+            pools[i].size = pool_size[i];
+            pools[i].used = pool->used;
+            pools[i].allocated = pool->nslabs * pool_slots(i);
+        }
     }
     if (slots_used) { *slots_used = used; }
     if (slots_allocated) { *slots_allocated = allocated; }
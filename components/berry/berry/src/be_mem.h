@@ -17,6 +17,15 @@ extern "C" {
 #define be_malloc(vm, size)         be_realloc((vm), NULL, 0, (size))
 #define be_free(vm, ptr, size)      be_realloc((vm), (ptr), (size), 0)
 
+#define BE_MEM_POOLS                8   /* size classes of the memory pools, 8 to 128 bytes */
+
+/* statistics of the memory pool of a size class */
+typedef struct {
+    size_t size;        /* the size of a slot */
+    size_t used;        /* the count of allocated slots */
+    size_t allocated;   /* the count of slots, allocated or free */
+} bmempoolinfo;
+
 BERRY_API void* be_os_malloc(size_t size);
 BERRY_API void be_os_free(void *ptr);
 BERRY_API void* be_os_realloc(void *ptr, size_t size);
@@ -24,7 +33,7 @@ BERRY_API void* be_realloc(bvm *vm, void *ptr, size_t old_size, size_t new_size)
 BERRY_API void be_gc_memory_pools(bvm *vm);
 BERRY_API void be_gc_free_memory_pools(bvm *vm);
 BERRY_API void be_gc_init_memory_pools(bvm *vm);
-BERRY_API void be_gc_memory_pools_info(bvm *vm, size_t* slots_used, size_t* slots_allocated);
+BERRY_API void be_gc_memory_pools_info(bvm *vm, size_t* slots_used, size_t* slots_allocated, bmempoolinfo *pools);
 
 /* The following moves a portion of memory to constraint regions with 32-bits read/write acess */
 /* Effective only if `BE_USE_MEM_ALIGNED` is set to `1`*/
@@ -85,6 +85,7 @@ static void insert_attrs(bvm *vm, bmap *table, const bntvmodule *nm)
         default: /* error */
             break;
         }
+        be_gc_barrier(vm, table);
     }
 }
 
@@ -98,6 +99,7 @@ static bmodule* new_module(bvm *vm, const bntvmodule *nm)
         obj->info.native = nm;
         obj->table = NULL; /* gc protection */
         obj->table = be_map_new(vm);
+        be_gc_barrier(vm, obj);
         insert_attrs(vm, obj->table, nm);
         be_map_compact(vm, obj->table); /* clear space */
         be_stackpop(vm, 1);
@@ -153,9 +155,14 @@ static char* conpath(bvm *vm, bstring *path1, bstring *path2, size_t *size)
     return buffer;
 }
 
-static int open_script(bvm *vm, char *path)
+static int open_script(bvm *vm, char *path, bbool cached)
 {
+#if BE_USE_BYTECODE_CACHE
+    int res = cached ? be_loadcached(vm, path) : be_loadmodule(vm, path);
+#else
     int res = be_loadmodule(vm, path);
+    (void)cached;
+#endif
     if (res == BE_OK)
         be_call(vm, 0);
     return res;
@@ -174,10 +181,15 @@ static int open_dllib(bvm *vm, char *path)
 static int open_libfile(bvm *vm, char *path, size_t size)
 {
     int res, idx = 0;
+#if BE_USE_BYTECODE_CACHE
+    /* a ".be" source is loaded with its ".bec" copy, see be_loadcached() */
+    const char *sfxs[] = { "", ".be", ".bec" };
+#else
     const char *sfxs[] = { "", ".bec", ".be" };
+#endif
     do {
         strcpy(path + size - SUFFIX_LEN, sfxs[idx]);
-        res = open_script(vm, path);
+        res = open_script(vm, path, idx == 1);
     } while (idx++ < 2 && res == BE_IO_ERROR);
     if (res == BE_IO_ERROR) {
 #if BE_USE_SHARED_LIB
@@ -304,6 +316,7 @@ bmodule* be_module_new(bvm *vm)
         obj->info.native = NULL;
         obj->table = NULL; /* gc protection */
         obj->table = be_map_new(vm);
+        be_gc_barrier(vm, obj);
         be_stackpop(vm, 1);
     }
     return obj;
@@ -360,6 +373,7 @@ bbool be_module_setmember(bvm *vm, bmodule *module, bstring *attr, bvalue *src)
         }
         if (v) {
             *v = *src;
+            be_gc_barrier(vm, attrs);
             return btrue;
         }
     } else {
@@ -438,6 +452,7 @@ BERRY_API void be_module_path_set(bvm *vm, const char *path)
     bvalue *value = be_list_push(vm, list, NULL);
     var_setnil(value);
     var_setstr(value, be_newstr(vm, path))
+    be_gc_barrier(vm, list);
 }
 
 /* shared library support */
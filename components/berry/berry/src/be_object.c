@@ -13,6 +13,17 @@
 
 #define cast_comobj(o)      gc_cast(o, BE_COMOBJ, bcommomobj)
 
+#if BE_USE_NAN_BOXING
+/* the inverse of be_vkind(), the unused kinds are never decoded */
+const short be_vtypes[32] = {
+    BE_REAL, BE_NIL, BE_BOOL, BE_INT, BE_INDEX, BE_COMPTR, BE_COMOBJ, BE_NONE,
+    BE_REAL, BE_STRING, BE_CLASS, BE_INSTANCE, BE_PROTO, BE_LIST, BE_MAP, BE_MODULE,
+    BE_REAL, BE_NTVFUNC, BE_CLOSURE, BE_NTVCLOS, BE_CTYPE_FUNC, BE_LEAF_FUNC, BE_REAL, BE_REAL,
+    BE_REAL, BE_NTVFUNC | BE_STATIC, BE_CLOSURE | BE_STATIC, BE_NTVCLOS | BE_STATIC,
+    BE_CTYPE_FUNC | BE_STATIC, BE_LEAF_FUNC | BE_STATIC, BE_REAL, BE_REAL
+};
+#endif
+
 const char* be_vtype2str(bvalue *v)
 {
     switch(var_primetype(v)) {
@@ -21,7 +32,7 @@ const char* be_vtype2str(bvalue *v)
     case BE_REAL: return "real";
     case BE_BOOL: return "bool";
     case BE_CLOSURE: case BE_NTVCLOS: case BE_CTYPE_FUNC:
-    case BE_NTVFUNC: return "function";
+    case BE_NTVFUNC: case BE_LEAF_FUNC: return "function";
     case BE_PROTO: return "proto";
     case BE_CLASS: return "class";
     case BE_STRING: return "string";
@@ -36,7 +36,8 @@
 #define BE_CLOSURE      ((1 << 5) | BE_FUNCTION)
 #define BE_NTVCLOS      ((2 << 5) | BE_FUNCTION)
 #define BE_CTYPE_FUNC   ((3 << 5) | BE_FUNCTION)
-#define BE_STATIC       (1 << 7)
+#define BE_LEAF_FUNC    ((4 << 5) | BE_FUNCTION)    /* native function that never re-enters the VM */
+#define BE_STATIC       (1 << 8)
 
 #define func_isstatic(o)       (((o)->type & BE_STATIC) != 0)
 #define func_setstatic(o)      ((o)->type |= BE_STATIC)
@@ -45,6 +46,7 @@
 /* values for bproto.varg */
 #define BE_VA_VARARG    (1 << 0)    /* function has variable number of arguments */
 #define BE_VA_METHOD    (1 << 1)    /* function is a method (this is only a hint) */
+#define BE_VA_LAZY      (1 << 2)    /* function body is compiled on the first call */
 #define array_count(a)   (sizeof(a) / sizeof((a)[0]))
 
 #define bcommon_header          \
@@ -108,12 +110,24 @@ union bvaldata {
 #endif
 };
 
+#if BE_USE_NAN_BOXING
+/* NaN-boxed berry value. a real number is stored as is, all other
+ * values are encoded in the NaN space: the sign bit and the mantissa
+ * bits 48 to 51 hold the kind of the value (see be_vkind()), the low
+ * 48 bits hold the pointer, integer or boolean. the real number NaN
+ * is always stored as BE_VNAN so it can't be confused with a kind. */
+typedef union bvalue {
+    uint64_t u; /* the boxed value */
+    breal r;    /* only used by constant initializers, use var_toreal() */
+} bvalue;
+#else
 /* berry value. for simple types, the value of the data is stored,
  * while the complex type stores a reference to the data. */
 typedef struct bvalue {
     union bvaldata v; /* the value data */
     int type;         /* the value type */
 } bvalue;
+#endif
 
 typedef struct {
 #if BE_DEBUG_VAR_INFO
@@ -144,6 +158,24 @@ typedef struct {
 #endif
 } bvarinfo;
 
+/* body of a `try` block, the instructions in (beginpc, endpc) are protected.
+ * The EXBLK at `beginpc` jumps to the `except` chain of the block. */
+typedef struct {
+    int beginpc;
+    int endpc;
+} btryrange;
+
+/* inline cache entry, a proto has one entry per member instruction with
+ * a constant name. It remembers how the member was last resolved by this
+ * instruction, keyed on the class of the receiver. */
+typedef struct bicache {
+    bclass *cls; /* class of the receiver, NULL if the entry is empty */
+    bclass *owner; /* class of the instance (or super-instance) owning the member */
+    uint32_t epoch; /* value of `vm->icepoch` when the entry was filled */
+    bbyte depth; /* number of super-instance hops from the receiver to the owner */
+    bvalue value; /* raw member: slot index (BE_INDEX), method or static value */
+} bicache;
+
 typedef struct bproto {
     bcommon_header;
     bbyte nstack; /* number of stack size by this function */
@@ -168,6 +200,14 @@ typedef struct bproto {
     bvarinfo *varinfo;
     int nvarinfo;
 #endif
+#if BE_USE_INLINE_CACHE
+    bicache *icache; /* inline caches, allocated on first use (nicache entries) */
+    uint16_t *icindex; /* index + 1 of the cache of each instruction, 0 if none */
+    int nicache; /* inline caches count */
+#endif
+    btryrange *tryranges; /* `try` blocks, inner blocks before outer ones */
+    int ntryranges; /* `try` blocks count */
+    struct bclass *cls; /* class of a method, the layout assumed by GETSMBR and SETSMBR */
 } bproto;
 
 /* berry closure */
@@ -200,6 +240,104 @@ typedef const char* (*breader)(void*, size_t*);
 #define cast_int(_v)            cast(int, _v)
 #define cast_bool(_v)           cast(bbool, _v)
 #define basetype(_t)            ((_t) & 0x1F)
+/* integer `+`, `-` and `*` wrap around on overflow, the operation is
+ * done on unsigned integers since the signed overflow is undefined */
+#define int_wrap(op, _a, _b)    cast(bint, cast(unsigned BE_INTEGER, _a) op cast(unsigned BE_INTEGER, _b))
+
+#if BE_USE_NAN_BOXING
+
+#if BE_INTGER_TYPE != 0 || BE_USE_SINGLE_FLOAT != 0
+  #error "BE_USE_NAN_BOXING requires 32-bit integers and double precision reals."
+#endif
+#if UINTPTR_MAX <= 0xFFFFFFFFu
+  #error "BE_USE_NAN_BOXING requires 64-bit pointers."
+#endif
+
+#define BE_VPAYLOAD             ((uint64_t)0xFFFFFFFFFFFF)
+#define BE_VSTATIC              ((uint64_t)8 << 48)
+#define BE_VNAN                 ((uint64_t)0x7FF8 << 48)
+
+/* kind of a boxed type: 1 to 7 and 9 to 15 (positive NaNs) for the
+ * data types, 17 to 21 (negative NaNs) for the functions and 25 to 29
+ * for the static functions, so BE_VSTATIC toggles the static flag.
+ * the kinds 0, 8, 16 and 24 are left to the infinities and NaNs. */
+#define be_vkind(_t) (                                                  \
+    (_t) == BE_NIL ? 1 : (_t) == BE_BOOL ? 2 : (_t) == BE_INT ? 3 :     \
+    (_t) == BE_INDEX ? 4 : (_t) == BE_COMPTR ? 5 :                      \
+    (_t) == BE_COMOBJ ? 6 : (_t) == BE_NONE ? 7 :                       \
+    basetype(_t) == BE_FUNCTION ?                                       \
+        17 + (((_t) >> 5) & 7) + ((_t) & BE_STATIC ? 8 : 0) :           \
+    (_t) >= BE_STRING && (_t) <= BE_MODULE ? (_t) - BE_STRING + 9 : 0)
+#define be_vtag16(_t)           ((unsigned)(((be_vkind(_t) >> 4) << 15) | 0x7FF0 | (be_vkind(_t) & 15)))
+#define be_vtag(_t)             ((uint64_t)be_vtag16(_t) << 48)
+#define be_vhigh(_u)            ((unsigned)((_u) >> 48))
+#define be_visboxed(_u)         ((be_vhigh(_u) & 0x7FF0) == 0x7FF0 && (be_vhigh(_u) & 7) != 0)
+#define be_vkindof(_u)          (((be_vhigh(_u) >> 11) & 0x10) | (be_vhigh(_u) & 15))
+#define be_vbox(_p, _t)         ((uint64_t)(uintptr_t)(_p) + be_vtag(_t))
+#define be_vreal(_u)            (((bvalue){ .u = (_u) }).r)
+#define be_vbits(_r)            ((_r) == (_r) ? ((bvalue){ .r = (_r) }).u : BE_VNAN)
+
+extern const short be_vtypes[32]; /* the type of each kind */
+
+#define var_type(_v)            (be_visboxed((_v)->u) ? be_vtypes[be_vkindof((_v)->u)] : BE_REAL)
+#define var_basetype(_v)        basetype(var_type(_v))
+#define var_primetype(_v)       (var_type(_v) & ~BE_STATIC)
+#define var_isstatic(_v)        ((be_vhigh((_v)->u) & 0xFFF8) == 0xFFF8 && (be_vhigh((_v)->u) & 7) != 0)
+#define var_istype(_v, _t)      (basetype(_t) == BE_FUNCTION ?                     \
+                                    (be_vhigh((_v)->u) & ~8u) == be_vtag16(_t) :   \
+                                 (_t) == BE_REAL ? !be_visboxed((_v)->u) :         \
+                                    be_vhigh((_v)->u) == be_vtag16(_t))
+#define var_settype(_v, _t)     ((_v)->u = ((_v)->u & BE_VPAYLOAD) | be_vtag(_t))
+#define var_markstatic(_v)      ((_v)->u |= BE_VSTATIC)
+#define var_clearstatic(_v)     (var_isstatic(_v) ? (void)((_v)->u &= ~BE_VSTATIC) : (void)0)
+#define var_setobj(_v, _t, _o)  { (_v)->u = be_vbox(_o, _t); }
+
+#define var_isnil(_v)           var_istype(_v, BE_NIL)
+#define var_isbool(_v)          var_istype(_v, BE_BOOL)
+#define var_isint(_v)           var_istype(_v, BE_INT)
+#define var_isreal(_v)          (!be_visboxed((_v)->u))
+#define var_isstr(_v)           var_istype(_v, BE_STRING)
+#define var_isclosure(_v)       var_istype(_v, BE_CLOSURE)
+#define var_isntvclos(_v)       var_istype(_v, BE_NTVCLOS)
+#define var_isntvfunc(_v)       var_istype(_v, BE_NTVFUNC)
+#define var_isfunction(_v)      ((be_vhigh((_v)->u) & 0xFFF0) == 0xFFF0 && (be_vhigh((_v)->u) & 7) != 0)
+#define var_isproto(_v)         var_istype(_v, BE_PROTO)
+#define var_isclass(_v)         var_istype(_v, BE_CLASS)
+#define var_isinstance(_v)      var_istype(_v, BE_INSTANCE)
+#define var_islist(_v)          var_istype(_v, BE_LIST)
+#define var_ismap(_v)           var_istype(_v, BE_MAP)
+#define var_ismodule(_v)        var_istype(_v, BE_MODULE)
+#define var_isindex(_v)         var_istype(_v, BE_INDEX)
+#define var_iscomptr(_v)        var_istype(_v, BE_COMPTR)
+#define var_isnumber(_v)        (var_isint(_v) || var_isreal(_v))
+
+#define var_setnil(_v)          ((_v)->u = be_vtag(BE_NIL))
+#define var_setval(_v, _s)      (*(_v) = *(_s))
+#define var_setbool(_v, _b)     { (_v)->u = be_vtag(BE_BOOL) | (uint64_t)(bbool)(_b); }
+#define var_setint(_v, _i)      { (_v)->u = be_vtag(BE_INT) | (uint32_t)(_i); }
+#define var_setreal(_v, _r)     { breal _real = (_r); (_v)->u = be_vbits(_real); }
+#define var_setstr(_v, _s)      var_setobj(_v, BE_STRING, _s)
+#define var_setinstance(_v, _o) var_setobj(_v, BE_INSTANCE, _o)
+#define var_setclass(_v, _o)    var_setobj(_v, BE_CLASS, _o)
+#define var_setclosure(_v, _o)  var_setobj(_v, BE_CLOSURE, _o)
+#define var_setntvclos(_v, _o)  var_setobj(_v, BE_NTVCLOS, _o)
+#define var_setntvfunc(_v, _o)  var_setobj(_v, BE_NTVFUNC, _o)
+#define var_setlist(_v, _o)     var_setobj(_v, BE_LIST, _o)
+#define var_setmap(_v, _o)      var_setobj(_v, BE_MAP, _o)
+#define var_setmodule(_v, _o)   var_setobj(_v, BE_MODULE, _o)
+#define var_setindex(_v, _i)    { (_v)->u = be_vtag(BE_INDEX) | (uint32_t)(_i); }
+#define var_setproto(_v, _o)    var_setobj(_v, BE_PROTO, _o)
+
+#define var_tobool(_v)          ((bbool)((_v)->u & 1))
+#define var_toint(_v)           ((bint)(int32_t)(uint32_t)(_v)->u)
+#define var_toreal(_v)          be_vreal((_v)->u)
+#define var_tostr(_v)           ((bstring*)var_toobj(_v))
+#define var_togc(_v)            ((bgcobject*)var_toobj(_v))
+#define var_toobj(_v)           ((void*)(uintptr_t)((_v)->u & BE_VPAYLOAD))
+#define var_tontvfunc(_v)       ((bntvfunc)(uintptr_t)((_v)->u & BE_VPAYLOAD))
+#define var_toidx(_v)           cast_int(var_toint(_v))
+
+#else
 
 #define var_type(_v)            ((_v)->type)
 #define var_basetype(_v)        basetype((_v)->type)
@@ -256,6 +394,9 @@ typedef const char* (*breader)(void*, size_t*);
 #define var_tontvfunc(_v)       ((_v)->v.nf)
 #define var_toidx(_v)           cast_int(var_toint(_v))
 
+
+#endif
+
 const char* be_vtype2str(bvalue *v);
 bvalue* be_indexof(bvm *vm, int idx);
 void be_commonobj_delete(bvm *vm, bgcobject *obj);
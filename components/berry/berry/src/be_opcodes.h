@@ -38,7 +38,7 @@ OPCODE(SETUPV),     /*  A, Bx    |   R(A) -> UPVALUE(Bx)*/
 OPCODE(JMP),        /*  sBx      |   pc <- pc + sBx */
 OPCODE(JMPT),       /*  A, sBx   |   if(R(A)): pc <- pc + sBx  */
 OPCODE(JMPF),       /*  A, sBx   |   if(not R(A)): pc <- pc + sBx  */
-OPCODE(CALL),       /*  A, B     |   CALL(R(A), B) */
+OPCODE(CALL),       /*  A, B, C  |   CALL(R(A), B), if(C): tail call, the frame of the caller is reused */
 OPCODE(RET),        /*  A, B     |   if (R(A)) R(-1) <- RK(B) else R(-1) <- nil */
 OPCODE(CLOSURE),    /*  A, Bx    |   R(A) <- CLOSURE(proto_table[Bx])*/
 OPCODE(GETMBR),     /*  A, B, C  |   R(A) <- RK(B).RK(C) */
@@ -54,4 +54,21 @@ OPCODE(CATCH),      /*  A, B, C  |   ... */
 OPCODE(RAISE),      /*  A, B, C  |   RAISE(B,C) B is code, C is description. A==0 only B provided, A==1 B and C are provided, A==2 rethrow with both parameters already on stack */
 OPCODE(CLASS),      /*  Bx       |   init class in K[Bx] */
 OPCODE(GETNGBL),    /*  A, B     |   R(A) <- GLOBAL[RK(B)] by name */
-OPCODE(SETNGBL)     /*  A, B     |   R(A) -> GLOBAL[RK(B)] by name */
+OPCODE(SETNGBL),    /*  A, B     |   R(A) -> GLOBAL[RK(B)] by name */
+OPCODE(FORPREP),    /*  A, B, C  |   R(A) <- iteration state of RK(B) (if B == C == A) or of connect(RK(B), RK(C)), uses R(A), R(A+1) */
+OPCODE(FORLOOP),    /*  A, sBx   |   R(A+2) <- next item of iteration state R(A), R(A+1), or pc <- pc + sBx when done */
+OPCODE(APPEND),     /*  A, B, C  |   R(A) <- connect(R(B), RK(C)) with B == A the temporary result of a previous connect, may be extended in place */
+OPCODE(GETSMBR),    /*  A, B, C  |   R(A) <- self.members[B] when `self` (R(0)) is an instance of the method's class, else R(A) <- R(0).K(C) */
+OPCODE(SETSMBR),    /*  A, B, C  |   self.members[A] <- RK(C) when `self` (R(0)) is an instance of the method's class, else R(0).K(B) <- RK(C) */
+OPCODE(COMPILE),    /*           |   compile the body of a lazy function in place of this stub and restart the call */
+/* type-specialized opcodes, never emitted by the compiler but written over
+ * the generic opcode at runtime (quickening), see `be_vm_unquicken()` */
+OPCODE(ADD_II),     /*  A, B, C  |   R(A) <- RK(B) + RK(C) with integer operands */
+OPCODE(SUB_II),     /*  A, B, C  |   R(A) <- RK(B) - RK(C) with integer operands */
+OPCODE(LT_II),      /*  A, B, C  |   R(A) <- RK(B) < RK(C) with integer operands */
+OPCODE(LE_II),      /*  A, B, C  |   R(A) <- RK(B) <= RK(C) with integer operands */
+OPCODE(GT_II),      /*  A, B, C  |   R(A) <- RK(B) > RK(C) with integer operands */
+OPCODE(GE_II),      /*  A, B, C  |   R(A) <- RK(B) >= RK(C) with integer operands */
+OPCODE(ADD_RR),     /*  A, B, C  |   R(A) <- RK(B) + RK(C) with real operands */
+OPCODE(GETIDX_LI),  /*  A, B, C  |   R(A) <- RK(B)[RK(C)] with `list` instance and integer index */
+OPCODE(SETIDX_LI)   /*  A, B, C  |   R(A)[RK(B)] <- RK(C) with `list` instance and integer index */
@@ -19,6 +19,7 @@
 #include "be_class.h"
 #include "be_decoder.h"
 #include "be_exec.h"
+#include "be_gc.h"
 #include <limits.h>
 
 #define OP_NOT_BINARY           TokenNone
@@ -66,10 +67,17 @@
 #define push_error(parser, ...) \
     parser_error(parser, be_pushfstring(parser->vm, __VA_ARGS__))
 
+/* a class being compiled */
+typedef struct bclassinfo {
+    struct bclassinfo *prev; /* enclosing class */
+    bclass *c;
+} bclassinfo;
+
 typedef struct {
     blexer lexer;
     bvm *vm;
     bfuncinfo *finfo;
+    bclassinfo *cinfo; /* innermost class being compiled */
     bclosure *cl;
     bbyte islocal;
 } bparser;
@@ -162,6 +170,7 @@ void begin_varinfo(bparser *parser, bstring *name)
     var->endpc = 0; /*  */
     finfo->proto->varinfo = be_vector_data(&finfo->varvec);
     finfo->proto->nvarinfo = be_vector_capacity(&finfo->varvec);
+    be_gc_barrier(parser->vm, finfo->proto);
 }
 
 void end_varinfo(bparser *parser, int beginpc)
@@ -249,13 +258,23 @@ static void begin_func(bparser *parser, bfuncinfo *finfo, bblockinfo *binfo)
     be_vector_init(vm, &finfo->pvec, sizeof(bproto*)); /* vector for subprotos */
     proto->ptab = be_vector_data(&finfo->pvec);
     proto->nproto = be_vector_capacity(&finfo->pvec);
+    be_vector_init(vm, &finfo->tryvec, sizeof(btryrange)); /* vector for try blocks */
+    proto->tryranges = be_vector_data(&finfo->tryvec);
+    proto->ntryranges = be_vector_capacity(&finfo->tryvec);
     proto->source = parser_source(parser); /* keep a copy of source for function */
+    be_gc_barrier(vm, proto);
     finfo->local = be_list_new(vm); /* list for local variables */
     var_setlist(vm->top, finfo->local); /* push list of local variables on the stack (avoid gc) */
     be_stackpush(vm);
     finfo->upval = be_map_new(vm); /* push a map for upvals on stack */
     var_setmap(vm->top, finfo->upval);
     be_stackpush(vm);
+    finfo->kmap = be_map_new(vm); /* push a map for the constants index on stack */
+    var_setmap(vm->top, finfo->kmap);
+    be_stackpush(vm);
+    finfo->localfn = be_map_new(vm); /* push a map for the local functions on stack */
+    var_setmap(vm->top, finfo->localfn);
+    be_stackpush(vm);
     finfo->prev = parser->finfo; /* init finfo */
     finfo->lexer = &parser->lexer;
     finfo->proto = proto;
@@ -263,6 +282,7 @@ static void begin_func(bparser *parser, bfuncinfo *finfo, bblockinfo *binfo)
     finfo->binfo = NULL;
     finfo->pc = 0;
     finfo->flags = 0;
+    finfo->cls = NULL;
     parser->finfo = finfo;
 #if BE_DEBUG_RUNTIME_INFO
     be_vector_init(vm, &finfo->linevec, sizeof(blineinfo));
@@ -312,12 +332,18 @@ static void end_func(bparser *parser)
     be_code_ret(finfo, NULL); /* append a return to last code */
     end_block(parser); /* close block */
     setupvals(finfo); /* close upvals */
+    if (comp_is_optimize(vm)) {
+        be_code_inlinecalls(finfo); /* copy the calls of the local functions */
+        be_code_optimize(finfo); /* peephole pass over the final code */
+    }
     proto->code = be_vector_release(vm, &finfo->code); /* compact all vectors and return NULL if empty */
     proto->codesize = finfo->pc;
     proto->ktab = be_vector_release(vm, &finfo->kvec);
     proto->nconst = be_vector_count(&finfo->kvec);
     proto->ptab = be_vector_release(vm, &finfo->pvec);
     proto->nproto = be_vector_count(&finfo->pvec);
+    proto->tryranges = be_vector_release(vm, &finfo->tryvec);
+    proto->ntryranges = be_vector_count(&finfo->tryvec);
 #if BE_DEBUG_RUNTIME_INFO
     proto->lineinfo = be_vector_release(vm, &finfo->linevec);
     proto->nlineinfo = be_vector_count(&finfo->linevec);
@@ -326,8 +352,9 @@ static void end_func(bparser *parser)
     proto->varinfo = be_vector_release(vm, &finfo->varvec);
     proto->nvarinfo = be_vector_count(&finfo->varvec);
 #endif
+    be_gc_barrier(vm, proto); /* the tables were filled after its scan */
     parser->finfo = parser->finfo->prev; /* restore previous `finfo` */
-    be_stackpop(vm, 2); /* pop upval and local */
+    be_stackpop(vm, 4); /* pop localfn, kmap, upval and local */
 }
 
 /* is the next token a binary operator? If yes return the operator or `OP_NOT_BINARY` */
@@ -380,7 +407,7 @@ static int find_localvar(bfuncinfo *finfo, bstring *s, int begin)
     int i, count = be_list_count(finfo->local);
     bvalue *var = be_list_data(finfo->local);
     for (i = count - 1; i >= begin; --i) {
-        if (be_eqstr(var[i].v.s, s)) {
+        if (be_eqstr(var_tostr(&var[i]), s)) {
             return i;
         }
     }
@@ -406,6 +433,7 @@ static int new_localvar(bparser *parser, bstring *name)
         reg = be_list_count(finfo->local); /* new local index */
         var = be_list_push(parser->vm, finfo->local, NULL);
         var_setstr(var, name);
+        be_code_localfn(finfo, reg, NULL); /* the register may be reused */
         if (reg >= finfo->freereg) {
             be_code_allocregs(finfo, 1); /* use a register */
         }
@@ -422,7 +450,7 @@ static int find_upval(bfuncinfo *finfo, bstring *s)
     bvm *vm = finfo->lexer->vm;
     bvalue *desc = be_map_findstr(vm, finfo->upval, s);
     if (desc) {
-        return upval_index(desc->v.i);
+        return upval_index(var_toint(desc));
     }
     return -1;
 }
@@ -547,6 +575,38 @@ static void singlevar(bparser *parser, bexpdesc *var)
     }
 }
 
+/* The variable `e` is assigned, if it is a local variable of the current or
+ * an enclosing function (by an upvalue), the calls of the function it may
+ * hold are not inlined */
+static void localfn_assigned(bparser *parser, bexpdesc *e)
+{
+    bfuncinfo *finfo = parser->finfo;
+    int idx = e->v.idx;
+    if (e->type != ETLOCAL && e->type != ETUPVAL) {
+        return;
+    }
+    while (e->type == ETUPVAL) { /* follow the upvalues to the local variable */
+        bmapnode *node;
+        bmapiter iter = be_map_iter();
+        int desc = -1;
+        while ((node = be_map_next(finfo->upval, &iter)) != NULL) {
+            if ((int)upval_index(var_toint(&node->value)) == idx) {
+                desc = (int)var_toint(&node->value);
+                break;
+            }
+        }
+        if (desc < 0 || finfo->prev == NULL) {
+            return; /* a variable of a function already compiled */
+        }
+        finfo = finfo->prev;
+        idx = upval_target(desc);
+        if (upval_instack(desc)) {
+            break;
+        }
+    }
+    be_code_localfn_assigned(finfo, idx);
+}
+
 /* parse a vararg argument in the form `def f(a, *b) end` */
 /* Munch the '*', read the token, create variable and declare the function as vararg */
 static void func_vararg(bparser *parser) {
@@ -588,8 +648,86 @@ static void func_varlist(bparser *parser)
             }
         }
     }
+    parser->finfo->proto->argc = parser->finfo->freereg; /* ')' is left to the caller */
+}
+
+/* Make `name` an upvalue of the current function if it is a variable of an
+ * enclosing function, unlike singlevaraux() the globals are not looked up.
+ * The body may assign the variable, so it is considered as assigned. */
+static void lazy_upval(bparser *parser, bstring *name)
+{
+    bfuncinfo *f, *finfo = parser->finfo;
+    if (find_localvar(finfo, name, 0) >= 0 || find_upval(finfo, name) >= 0) {
+        return; /* argument or known upvalue */
+    }
+    for (f = finfo->prev; f; f = f->prev) {
+        if (find_localvar(f, name, 0) >= 0 || find_upval(f, name) >= 0) {
+            bexpdesc e;
+            singlevaraux(finfo->lexer->vm, finfo, name, &e);
+            localfn_assigned(parser, &e);
+            return;
+        }
+    }
+}
+
+/* Record the source of a function body up to its `end` instead of compiling
+ * it, the stub code compiles it on the first call (see be_parser_lazy()).
+ * Every identifier that names a variable of an enclosing function becomes
+ * an upvalue, this is a superset of the upvalues of the compiled body. */
+static void lazy_body(bparser *parser)
+{
+    bvm *vm = parser->vm;
+    bfuncinfo *finfo = parser->finfo;
+    btokentype last = OptRBK;
+    int depth = 0, line = parser->lexer.linenumber;
+    int i, nlocal = be_list_count(finfo->local), nupval;
+    bmapnode *node;
+    bmapiter iter = be_map_iter();
+    blist *k;
+    be_lexer_capture(&parser->lexer);
     match_token(parser, OptRBK); /* skip ')' */
-    parser->finfo->proto->argc = parser->finfo->freereg;
+    while (depth || next_type(parser) != KeyEnd) {
+        switch (next_type(parser)) {
+        case KeyIf: case KeyWhile: case KeyFor: case KeyDo:
+        case KeyTry: case KeyDef: case KeyClass: /* blocks closed by `end` */
+            ++depth;
+            break;
+        case KeyEnd:
+            --depth;
+            break;
+        case TokenId:
+            if (last != OptDot) { /* not a member name */
+                lazy_upval(parser, next_token(parser).u.s);
+            }
+            break;
+        case TokenEOS:
+            match_token(parser, KeyEnd); /* raise the error of the missing `end` */
+            break;
+        default:
+            break;
+        }
+        last = next_type(parser);
+        scan_next_token(parser);
+    }
+    /* constants of the stub: source text, first line, names of the
+     * arguments then names of the upvalues by index */
+    nupval = be_map_count(finfo->upval);
+    k = be_list_new(vm);
+    var_setlist(vm->top, k);
+    be_stackpush(vm);
+    be_list_resize(vm, k, 2 + nlocal + nupval);
+    var_setstr(be_list_at(k, 0), be_lexer_captured(&parser->lexer));
+    var_setint(be_list_at(k, 1), line);
+    for (i = 0; i < nlocal; ++i) {
+        *be_list_at(k, 2 + i) = *be_list_at(finfo->local, i);
+    }
+    while ((node = be_map_next(finfo->upval, &iter)) != NULL) {
+        int index = upval_index((uint32_t)var_toint(&node->value));
+        be_map_key2value(be_list_at(k, 2 + nlocal + index), node);
+    }
+    be_code_lazy(finfo, k);
+    be_stackpop(vm, 1);
+    finfo->proto->varg |= BE_VA_LAZY;
 }
 
 /* Parse a function includind arg list and body */
@@ -603,12 +741,19 @@ static bproto* funcbody(bparser *parser, bstring *name, int type)
     /* '(' varlist ')' block 'end' */
     begin_func(parser, &finfo, &binfo); /* init new function context */
     finfo.proto->name = name;
+    be_gc_barrier(parser->vm, finfo.proto);
     if (type & FUNC_METHOD) { /* If method, add an implicit first argument `self` */
         new_localvar(parser, parser_newstr(parser, "self"));
         finfo.proto->varg |= BE_VA_METHOD;
+        finfo.cls = parser->cinfo->c; /* `self.<var>` can use the slot index */
     }
     func_varlist(parser); /* parse arg list */
-    stmtlist(parser); /* parse statement without final `end` */
+    if (comp_is_lazy(parser->vm)) {
+        lazy_body(parser); /* the body is compiled on the first call */
+    } else {
+        match_token(parser, OptRBK); /* skip ')' */
+        stmtlist(parser); /* parse statement without final `end` */
+    }
     end_func(parser); /* close function context */
     match_token(parser, KeyEnd); /* skip 'end' */
     return finfo.proto; /* return fully constructed `bproto` */
@@ -661,6 +806,7 @@ static void lambda_expr(bparser *parser, bexpdesc *e)
     scan_next_token(parser); /* skip '/' */
     begin_func(parser, &finfo, &binfo);
     finfo.proto->name = name;
+    be_gc_barrier(parser->vm, finfo.proto);
     lambda_varlist(parser);
     expr(parser, &e1);
     check_var(parser, &e1);
@@ -776,6 +922,9 @@ static void call_expr(bparser *parser, bexpdesc *e)
         base = be_code_getmethod(finfo, e);
     } else {
         base = be_code_nextreg(finfo, e); /* allocate a new base reg if not at top already */
+        if (e->type == ETLOCAL) {
+            be_code_localcall(finfo, e->v.idx); /* the call may be inlined */
+        }
     }
     /* base is always taken at top of freereg and allocates 1 reg for function and 2 regs for method */
     scan_next_token(parser); /* skip '(' */
@@ -1014,6 +1163,7 @@ static void assign_expr(bparser *parser)
         if (check_newvar(parser, &e)) { /* new variable */
             new_var(parser, e.v.s, &e);
         }
+        localfn_assigned(parser, &e);
         if (be_code_setvar(parser->finfo, &e, &e1)) {
             parser->lexer.linenumber = line;
             parser_error(parser,
@@ -1063,6 +1213,7 @@ static void sub_expr(bparser *parser, bexpdesc *e, int prio)
 {
     bfuncinfo *finfo = parser->finfo;
     btokentype op = get_unary_op(parser);  /* check if first token in unary op */
+    btokentype prevop = OP_NOT_BINARY;  /* previous binop of the chain */
     if (op != OP_NOT_UNARY) {  /* unary op found */
         int line, res;
         scan_next_token(parser);  /* move to next token */
@@ -1081,6 +1232,7 @@ static void sub_expr(bparser *parser, bexpdesc *e, int prio)
     op = get_binop(parser);  /* check if binop */
     while (op != OP_NOT_BINARY && prio > binary_op_prio(op)) {  /* is binop applicable */
         bexpdesc e2;
+        int chain = op == OptConnect && prevop == OptConnect;
         check_var(parser, e);  /* check that left part is valid */
         scan_next_token(parser);  /* move to next token */
         be_code_prebinop(finfo, op, e); /* and or */
@@ -1091,7 +1243,12 @@ static void sub_expr(bparser *parser, bexpdesc *e, int prio)
         } else {
             check_var(parser, &e2);  /* check if valid */
         }
-        be_code_binop(finfo, op, e, &e2, -1); /* encode binary op */
+        if (chain) { /* `e` is the temporary result of the previous `..` */
+            be_code_append(finfo, e, &e2);
+        } else {
+            be_code_binop(finfo, op, e, &e2, -1); /* encode binary op */
+        }
+        prevop = op;
         op = get_binop(parser);  /* is there a following binop? */
     }
     if (prio == ASSIGN_OP_PRIO) {
@@ -1125,40 +1282,58 @@ static int block_follow(bparser *parser)
     }
 }
 
-static int cond_stmt(bparser *parser)
+/* `*constcond` is set to the truth value of the condition if it is
+ * known at compile time, see be_code_constcond() */
+static int cond_stmt(bparser *parser, int *constcond)
 {
     bexpdesc e;
     /* expr */
     match_notoken(parser, OptRBK);
     expr(parser, &e);
     check_var(parser, &e);
+    *constcond = be_code_constcond(&e);
     be_code_jumpbool(parser->finfo, &e, bfalse); /* go if true */
     return e.f;
 }
 
-static void condition_block(bparser *parser, int *jmp)
+/* Parse a conditional block, `dead` is true when a previous condition of
+ * the `if` statement is always true. The code of a block that never runs is
+ * dropped. Return true if this block or a previous one always runs. */
+static bbool condition_block(bparser *parser, int *jmp, bbool dead)
 {
     bfuncinfo *finfo = parser->finfo;
-    int br = cond_stmt(parser);
+    int pc = finfo->pc, nproto = be_vector_count(&finfo->pvec), k;
+    int br = cond_stmt(parser, &k);
     block(parser, 0);
-    if (next_type(parser) == KeyElif
-            || next_type(parser) == KeyElse) {
+    if (dead || k == 0) {
+        be_code_discard(finfo, pc, nproto);
+        return dead;
+    }
+    if (k != 1 && (next_type(parser) == KeyElif
+            || next_type(parser) == KeyElse)) {
         be_code_conjump(finfo, jmp, be_code_jump(finfo)); /* connect jump */
     }
     be_code_patchjump(finfo, br);
+    return k == 1;
 }
 
 static void if_stmt(bparser *parser)
 {
     int jl = NO_JUMP; /* jump list */
+    bbool dead; /* the next blocks never run */
     /* IF expr block {ELSEIF expr block}, [ELSE block], end */
     scan_next_token(parser); /* skip 'if' */
-    condition_block(parser, &jl);
+    dead = condition_block(parser, &jl, bfalse);
     while (match_skip(parser, KeyElif)) { /* 'elif' */
-        condition_block(parser, &jl);
+        dead = condition_block(parser, &jl, dead);
     }
     if (match_skip(parser, KeyElse)) { /* 'else' */
+        bfuncinfo *finfo = parser->finfo;
+        int pc = finfo->pc, nproto = be_vector_count(&finfo->pvec);
         block(parser, 0);
+        if (dead) {
+            be_code_discard(finfo, pc, nproto);
+        }
     }
     match_token(parser, KeyEnd); /* skip end */
     be_code_patchjump(parser->finfo, jl);
@@ -1174,16 +1349,20 @@ static void do_stmt(bparser *parser)
 
 static void while_stmt(bparser *parser)
 {
-    int brk;
+    int brk, k;
     bblockinfo binfo;
     bfuncinfo *finfo = parser->finfo;
+    int pc = finfo->pc, nproto = be_vector_count(&finfo->pvec);
     /* WHILE expr block END */
     scan_next_token(parser); /* skip 'while' */
     begin_block(parser->finfo, &binfo, BLOCK_LOOP);
-    brk = cond_stmt(parser);
+    brk = cond_stmt(parser, &k);
     stmtlist(parser);
     end_block(parser);
     be_code_patchjump(finfo, brk);
+    if (k == 0) { /* the loop never runs */
+        be_code_discard(finfo, pc, nproto);
+    }
     match_token(parser, KeyEnd); /* skip 'end' */
 }
 
@@ -1200,20 +1379,16 @@ static bstring* for_itvar(bparser *parser)
 
 static void for_init(bparser *parser, bexpdesc *v)
 {
-    bexpdesc e;
-    bstring *s;
+    int base, beginpc = parser->finfo->pc;
     bfuncinfo *finfo = parser->finfo;
-    /* .it = __iterator__(expr) */
-    s = parser_newstr(parser, "__iterator__");
-    init_exp(&e, ETGLOBAL, be_builtin_find(parser->vm, s));
-    be_code_nextreg(finfo, &e); /* code function '__iterator__' */
+    /* .it, .is = iteration state of expr */
     expr(parser, v);
     check_var(parser, v);
-    be_code_nextreg(finfo, v);
-    be_code_call(finfo, e.v.idx, 1); /* call __iterator__(expr) */
-    be_code_freeregs(finfo, 1); /* free register of __iterator__ */
-    s = parser_newstr(parser, ".it");
-    init_exp(v, ETLOCAL, new_localvar(parser, s));
+    base = be_code_nextreg(finfo, v);
+    be_code_forprep(finfo, base, beginpc);
+    init_exp(v, ETLOCAL, new_localvar(parser, parser_newstr(parser, ".it")));
+    new_localvar(parser, parser_newstr(parser, ".is"));
+    be_assert(v->v.idx == base);
 }
 
 static void for_iter(bparser *parser, bstring *var, bexpdesc *it)
@@ -1222,10 +1397,10 @@ static void for_iter(bparser *parser, bstring *var, bexpdesc *it)
     bfuncinfo *finfo = parser->finfo;
     /* reset the jump head PC of the for loop body */
     finfo->binfo->beginpc = finfo->pc;
-    /* itvar = .it() */
+    /* itvar = next item of .it, leave the loop when done */
     init_exp(&e, ETLOCAL, new_localvar(parser, var)); /* new itvar */
-    be_code_setvar(finfo, &e, it); /* code function to variable '.it' */
-    be_code_call(finfo, e.v.idx, 0); /* itvar <- call .it() */
+    be_assert(e.v.idx == it->v.idx + 2); /* next to the iteration state */
+    be_code_forloop(finfo, it->v.idx, &finfo->binfo->breaklist);
     stmtlist(parser);
 }
 
@@ -1237,8 +1412,8 @@ static void for_leave(bparser *parser, int jcatch, int beginpc)
     init_exp(&e, ETSTRING, 0);
     e.v.s = parser_newstr(parser, "stop_iteration");
     end_block_ex(parser, beginpc); /* leave except & loop block */
+    be_code_tryrange(finfo, jcatch);
     if (jbrk != NO_JUMP) { /* has `break` statement in iteration block */
-        be_code_exblk(finfo, 1);
         jbrk = be_code_jump(finfo);
     }
     be_code_conjump(finfo, &jcatch, finfo->pc);
@@ -1257,7 +1432,8 @@ static void for_leave(bparser *parser, int jcatch, int beginpc)
  *     end
  * except ('stop_iteration')
  * end
- * */
+ * The FORPREP and FORLOOP instructions iterate integer ranges, lists
+ * and maps natively and only call `.it()` for other iterables. */
 static void for_stmt(bparser *parser)
 {
     bstring *var;
@@ -1270,7 +1446,7 @@ static void for_stmt(bparser *parser)
     var = for_itvar(parser);
     match_token(parser, OptColon); /* skip ':' */
     for_init(parser, &iter);
-    jcatch = be_code_exblk(parser->finfo, 0);
+    jcatch = be_code_exblk(parser->finfo);
     for_iter(parser, var, &iter);
     for_leave(parser, jcatch, beginpc);
     match_token(parser, KeyEnd); /* skip 'end' */
@@ -1278,19 +1454,12 @@ static void for_stmt(bparser *parser)
 
 static bblockinfo* break_block(bparser *parser)
 {
-    int try_depth = 0; /* count of exception catch blocks */
     bblockinfo *binfo = parser->finfo->binfo;
     /* BREAK | CONTINUE */
     scan_next_token(parser); /* skip 'break' or 'continue' */
     while (binfo && !(binfo->type & BLOCK_LOOP)) {
-        if (binfo->type & BLOCK_EXCEPT) {
-            ++try_depth; /* leave the exception catch block */
-        }
         binfo = binfo->prev;
     }
-    if (binfo && try_depth) { /* exception catch blocks that needs to leave */
-        be_code_exblk(parser->finfo, try_depth);
-    }
     return binfo;
 }
 
@@ -1361,6 +1530,9 @@ static void def_stmt(bparser *parser)
     scan_next_token(parser); /* skip 'def' */
     proto = funcbody(parser, func_name(parser, &e, 0), 0);
     be_code_closure(finfo, &e, be_code_proto(finfo, proto));
+    if (e.type == ETLOCAL && comp_is_optimize(parser->vm)) {
+        be_code_localfn(finfo, e.v.idx, proto); /* its calls may be inlined */
+    }
     be_stackpop(parser->vm, 1);
 }
 
@@ -1501,14 +1673,20 @@ static void class_stmt(bparser *parser)
     /* 'class' ID [':' ID] class_block 'end' */
     scan_next_token(parser); /* skip 'class' */
     if (match_id(parser, name) != NULL) {
+        bvm *vm = parser->vm;
         bexpdesc e;
-        bclass *c = be_newclass(parser->vm, name, NULL);
+        bclassinfo cinfo;
+        bclass *c = be_newclass(vm, name, NULL);
         new_var(parser, name, &e);
         be_code_class(parser->finfo, &e, c);
+        cinfo.prev = parser->cinfo;
+        cinfo.c = c;
+        parser->cinfo = &cinfo;
         class_inherit(parser, &e);
         class_block(parser, c, &e);
-        be_class_compress(parser->vm, c); /* compress class size */
+        be_class_compress(vm, c); /* compress class size */
         match_token(parser, KeyEnd); /* skip 'end' */
+        parser->cinfo = cinfo.prev;
     } else {
         parser_error(parser, "class name error");
     }
@@ -1551,6 +1729,7 @@ static void var_field(bparser *parser)
     /* ID ['=' expr] */
     bexpdesc e1, e2;
     bstring *name;
+    bproto *proto = NULL;
     name = next_token(parser).u.s;
     match_token(parser, TokenId); /* match and skip ID */
     if (match_skip(parser, OptAssign)) { /* '=' */
@@ -1559,8 +1738,14 @@ static void var_field(bparser *parser)
     } else {
         init_exp(&e2, ETNIL, 0);
     }
+    if (e2.type == ETPROTO) { /* `var f = def ... end` or `var f = /x -> ...` */
+        proto = parser->finfo->proto->ptab[e2.v.idx];
+    }
     new_var(parser, name, &e1); /* new variable */
     be_code_setvar(parser->finfo, &e1, &e2);
+    if (proto && e1.type == ETLOCAL && comp_is_optimize(parser->vm)) {
+        be_code_localfn(parser->finfo, e1.v.idx, proto); /* its calls may be inlined */
+    }
 }
 
 static void var_stmt(bparser *parser)
@@ -1644,9 +1829,9 @@ static void try_stmt(bparser *parser)
     int jcatch, jbrk;
     /* 'try' block 'except' except_stmt block 'end' */
     scan_next_token(parser); /* skip 'try' */
-    jcatch = be_code_exblk(parser->finfo, 0);
+    jcatch = be_code_exblk(parser->finfo);
     block(parser, BLOCK_EXCEPT);
-    be_code_exblk(parser->finfo, 1);
+    be_code_tryrange(parser->finfo, jcatch);
     jbrk = be_code_jump(parser->finfo);
     except_block(parser, &jcatch, &jbrk);
     while (next_type(parser) == KeyExcept) {
@@ -1718,8 +1903,10 @@ static void mainfunc(bparser *parser, bclosure *cl)
     begin_func(parser, &finfo, &binfo);
     finfo.proto->argc = 0; /* args */
     finfo.proto->name = be_newstr(parser->vm, funcname(parser));
+    be_gc_barrier(parser->vm, finfo.proto);
     cl->proto = finfo.proto;
-    be_remove(parser->vm, -3);  /* pop proto from stack */
+    be_gc_barrier(parser->vm, cl);
+    be_remove(parser->vm, -5);  /* pop proto from stack */
     stmtlist(parser);
     end_func(parser);
     match_token(parser, TokenEOS); /* skip EOS */
@@ -1732,6 +1919,7 @@ bclosure* be_parser_source(bvm *vm,
     bclosure *cl = be_newclosure(vm, 0);
     parser.vm = vm;
     parser.finfo = NULL;
+    parser.cinfo = NULL;
     parser.cl = cl;
     parser.islocal = (bbyte)islocal;
     var_setclosure(vm->top, cl);
@@ -1746,4 +1934,86 @@ bclosure* be_parser_source(bvm *vm,
     return cl;
 }
 
+static const char* lazy_reader(void *data, size_t *size)
+{
+    bstring **s = data;
+    if (*s) {
+        const char *text = str(*s);
+        *size = str_len(*s);
+        *s = NULL;
+        return text;
+    }
+    *size = 0;
+    return NULL;
+}
+
+#define swap_field(a, b, f)     do { \
+    void *_t = (void*)(a)->f; (a)->f = (b)->f; (b)->f = _t; } while (0)
+#define swap_count(a, b, f)     do { \
+    int _n = (a)->f; (a)->f = (b)->f; (b)->f = _n; } while (0)
+
+/* Compile the body of a function recorded by lazy_body(), the code and
+ * tables are exchanged with the stub so the closures of `proto` run the
+ * compiled body and the stub tables are freed with the temporary proto */
+void be_parser_lazy(bvm *vm, bproto *proto)
+{
+    bparser parser;
+    bfuncinfo finfo;
+    bblockinfo binfo;
+    bvalue *k = proto->ktab; /* constants of the stub */
+    bstring *text = var_tostr(k);
+    bproto *p;
+    int i;
+    parser.vm = vm;
+    parser.finfo = NULL;
+    parser.cinfo = NULL;
+    parser.cl = NULL;
+    parser.islocal = btrue; /* new variables are local as in any nested function */
+    be_lexer_init(&parser.lexer, vm, str(proto->source), lazy_reader, &text);
+    parser.lexer.linenumber = parser.lexer.lastline = (int)var_toint(k + 1);
+    scan_next_token(&parser); /* scan first token */
+    begin_func(&parser, &finfo, &binfo);
+    p = finfo.proto;
+    p->name = proto->name;
+    p->source = proto->source;
+    p->varg = proto->varg & ~BE_VA_LAZY;
+    finfo.cls = proto->cls;
+    for (i = 0; i < proto->argc; ++i) { /* arguments */
+        new_localvar(&parser, var_tostr(k + 2 + i));
+    }
+    for (i = 0; i < proto->nupvals; ++i) { /* same upvalues as the stub */
+        bupvaldesc *uv = proto->upvals + i;
+        bvalue *desc = be_map_insertstr(vm, finfo.upval, var_tostr(k + 2 + proto->argc + i), NULL);
+        var_setint(desc, upval_desc(i, uv->idx, uv->instack));
+    }
+    p->argc = proto->argc;
+    stmtlist(&parser);
+    end_func(&parser);
+    match_token(&parser, KeyEnd); /* skip 'end' */
+    be_assert(p->nupvals == proto->nupvals);
+    swap_field(proto, p, code);
+    swap_count(proto, p, codesize);
+    swap_field(proto, p, ktab);
+    swap_count(proto, p, nconst);
+    swap_field(proto, p, ptab);
+    swap_count(proto, p, nproto);
+    swap_field(proto, p, upvals);
+    swap_field(proto, p, tryranges);
+    swap_count(proto, p, ntryranges);
+#if BE_DEBUG_RUNTIME_INFO
+    swap_field(proto, p, lineinfo);
+    swap_count(proto, p, nlineinfo);
+#endif
+#if BE_DEBUG_VAR_INFO
+    swap_field(proto, p, varinfo);
+    swap_count(proto, p, nvarinfo);
+#endif
+    proto->nstack = p->nstack;
+    proto->varg = p->varg;
+    be_gc_barrier(vm, proto);
+    be_lexer_deinit(&parser.lexer);
+    be_global_release_space(vm);
+    be_stackpop(vm, 2); /* pop the temporary proto and strtab */
+}
+
 #endif
@@ -65,9 +65,12 @@ typedef struct bfuncinfo {
     struct blexer *lexer; /* the lexer pointer */
     blist *local; /* local variable */
     bmap *upval; /* upvalue variable */
+    bmap *kmap; /* index of the constants table, value -> index */
+    bmap *localfn; /* local variables holding a known function, register -> proto */
     bvector code; /* code vector */
     bvector kvec; /* constants table */
     bvector pvec; /* proto table */
+    bvector tryvec; /* `try` block ranges */
 #if BE_DEBUG_RUNTIME_INFO /* debug information */
     bvector linevec;
 #endif
@@ -77,6 +80,7 @@ typedef struct bfuncinfo {
     int pc; /* program count */
     bbyte freereg; /* first free register */
     bbyte flags; /* some flages */
+    bclass *cls; /* class of a method, NULL for other functions */
 } bfuncinfo;
 
 /* code block type definitions */
@@ -85,5 +89,6 @@ typedef struct bfuncinfo {
 
 bclosure *be_parser_source(bvm *vm,
     const char *fname, breader reader, void *data, bbool islocal);
+void be_parser_lazy(bvm *vm, bproto *proto);
 
 #endif
@@ -73,7 +73,7 @@ static int iter_closure(bvm *vm)
     if (lower > upper) {
         be_stop_iteration(vm);
     }
-    var_toint(uv0) = lower + 1; /* set upvale[0] */
+    var_setint(uv0, lower + 1); /* set upvale[0] */
     be_pushint(vm, lower); /* push the return value */
     be_return(vm);
 }
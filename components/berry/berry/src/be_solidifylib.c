@@ -15,6 +15,7 @@
 #include "be_map.h"
 #include "be_vm.h"
 #include "be_decoder.h"
+#include "be_parser.h"
 #include "be_sys.h"
 #include <string.h>
 #include <stdio.h>
@@ -112,16 +113,16 @@ static void m_solidify_map(bvm *vm, bbool str_literal, bmap * map, const char *c
     logfmt("    ( (struct bmapnode*) &(const bmapnode[]) {\n");
     for (int i = 0; i < map->size; i++) {
         bmapnode * node = &map->slots[i];
-        if (node->key.type == BE_NIL) {
+        if (var_isnil(&node->key)) {
             continue;   /* key not used */
         }
         int key_next = node->key.next;
         if (0xFFFFFF == key_next) {
             key_next = -1;      /* more readable */
         }
-        if (node->key.type == BE_STRING) {
+        if (var_isstr(&node->key)) {
             /* convert the string literal to identifier */
-            const char * key = str(node->key.v.s);
+            const char * key = str(var_tostr(&node->key));
             size_t id_len = toidentifier_length(key);
             char id_buf[id_len];
             toidentifier(id_buf, key);
@@ -130,17 +131,17 @@ static void m_solidify_map(bvm *vm, bbool str_literal, bmap * map, const char *c
             } else {
                 logfmt("        { be_const_key_weak(%s, %i), ", id_buf, key_next);
             }
-            m_solidify_bvalue(vm, str_literal, &node->value, class_name, str(node->key.v.s), fout);
-        } else if (node->key.type == BE_INT) {
+            m_solidify_bvalue(vm, str_literal, &node->value, class_name, str(var_tostr(&node->key)), fout);
+        } else if (var_isint(&node->key)) {
 #if BE_INTGER_TYPE == 2
-            logfmt("        { be_const_key_int(%lli, %i), ", node->key.v.i, key_next);
+            logfmt("        { be_const_key_int(%lli, %i), ", var_toint(&node->key), key_next);
 #else
-            logfmt("        { be_const_key_int(%li, %i), ", node->key.v.i, key_next);
+            logfmt("        { be_const_key_int(%li, %i), ", (long)var_toint(&node->key), key_next);
 #endif
             m_solidify_bvalue(vm, str_literal, &node->value, class_name, NULL, fout);
         } else {
             char error[64];
-            snprintf(error, sizeof(error), "Unsupported type in key: %i", node->key.type);
+            snprintf(error, sizeof(error), "Unsupported type in key: %i", var_type(&node->key));
             be_raise(vm, "internal_error", error);
         }
 
@@ -154,7 +155,7 @@ static void m_solidify_list(bvm *vm, bbool str_literal, blist * list, const char
 {
     logfmt("    be_nested_list(%i,\n", list->count);
 
-    logfmt("    ( (struct bvalue*) &(const bvalue[]) {\n");
+    logfmt("    ( (bvalue*) &(const bvalue[]) {\n");
     for (int i = 0; i < list->count; i++) {
         logfmt("        ");
         m_solidify_bvalue(vm, str_literal, &list->data[i], class_name, "", fout);
@@ -178,21 +179,25 @@ static void m_solidify_bvalue(bvm *vm, bbool str_literal, bvalue * value, const
 #if BE_INTGER_TYPE == 2
         logfmt("be_const_int(%lli)", var_toint(value));
 #else
-        logfmt("be_const_int(%li)", var_toint(value));
+        logfmt("be_const_int(%li)", (long)var_toint(value));
 #endif
         break;
     case BE_INDEX:
 #if BE_INTGER_TYPE == 2
         logfmt("be_const_var(%lli)", var_toint(value));
 #else
-        logfmt("be_const_var(%li)", var_toint(value));
+        logfmt("be_const_var(%li)", (long)var_toint(value));
 #endif
         break;
     case BE_REAL:
 #if BE_USE_SINGLE_FLOAT
         logfmt("be_const_real_hex(%08" PRIX32 ")", (uint32_t)(uintptr_t)var_toobj(value));
 #else
-        logfmt("be_const_real_hex(0x%016" PRIx64 ")", (uint64_t)var_toobj(value));
+        {
+            union { breal r; uint64_t i; } u;
+            u.r = var_toreal(value);
+            logfmt("be_const_real_hex(0x%016" PRIx64 ")", u.i);
+        }
 #endif
         break;
     case BE_STRING:
@@ -235,6 +240,10 @@ static void m_solidify_bvalue(bvm *vm, bbool str_literal, bvalue * value, const
             var_isstatic(value) ? "static_" : "",
             classname ? classname : "unknown", key ? key : "unknown");
         break;
+    case BE_LEAF_FUNC:
+        logfmt("be_const_leaf_func(be_ntv_%s_%s)",
+            classname ? classname : "unknown", key ? key : "unknown");
+        break;
     case BE_INSTANCE:
     {
         binstance * ins = (binstance *) var_toobj(value);
@@ -290,12 +299,36 @@ static void m_solidify_proto_inner_class(bvm *vm, bbool str_literal, bproto *pr,
 }
 
 
-static void m_solidify_proto(bvm *vm, bbool str_literal, bproto *pr, const char * func_name, int indent, void* fout)
+/* true if `pr` is a method of `owner` accessing the variables of `self`
+ * by slot (GETSMBR or SETSMBR), its proto must then refer to the class */
+static bbool uses_self_slots(bproto *pr, bclass *owner)
+{
+    if (owner && pr->cls == owner) {
+        for (int pc = 0; pc < pr->codesize; pc++) {
+            bopcode op = IGET_OP(pr->code[pc]);
+            if (op == OP_GETSMBR || op == OP_SETSMBR) {
+                return btrue;
+            }
+        }
+    }
+    return bfalse;
+}
+
+static void m_solidify_proto(bvm *vm, bbool str_literal, bproto *pr, const char * func_name, bclass *owner, int indent, void* fout)
 {
     // const char * func_name = str(pr->name);
     // const char * func_source = str(pr->source);
+    bbool has_cls;
+#if BE_USE_SCRIPT_COMPILER
+    if (pr->varg & BE_VA_LAZY) { /* solidify the compiled body */
+        be_parser_lazy(vm, pr);
+    }
+#endif
+    has_cls = uses_self_slots(pr, owner);
 
-    logfmt("%*sbe_nested_proto(\n", indent, "");
+    /* protos with `try` blocks carry their range table in an extra argument,
+     * methods using the slots of `self` also carry their class */
+    logfmt("%*sbe_nested_proto%s(\n", indent, "", has_cls ? "_ex" : pr->ntryranges ? "_try" : "");
     indent += 2;
 
     logfmt("%*s%d,                          /* nstack */\n", indent, "", pr->nstack);
@@ -320,7 +353,7 @@ static void m_solidify_proto(bvm *vm, bbool str_literal, bproto *pr, const char
             size_t sub_len = strlen(func_name) + 10;
             char sub_name[sub_len];
             snprintf(sub_name, sizeof(sub_name), "%s_%d", func_name, i);
-            m_solidify_proto(vm, str_literal, pr->ptab[i], sub_name, indent+2, fout);
+            m_solidify_proto(vm, str_literal, pr->ptab[i], sub_name, NULL, indent+2, fout);
             logfmt(",\n");
         }
         logfmt("%*s}),\n", indent, "");
@@ -356,7 +389,7 @@ static void m_solidify_proto(bvm *vm, bbool str_literal, bproto *pr, const char
 
     logfmt("%*s( &(const binstruction[%2d]) {  /* code */\n", indent, "", pr->codesize);
     for (int pc = 0; pc < pr->codesize; pc++) {
-        uint32_t ins = pr->code[pc];
+        uint32_t ins = be_vm_unquicken(pr->code[pc]);
         logfmt("%*s  0x%08X,  //", indent, "", ins);
         be_print_inst(ins, pc, fout);
         bopcode op = IGET_OP(ins);
@@ -370,13 +403,32 @@ static void m_solidify_proto(bvm *vm, bbool str_literal, bproto *pr, const char
             }
         }
     }
-    logfmt("%*s})\n", indent, "");
+    if (pr->ntryranges > 0) {
+        logfmt("%*s}),\n", indent, "");
+        if (has_cls) {
+            logfmt("%*s1,                          /* has try blocks */\n", indent, "");
+        }
+        logfmt("%*s( &(const btryrange[%2d]) {  /* try blocks */\n", indent, "", pr->ntryranges);
+        for (int i = 0; i < pr->ntryranges; i++) {
+            logfmt("%*s  { %d, %d },\n", indent, "", pr->tryranges[i].beginpc, pr->tryranges[i].endpc);
+        }
+    }
+    if (has_cls) {
+        logfmt("%*s}),\n", indent, "");
+        if (pr->ntryranges == 0) {
+            logfmt("%*s0,                          /* has try blocks */\n", indent, "");
+            logfmt("%*sNULL,                       /* no try blocks */\n", indent, "");
+        }
+        logfmt("%*s&be_class_%s\n", indent, "", str(owner->name));
+    } else {
+        logfmt("%*s})\n", indent, "");
+    }
     indent -= 2;
     logfmt("%*s)", indent, "");
 
 }
 
-static void m_solidify_closure(bvm *vm, bbool str_literal, bclosure *cl, const char * classname, void* fout)
+static void m_solidify_closure(bvm *vm, bbool str_literal, bclosure *cl, const char * classname, bclass *owner, void* fout)
 {   
     bproto *pr = cl->proto;
     const char * func_name = str(pr->name);
@@ -388,12 +440,20 @@ static void m_solidify_closure(bvm *vm, bbool str_literal, bclosure *cl, const c
 
     int indent = 2;
 
+#if BE_USE_SCRIPT_COMPILER
+    if (pr->varg & BE_VA_LAZY) { /* the body may contain inner classes */
+        be_parser_lazy(vm, pr);
+    }
+#endif
     m_solidify_proto_inner_class(vm, str_literal, pr, fout);
 
     logfmt("\n");
     logfmt("/********************************************************************\n");
     logfmt("** Solidified function: %s\n", func_name);
     logfmt("********************************************************************/\n");
+    if (uses_self_slots(pr, owner)) {
+        logfmt("extern const bclass be_class_%s;\n", str(owner->name));
+    }
 
     {
         size_t id_len = toidentifier_length(func_name);
@@ -404,7 +464,7 @@ static void m_solidify_closure(bvm *vm, bbool str_literal, bclosure *cl, const c
             func_name_id);
     }
 
-    m_solidify_proto(vm, str_literal, pr, func_name, indent, fout);
+    m_solidify_proto(vm, str_literal, pr, func_name, owner, indent, fout);
     logfmt("\n");
 
     // closure
@@ -423,7 +483,7 @@ static void m_solidify_subclass(bvm *vm, bbool str_literal, bclass *cl, void* fo
         while ((node = be_map_next(cl->members, &iter)) != NULL) {
             if (var_isstr(&node->key) && var_isclosure(&node->value)) {
                 bclosure *f = var_toobj(&node->value);
-                m_solidify_closure(vm, str_literal, f, class_name, fout);
+                m_solidify_closure(vm, str_literal, f, class_name, cl, fout);
             }
         }
     }
@@ -490,7 +550,7 @@ static void m_solidify_module(bvm *vm, bbool str_literal, bmodule *ml, void* fou
         while ((node = be_map_next(ml->table, &iter)) != NULL) {
             if (var_isstr(&node->key) && var_isclosure(&node->value)) {
                 bclosure *f = var_toobj(&node->value);
-                m_solidify_closure(vm, str_literal, f, module_name, fout);
+                m_solidify_closure(vm, str_literal, f, module_name, NULL, fout);
             }
             if (var_isstr(&node->key) && var_isclass(&node->value)) {
                 bclass *cl = var_toobj(&node->value);
@@ -538,7 +598,7 @@ static int m_dump(bvm *vm)
             be_pop(vm, 1);
         }
         if (var_isclosure(v)) {
-            m_solidify_closure(vm, str_literal, var_toobj(v), NULL, fout);
+            m_solidify_closure(vm, str_literal, var_toobj(v), NULL, NULL, fout);
         } else if (var_isclass(v)) {
             m_solidify_class(vm, str_literal, var_toobj(v), fout);
         } else if (var_ismodule(v)) {
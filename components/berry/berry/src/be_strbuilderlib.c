@@ -0,0 +1,108 @@
+/********************************************************************
+** Copyright (c) 2018-2020 Guan Wenliang
+** This file is part of the Berry default interpreter.
+** skiars@qq.com, https://github.com/Skiars/berry
+** See Copyright Notice in the LICENSE file or at
+** https://github.com/Skiars/berry/blob/master/LICENSE
+********************************************************************/
+#include "be_object.h"
+#include "be_string.h"
+#include "be_strlib.h"
+
+/* `strbuilder` accumulates text without creating a new string for each
+ * piece: the characters are kept in the string `.p`, which is only
+ * referenced by the builder, so be_strappend() can extend it in place. */
+
+/* append the string values of the arguments from `index`, `.p` must be at top */
+static void append_args(bvm *vm, int index, int argc)
+{
+    int buf = be_top(vm);
+    for (; index <= argc; ++index) {
+        bstring *s, *res;
+        be_tostring(vm, index);
+        s = var_tostr(be_indexof(vm, index));
+        res = be_strappend(vm, var_tostr(be_indexof(vm, buf)), str(s), str_len(s));
+        var_setstr(be_indexof(vm, buf), res);
+    }
+}
+
+static int m_init(bvm *vm)
+{
+    int argc = be_top(vm);
+    be_pushstring(vm, "");
+    append_args(vm, 2, argc);
+    be_setmember(vm, 1, ".p");
+    be_return_nil(vm);
+}
+
+static int m_append(bvm *vm)
+{
+    int argc = be_top(vm);
+    be_getmember(vm, 1, ".p");
+    if (be_isstring(vm, -1)) {
+        append_args(vm, 2, argc);
+        be_setmember(vm, 1, ".p");
+    }
+    be_pushvalue(vm, 1);
+    be_return(vm); /* return self */
+}
+
+static int m_tostring(bvm *vm)
+{
+    be_getmember(vm, 1, ".p");
+    if (be_isstring(vm, -1)) { /* the buffer is never returned, it may still change */
+        bstring *s = var_tostr(be_indexof(vm, -1));
+        be_pushnstring(vm, str(s), str_len(s));
+        be_return(vm);
+    }
+    be_pushstring(vm, "");
+    be_return(vm);
+}
+
+static int m_size(bvm *vm)
+{
+    be_getmember(vm, 1, ".p");
+    if (be_isstring(vm, -1)) {
+        be_pushint(vm, be_strlen(vm, -1));
+        be_return(vm);
+    }
+    be_pushint(vm, 0);
+    be_return(vm);
+}
+
+static int m_clear(bvm *vm)
+{
+    be_pushstring(vm, "");
+    be_setmember(vm, 1, ".p");
+    be_return_nil(vm);
+}
+
+#if !BE_USE_PRECOMPILED_OBJECT
+void be_load_strbuilderlib(bvm *vm)
+{
+    static const bnfuncinfo members[] = {
+        { ".p", NULL },
+        { "init", m_init },
+        { "append", m_append },
+        { "..", m_append },
+        { "tostring", m_tostring },
+        { "size", m_size },
+        { "clear", m_clear },
+        { NULL, NULL }
+    };
+    be_regclass(vm, "strbuilder", members);
+}
+#else
+/* @const_object_info_begin
+class be_class_strbuilder (scope: global, name: strbuilder) {
+    .p, var
+    init, func(m_init)
+    append, func(m_append)
+    .., func(m_append)
+    tostring, func(m_tostring)
+    size, leaf_func(m_size)
+    clear, func(m_clear)
+}
+@const_object_info_end */
+#include "../generate/be_fixed_be_class_strbuilder.h"
+#endif
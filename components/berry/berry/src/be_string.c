@@ -9,6 +9,8 @@
 #include "be_vm.h"
 #include "be_mem.h"
 #include "be_constobj.h"
+#include "be_var.h"
+#include "be_vector.h"
 #include <string.h>
 
 #define next(_s)    cast(void*, cast(bstring*, (_s)->next))
@@ -146,10 +148,10 @@ void be_string_deleteall(bvm *vm)
     be_free(vm, tab->table, tab->size * sizeof(bstring*));
 }
 
-static bstring* createstrobj(bvm *vm, size_t len, int islong)
+static bstring* createstrobj(bvm *vm, size_t len, size_t cap, int islong)
 {
     size_t size = (islong ? sizeof(blstring)
-                : sizeof(bsstring)) + len + 1;
+                : sizeof(bsstring)) + cap + 1;
     bgcobject *gco = be_gc_newstr(vm, size, islong);
     bstring *s = cast_str(gco);
     if (s) {
@@ -184,11 +186,17 @@ static bstring* newshortstr(bvm *vm, const char *str, size_t len)
 
     for (s = *list; s != NULL; s = next(s)) {
         if (len == s->slen && !strncmp(str, sstr(s), len)) {
+            if (vm->gc.state > GC_SATOMIC && gc_iswhite(s)) {
+                gc_setmark(s, GC_DARK); /* unreachable but not swept yet */
+            }
             return s;
         }
     }
-    s = createstrobj(vm, len, 0);
+    s = createstrobj(vm, len, len, 0);
     if (s) {
+        /* the allocation may run the GC, which can resize the table */
+        size = vm->strtab.size;
+        list = vm->strtab.table + (hash & (size - 1));
         memcpy(cast(char *, sstr(s)), str, len);
         s->extra = 0;
         s->next = cast(void*, *list);
@@ -197,27 +205,66 @@ static bstring* newshortstr(bvm *vm, const char *str, size_t len)
 #endif
         *list = s;
         vm->strtab.count++;
-        if (vm->strtab.count > size << 2) {
+        /* the strings created during a major cycle are swept by this cycle */
+        if (vm->gc.promoteage && (vm->gc.state == GC_SPAUSE || vm->gc.state == GC_SMINOR)) {
+            be_vector_push(vm, &vm->gc.youngstr, &s);
+        }
+        if (vm->strtab.count > size << 2 && vm->gc.state != GC_SSWEEPSTR) {
             resize(vm, size << 1);
         }
     }
     return s;
 }
 
-bstring* be_newlongstr(bvm *vm, const char *str, size_t len)
+static bstring* newlongstr(bvm *vm, const char *str, size_t len, size_t cap)
 {
     bstring *s;
     blstring *ls;
-    s = createstrobj(vm, len, 1);
+    s = createstrobj(vm, len, cap, 1);
     ls = cast(blstring*, s);
     s->extra = 0;
     ls->llen = cast_int(len);
+    ls->lcap = cast_int(cap);
     if (str) { /* if the argument 'str' is NULL, we just allocate space */
         memcpy(cast(char *, lstr(s)), str, len);
     }
     return s;
 }
 
+bstring* be_newlongstr(bvm *vm, const char *str, size_t len)
+{
+    return newlongstr(vm, str, len, len);
+}
+
+/* Append `len` characters of `str` to `s` and return the resulting string.
+ * `s` must not be visible to anything else than the caller (e.g. the
+ * temporary result of a `..` chain): a long string with enough spare room
+ * is extended in place, otherwise a new string is created with room to grow.
+ * `str` must be kept reachable by the caller, a GC may run. */
+bstring* be_strappend(bvm *vm, bstring *s, const char *str, size_t len)
+{
+    size_t slen = str_len(s), total = slen + len;
+    if (total <= SHORT_STR_MAX_LEN) {
+        char buf[SHORT_STR_MAX_LEN + 1];
+        memcpy(buf, be_str2cstr(s), slen);
+        memcpy(buf + slen, str, len);
+        return be_newstrn(vm, buf, total);
+    }
+    if (s->slen == 255 && !gc_isconst(s) && total <= (size_t)cast(blstring*, s)->lcap) {
+        char *p = lstr(s);
+        memcpy(p + slen, str, len);
+        p[total] = '\0';
+        cast(blstring*, s)->llen = cast_int(total);
+        return s;
+    } else {
+        bstring *ns = newlongstr(vm, NULL, total, total + (total >> 1));
+        char *p = lstr(ns);
+        memcpy(p, be_str2cstr(s), slen);
+        memcpy(p + slen, str, len);
+        return ns;
+    }
+}
+
 bstring* be_newstr(bvm *vm, const char *str)
 {
     return be_newstrn(vm, str, strlen(str));
@@ -236,16 +283,20 @@ bstring *be_newstrn(bvm *vm, const char *str, size_t len)
     return be_newlongstr(vm, str, len); /* long string */
 }
 
-void be_gcstrtab(bvm *vm)
+/* free the unreachable strings of the lists [start, start + count) of the
+ * string table, returns the next list to sweep or 0 when the whole table
+ * is swept */
+int be_gcstrtab(bvm *vm, int start, int count)
 {
     struct bstringtable *tab = &vm->strtab;
-    int size = tab->size, i;
-    for (i = 0; i < size; ++i) {
+    int size = tab->size, i, end = count < size - start ? start + count : size;
+    for (i = start; i < end; ++i) {
         bstring **list = tab->table + i;
         bstring *prev = NULL, *node, *next;
         for (node = *list; node; node = next) {
             next = next(node);
             if (!gc_isfixed(node) && gc_iswhite(node)) {
+                be_global_cache_forget(vm, node);
                 free_sstring(vm, node);
                 tab->count--;
                 if (prev) { /* link list */
@@ -255,13 +306,53 @@ void be_gcstrtab(bvm *vm)
                 }
             } else {
                 prev = node;
-                gc_setwhite(node);
+                be_gc_survive(vm, gc_object(node));
             }
         }
     }
+    if (end < size) {
+        return end;
+    }
     if (tab->count < size >> 2 && size > 8) {
         resize(vm, size >> 1);
     }
+    return 0;
+}
+
+/* free the unreachable young short strings, which are not in the GC-object
+ * list, so a minor collection does not walk the whole string table */
+void be_gcyoungstr(bvm *vm)
+{
+    struct bstringtable *tab = &vm->strtab;
+    bvector *young = &vm->gc.youngstr;
+    bstring **s = be_vector_data(young), **keep = s;
+    bstring **end = s + be_vector_count(young);
+    for (; s < end; ++s) {
+        if (!gc_isfixed(*s) && gc_iswhite(*s)) {
+            bstring **list = tab->table + (be_strhash(*s) & (tab->size - 1));
+            bstring *prev = NULL, *node = *list;
+            for (; node != *s; node = next(node)) {
+                prev = node;
+            }
+            if (prev) { /* link list */
+                prev->next = cast(void*, next(node));
+            } else {
+                *list = next(node);
+            }
+            be_global_cache_forget(vm, *s);
+            free_sstring(vm, *s);
+            tab->count--;
+        } else {
+            be_gc_survive(vm, gc_object(*s));
+            if (!gc_isold(*s)) {
+                *keep++ = *s;
+            }
+        }
+    }
+    be_vector_resize(vm, young, cast_int(keep - (bstring**)be_vector_data(young)));
+    if (tab->count < tab->size >> 2 && tab->size > 8) {
+        resize(vm, tab->size >> 1);
+    }
 }
 
 uint32_t be_strhash(const bstring *s)
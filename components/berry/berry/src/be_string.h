@@ -23,6 +23,7 @@ typedef struct {
 typedef struct {
     bstring str;
     int llen;
+    int lcap; /* room allocated for characters, at least `llen` */
     /* char s[]; */
 } blstring;
 
@@ -49,7 +50,9 @@ int be_eqstr(bstring *s1, bstring *s2);
 bstring* be_newstr(bvm *vm, const char *str);
 bstring* be_newstrn(bvm *vm, const char *str, size_t len);
 bstring* be_newlongstr(bvm *vm, const char *str, size_t len);
-void be_gcstrtab(bvm *vm);
+bstring* be_strappend(bvm *vm, bstring *s, const char *str, size_t len);
+int be_gcstrtab(bvm *vm, int start, int count);
+void be_gcyoungstr(bvm *vm);
 uint32_t be_strhash(const bstring *s);
 const char* be_str2cstr(const bstring *s);
 void be_str_setextra(bstring *s, int extra);
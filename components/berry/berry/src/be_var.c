@@ -17,6 +17,21 @@
 #define global(vm)      ((vm)->gbldesc.global)
 #define builtin(vm)     ((vm)->gbldesc.builtin)
 
+#if BE_GLOBAL_CACHE_SIZE
+/* Short strings are interned, so a name has a single address and the
+ * cache is keyed by the string pointer. Global slots are never removed,
+ * an entry only becomes stale when a new global shadows a built-in of
+ * the same name or when the name string is freed. */
+#define cache_slot(vm, s) \
+    (&(vm)->gbldesc.cache[((size_t)(s) >> 3 ^ (size_t)(s) >> 9) & (BE_GLOBAL_CACHE_SIZE - 1)])
+
+static void cache_set(bvm *vm, bstring *name, int idx)
+{
+    cache_slot(vm, name)->name = name;
+    cache_slot(vm, name)->idx = idx;
+}
+#endif
+
 extern BERRY_LOCAL bclass_array be_class_table;
 
 void be_globalvar_init(bvm *vm)
@@ -74,13 +89,24 @@ static int global_find(bvm *vm, bstring *name)
 
 int be_global_find(bvm *vm, bstring *name)
 {
-    int res = global_find(vm, name);
+    int res;
+#if BE_GLOBAL_CACHE_SIZE
+    if (cache_slot(vm, name)->name == name) {
+        return cache_slot(vm, name)->idx;
+    }
+#endif
+    res = global_find(vm, name);
     if (res < 0) {
         res = be_builtin_find(vm, name);
     }
     if (res < 0) {
         res = global_native_class_find(vm, name);
     }
+#if BE_GLOBAL_CACHE_SIZE
+    if (res >= 0) {
+        cache_set(vm, name, res);
+    }
+#endif
     return res;
 }
 
@@ -96,7 +122,15 @@ static int global_new_anonymous(bvm *vm)
 
 int be_global_new(bvm *vm, bstring *name)
 {
-    int idx = global_find(vm, name);
+    int idx;
+#if BE_GLOBAL_CACHE_SIZE
+    /* a cached built-in index does not count, it must be shadowed */
+    if (cache_slot(vm, name)->name == name &&
+        cache_slot(vm, name)->idx >= be_builtin_count(vm)) {
+        return cache_slot(vm, name)->idx;
+    }
+#endif
+    idx = global_find(vm, name);
     if (idx == -1) {
         bvalue *desc;
         idx = global_new_anonymous(vm);
@@ -104,9 +138,24 @@ int be_global_new(bvm *vm, bstring *name)
         var_setint(desc, idx);
         idx += be_builtin_count(vm);
     }
+#if BE_GLOBAL_CACHE_SIZE
+    cache_set(vm, name, idx);
+#endif
     return idx;
 }
 
+/* drop the cached index of a string that is about to be freed */
+void be_global_cache_forget(bvm *vm, bstring *name)
+{
+#if BE_GLOBAL_CACHE_SIZE
+    if (cache_slot(vm, name)->name == name) {
+        cache_slot(vm, name)->name = NULL;
+    }
+#else
+    (void)vm; (void)name;
+#endif
+}
+
 bvalue* be_global_var(bvm *vm, int index)
 {
     int bcnt = be_builtin_count(vm);
@@ -137,8 +186,8 @@ bstring* be_builtin_name(bvm *vm, int index)
     bmap *map = builtin(vm).vtab;
     bmapnode *end, *node = map->slots;
     for (end = node + map->size; node < end; ++node) {
-        if (var_isstr(&node->key) && node->value.v.i == index) {
-            return node->key.v.s;
+        if (var_isstr(&node->key) && var_toint(&node->value) == index) {
+            return var_tostr(&node->key);
         }
     }
     return NULL;
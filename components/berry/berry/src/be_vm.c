@@ -21,6 +21,7 @@
 #include "be_exec.h"
 #include "be_debug.h"
 #include "be_libs.h"
+#include "be_parser.h"
 #include <string.h>
 #include <math.h>
 
@@ -34,9 +35,10 @@
 #define RKC()  ((isKC(ins) ? ktab : reg) + KR2idx(IGET_RKC(ins)))  /* Get value of register or constant C */
 
 #define var2cl(_v)          cast(bclosure*, var_toobj(_v))  /* cast var to closure */
-#define var2real(_v)        (var_isreal(_v) ? (_v)->v.r : (breal)(_v)->v.i)  /* get var as real or convert to real if integer */
+#define var2real(_v)        (var_isreal(_v) ? var_toreal(_v) : (breal)var_toint(_v))  /* get var as real or convert to real if integer */
 #define val2bool(v)         ((v) ? btrue : bfalse)  /* get var as bool (trur if non zero) */
-#define ibinop(op, a, b)    ((a)->v.i op (b)->v.i)  /* apply binary operator to both arguments as integers */
+#define ibinop(op, a, b)    (var_toint(a) op var_toint(b))  /* apply binary operator to both arguments as integers */
+#define iwrapop(op, a, b)   int_wrap(op, var_toint(a), var_toint(b))  /* same for `+`, `-` and `*`, wrap around on overflow */
 
 #if BE_USE_DEBUG_HOOK
   #define DEBUG_HOOK() \
@@ -65,22 +67,45 @@
   #define VM_HEARTBEAT()
 #endif
 
-#define vm_exec_loop() \
+/* direct-threaded dispatch needs the "labels as values" extension */
+#if BE_USE_COMPUTED_GOTO && defined(__GNUC__)
+  #define VM_THREADED_DISPATCH  1
+#else
+  #define VM_THREADED_DISPATCH  0
+#endif
+
+#if VM_THREADED_DISPATCH
+  /* each handler jumps straight to the handler of the next instruction,
+   * the enabled hooks are replicated at the end of every handler */
+  #define vm_exec_loop() \
+    dispatch();
+
+  #define opcase(opcode)    op_##opcode
+  #define dispatch() { \
+        DEBUG_HOOK(); \
+        COUNTER_HOOK(); \
+        VM_HEARTBEAT(); \
+        ins = *vm->ip++; \
+        __extension__ ({ goto *disptab[IGET_OP(ins)]; }); \
+    }
+#else
+  #define vm_exec_loop() \
     loop: \
         DEBUG_HOOK(); \
         COUNTER_HOOK(); \
         VM_HEARTBEAT(); \
         switch (IGET_OP(ins = *vm->ip++))
 
+  #define opcase(opcode)    case OP_##opcode
+  #define dispatch()        goto loop
+#endif
+
 #if BE_USE_SINGLE_FLOAT
   #define mathfunc(func)    func##f
 #else
   #define mathfunc(func)    func
 #endif
 
-#define opcase(opcode)      case OP_##opcode
-#define dispatch()          goto loop
-
 #define equal_rule(op, iseq) \
     bbool res; \
     be_assert(!var_isstatic(a)); \
@@ -97,7 +122,7 @@
         } else if (var_isbool(a)) { /* bool op bool */ \
             res = var_tobool(a) op var_tobool(b); \
         } else if (var_isstr(a)) { /* string op string */ \
-            res = 1 op be_eqstr(a->v.s, b->v.s); \
+            res = 1 op be_eqstr(var_tostr(a), var_tostr(b)); \
         } else if (var_isclass(a) || var_isfunction(a) || var_iscomptr(a)) { \
             res = var_toobj(a) op var_toobj(b); \
         } else { \
@@ -139,12 +164,73 @@
         binop_error(vm, #op, a, b); \
     }
 
+/* Quickening: once the operand types of a generic instruction have been
+ * observed, the instruction is rewritten in place with a type-specialized
+ * opcode. A specialized handler checks its type guard and restores the
+ * generic opcode when the types change. Read-only protos are not rewritten. */
+#define quicken(_op) { \
+    if (!proto_isreadonly(clos->proto)) { \
+        vm->ip[-1] = (ins & ~IOP_MASK) | ISET_OP(OP_##_op); \
+    } \
+}
+
+#define deoptimize(_op) { \
+    ins = (ins & ~IOP_MASK) | ISET_OP(OP_##_op); \
+    vm->ip[-1] = ins; \
+    goto generic_##_op; /* the hooks already ran for this instruction */ \
+}
+
+#define quick_arith_ii(op, generic) \
+    bvalue *a = RKB(), *b = RKC(); \
+    if (var_isint(a) && var_isint(b)) { \
+        bvalue *dst = RA(); \
+        var_setint(dst, iwrapop(op, a, b)); \
+        dispatch(); \
+    } \
+    deoptimize(generic)
+
+#define quick_relop_ii(op, generic) \
+    bvalue *a = RKB(), *b = RKC(); \
+    if (var_isint(a) && var_isint(b)) { \
+        bvalue *dst = RA(); \
+        var_setbool(dst, ibinop(op, a, b)); \
+        dispatch(); \
+    } \
+    deoptimize(generic)
+
+/* relational opcodes, quickened when both operands are integers */
+#define relop_block(generic, func) \
+    bvalue *a = RKB(), *b = RKC(), *dst; \
+    if (var_isint(a) && var_isint(b)) { \
+        quicken(generic##_II); \
+    } \
+    bbool res = func(vm, a, b); \
+    reg = vm->reg; \
+    dst = RA(); \
+    var_setbool(dst, res)
+
+#if BE_USE_PRECOMPILED_OBJECT
+extern const bclass be_class_list;
+extern const bclass be_class_map;
+extern const bclass be_class_range;
+/* initialized instance of the built-in `list` class (not a subclass) */
+  #define is_list_instance(_v) \
+    (var_isinstance(_v) && \
+     be_instance_class(cast(binstance*, var_toobj(_v))) == &be_class_list && \
+     var_islist(be_instance_members(cast(binstance*, var_toobj(_v)))))
+#else
+  #define is_list_instance(_v)  bfalse
+#endif
+/* get the `blist` object of a `list` instance */
+#define instance_list(_v)   cast(blist*, var_toobj(be_instance_members(cast(binstance*, var_toobj(_v)))))
+
 #define push_native(_vm, _f, _ns, _t) { \
     precall(_vm, _f, _ns, _t); \
     _vm->cf->status = PRIM_FUNC; \
 }
 
 static void prep_closure(bvm *vm, int pos, int argc, int mode);
+static void tail_closure(bvm *vm, bvalue *func, int argc);
 
 static void attribute_error(bvm *vm, const char *t, bvalue *b, bvalue *c)
 {
@@ -220,6 +306,9 @@ static void precall(bvm *vm, bvalue *func, int nstack, int mode)
         be_stack_expansion(vm, expan);  /* expand stack (vector object), warning stack address changes */
         func = vm->stack + fpos;  /* recompute `func` address with new stack address */
     }
+    if (vm->cf == &vm->leafcf) {  /* a leaf native function calls back into the VM */
+        be_stack_push(vm, &vm->callstack, &vm->leafcf);  /* move its frame to the callstack */
+    }
     be_stack_push(vm, &vm->callstack, NULL);  /* push a NULL value on callstack */
     cf = be_stack_top(&vm->callstack);  /* get address of new callframe at top of callstack */
     cf->func = func - mode;
@@ -253,6 +342,38 @@ static void ret_native(bvm *vm)
     vm->cf = be_stack_top(&vm->callstack);
 }
 
+/* Call a leaf native function (BE_LEAF_FUNC). Leaf natives are not expected
+ * to call back into the VM, so they run in `vm->leafcf` instead of a frame
+ * pushed on the callstack: only the register window is moved to the arguments.
+ * If they still do (e.g. a destructor run by the GC), `precall()` moves the
+ * leaf frame to the callstack and it is popped as a regular native frame. */
+static void call_leaf(bvm *vm, bvalue *func, int argc, int mode)
+{
+    bcallframe *cf = &vm->leafcf;
+    bntvfunc f = var_tontvfunc(func);
+    int expan = argc + BE_STACK_FREE_MIN;
+    if (vm->stacktop < func + expan) {
+        size_t fpos = func - vm->stack;
+        be_stack_expansion(vm, expan);
+        func = vm->stack + fpos;
+    }
+    cf->func = func - mode;
+    cf->top = vm->top;
+    cf->reg = vm->reg;
+    cf->status = PRIM_FUNC;
+    vm->reg = func + 1;
+    vm->top = vm->reg + argc;
+    vm->cf = cf;
+    f(vm); /* call C primitive function */
+    if (vm->cf != cf) {  /* the frame was moved to the callstack */
+        ret_native(vm);
+        return;
+    }
+    vm->reg = cf->reg;
+    vm->top = cf->top;
+    vm->cf = be_stack_top(&vm->callstack);
+}
+
 static bbool obj2bool(bvm *vm, bvalue *var)
 {
     binstance *obj = var_toobj(var);
@@ -277,9 +398,9 @@ bbool be_value2bool(bvm *vm, bvalue *v)
     case BE_BOOL:
         return var_tobool(v);
     case BE_INT:
-        return val2bool(v->v.i);
+        return val2bool(var_toint(v));
     case BE_REAL:
-        return val2bool(v->v.r);
+        return val2bool(var_toreal(v));
     case BE_STRING:
         return str_len(var_tostr(v)) != 0;
     case BE_COMPTR:
@@ -304,10 +425,70 @@ static void obj_method(bvm *vm, bvalue *o, bstring *attr, bvalue *dst)
     }
 }
 
-static int obj_attribute(bvm *vm, bvalue *o, bstring *attr, bvalue *dst)
+#if BE_USE_INLINE_CACHE
+/* Returns true if `ins` looks up a member by a constant name */
+static bbool icache_site(binstruction ins)
+{
+    switch (IGET_OP(ins)) {
+    case OP_GETMBR: case OP_GETMET: case OP_GETSMBR: return isKC(ins);
+    case OP_SETMBR: case OP_SETSMBR: return isKB(ins);
+    default: return bfalse;
+    }
+}
+
+/* Allocate one inline cache per member instruction with a constant name,
+ * `icindex` maps each instruction to its cache */
+static void icache_alloc(bvm *vm, bproto *proto)
+{
+    int pc, n = 0;
+    size_t size;
+    for (pc = 0; pc < proto->codesize; ++pc) {
+        n += icache_site(proto->code[pc]);
+    }
+    n = n < UINT16_MAX ? n : UINT16_MAX; /* the last sites are not cached */
+    size = n * sizeof(bicache) + proto->codesize * sizeof(uint16_t);
+    proto->icache = be_malloc(vm, size);
+    memset(proto->icache, 0, size);
+    proto->icindex = (uint16_t*)(proto->icache + n);
+    proto->nicache = n;
+    for (pc = 0, n = 0; pc < proto->codesize && n < proto->nicache; ++pc) {
+        if (icache_site(proto->code[pc])) {
+            proto->icindex[pc] = (uint16_t)++n;
+        }
+    }
+}
+
+/* Get the inline cache of the instruction at `ip`, the caches are allocated on first use */
+/* Returns NULL for read-only (solidified) protos and for the names held in registers */
+static bicache* proto_icache(bvm *vm, bproto *proto, binstruction *ip)
+{
+    int idx;
+    if (proto->icache == NULL) {
+        if (gc_isconst(proto)) {
+            return NULL;
+        }
+        icache_alloc(vm, proto);
+    }
+    idx = proto->icindex[ip - proto->code];
+    return idx ? proto->icache + idx - 1 : NULL;
+}
+
+  #define ICACHE()          proto_icache(vm, clos->proto, vm->ip - 1)
+#else
+  #define ICACHE()          NULL
+#endif
+
+/* `ic` is the inline cache of the instruction, or NULL if not cacheable */
+static int obj_attribute(bvm *vm, bicache *ic, bvalue *o, bstring *attr, bvalue *dst)
 {
     binstance *obj = var_toobj(o);
+#if BE_USE_INLINE_CACHE
+    int type = ic ? be_instance_member_cached(vm, ic, obj, attr, dst)
+                  : be_instance_member(vm, obj, attr, dst);
+#else
     int type = be_instance_member(vm, obj, attr, dst);
+    (void)ic;
+#endif
     if (type == BE_NONE) {
         vm_error(vm, "attribute_error",
             "the '%s' object has no attribute '%s'",
@@ -316,6 +497,19 @@ static int obj_attribute(bvm *vm, bvalue *o, bstring *attr, bvalue *dst)
     return type;
 }
 
+/* `ic` is the inline cache of the instruction, or NULL if not cacheable */
+static bbool obj_setmember(bvm *vm, bicache *ic, binstance *obj, bstring *attr, bvalue *src)
+{
+#if BE_USE_INLINE_CACHE
+    if (ic) {
+        return be_instance_setmember_cached(vm, ic, obj, attr, src);
+    }
+#else
+    (void)ic;
+#endif
+    return be_instance_setmember(vm, obj, attr, src);
+}
+
 static int class_attribute(bvm *vm, bvalue *o, bvalue *c, bvalue *dst)
 {
     bstring *attr = var_tostr(c);
@@ -421,6 +615,25 @@ bbool be_vm_isge(bvm *vm, bvalue *a, bvalue *b)
     relop_rule(>=);
 }
 
+/* map a type-specialized instruction back to its generic form, the
+ * specialized opcodes are never saved, solidified or printed */
+binstruction be_vm_unquicken(binstruction ins)
+{
+    bopcode op;
+    switch (IGET_OP(ins)) {
+    case OP_ADD_II: case OP_ADD_RR: op = OP_ADD; break;
+    case OP_SUB_II: op = OP_SUB; break;
+    case OP_LT_II: op = OP_LT; break;
+    case OP_LE_II: op = OP_LE; break;
+    case OP_GT_II: op = OP_GT; break;
+    case OP_GE_II: op = OP_GE; break;
+    case OP_GETIDX_LI: op = OP_GETIDX; break;
+    case OP_SETIDX_LI: op = OP_SETIDX; break;
+    default: return ins;
+    }
+    return (ins & ~IOP_MASK) | ISET_OP(op);
+}
+
 static void make_range(bvm *vm, bvalue lower, bvalue upper)
 {
     /* get method 'item' (possible GC) */
@@ -434,6 +647,50 @@ static void make_range(bvm *vm, bvalue lower, bvalue upper)
     vm->top -= 3;
 }
 
+/* Prepare the iteration state of the iterable in register `base` for
+ * FORLOOP (possible GC). Integer ranges, lists and maps are iterated
+ * natively, R(base) holds the next value and R(base+1) the upper bound for
+ * a range, or R(base) holds the instance and R(base+1) the position in it.
+ * Any other iterable is replaced by its `iter()` closure. */
+static void for_prepare(bvm *vm, int base)
+{
+    bvalue *it = vm->reg + base, *top = vm->top;
+    if (var_isinstance(it)) {
+        binstance *obj = var_toobj(it);
+#if BE_USE_PRECOMPILED_OBJECT
+        bclass *c = be_instance_class(obj);
+        if (c == &be_class_range) {
+            bvalue lower, upper;
+            be_instance_member(vm, obj, str_literal(vm, "__lower__"), &lower);
+            be_instance_member(vm, obj, str_literal(vm, "__upper__"), &upper);
+            if (var_isint(&lower) && var_isint(&upper)) {
+                it[0] = lower;
+                it[1] = upper;
+                return;
+            }
+        } else if ((c == &be_class_list && var_islist(be_instance_members(obj))) ||
+                   (c == &be_class_map && var_ismap(be_instance_members(obj)))) {
+            var_setint(it + 1, 0); /* start position */
+            return;
+        }
+#endif
+        /* .it = iterable.iter() */
+        if (basetype(be_instance_member(vm, obj, str_literal(vm, "iter"), top)) == BE_FUNCTION) {
+            top[1] = *it; /* move self to argv[0] */
+            vm->top += 2; /* prevent collection results */
+            be_dofunc(vm, top, 1); /* call method 'iter' */
+            vm->top -= 2;
+            it = vm->reg + base;
+            *it = *vm->top;
+        } else {
+            var_setnil(it);
+        }
+    } else if (var_basetype(it) != BE_FUNCTION) {
+        var_setnil(it); /* not iterable, fails when called */
+    }
+    var_setnil(it + 1);
+}
+
 static void connect_str(bvm *vm, bstring *a, bvalue *b)
 {
     bstring *s;
@@ -448,6 +705,30 @@ static void connect_str(bvm *vm, bstring *a, bvalue *b)
         var_setstr(b, s);
         vm->top -= 1;
     }
+    vm->catstr = s;
+}
+
+/* Same as connect_str() for APPEND: `a` is only referenced by the register
+ * of the instruction, it is extended in place when it is still the string
+ * created by the previous `..`. Otherwise (e.g. it was returned by a `..`
+ * method) it may be shared and is copied. */
+static void append_str(bvm *vm, bstring *a, bvalue *b)
+{
+    bstring *s;
+    int conv = !var_isstr(b);
+    if (conv) {
+        *vm->top++ = *b;
+        be_val2str(vm, -1); /* may run code that changes `vm->catstr` */
+        b = vm->top - 1;
+    }
+    if (a == vm->catstr) {
+        s = be_strappend(vm, a, str(var_tostr(b)), str_len(var_tostr(b)));
+    } else {
+        s = be_strcat(vm, a, var_tostr(b));
+    }
+    vm->top -= conv;
+    var_setstr(vm->top, s);
+    vm->catstr = s;
 }
 
 BERRY_API bvm* be_vm_new(void)
@@ -455,11 +736,16 @@ BERRY_API bvm* be_vm_new(void)
     bvm *vm = be_os_malloc(sizeof(bvm));
     be_assert(vm != NULL);
     memset(vm, 0, sizeof(bvm)); /* clear all members */
+#if BE_USE_DEBUG_HOOK
+    var_setnil(&vm->hook); /* a zeroed value is not nil with NaN-boxing */
+#endif
+#if BE_USE_INLINE_CACHE
+    vm->icepoch = 0; /* must be set before any class is created */
+#endif
     be_gc_init(vm);
     be_string_init(vm);
     be_stack_init(vm, &vm->callstack, sizeof(bcallframe));
     be_stack_init(vm, &vm->refstack, sizeof(binstance*));
-    be_stack_init(vm, &vm->exceptstack, sizeof(struct bexecptframe));
     be_stack_init(vm, &vm->tracestack, sizeof(bcallsnapshot));
     vm->stack = be_malloc(vm, sizeof(bvalue) * BE_STACK_START);
     vm->stacktop = vm->stack + BE_STACK_START;
@@ -491,7 +777,6 @@ BERRY_API void be_vm_delete(bvm *vm)
     be_string_deleteall(vm);
     be_stack_delete(vm, &vm->callstack);
     be_stack_delete(vm, &vm->refstack);
-    be_stack_delete(vm, &vm->exceptstack);
     be_stack_delete(vm, &vm->tracestack);
     be_free(vm, vm->stack, (vm->stacktop - vm->stack) * sizeof(bvalue));
     be_globalvar_deinit(vm);
@@ -510,6 +795,18 @@ static void vm_exec(bvm *vm)
     bclosure *clos;
     bvalue *ktab, *reg;
     binstruction ins;
+    /* recovery point of the `try` blocks of the frames run by this call,
+     * it is set by the first EXBLK and is active while `vm->errjmp` is it */
+    struct blongjmp errjmp;
+    int depth = be_stack_count(&vm->callstack) - 1; /* index of the entry frame */
+    int refcount = vm->refstack.count;
+#if VM_THREADED_DISPATCH
+    static const void* const disptab[] = { /* handler of each opcode */
+        #define OPCODE(opc) __extension__ &&op_##opc
+        #include "be_opcodes.h"
+        #undef OPCODE
+    };
+#endif
     vm->cf->status |= BASE_FRAME;
 newframe: /* a new call frame */
     be_assert(var_isclosure(vm->cf->func));
@@ -576,6 +873,71 @@ newframe: /* a new call frame */
             }
             dispatch();
         }
+        opcase(FORPREP): {
+            bvalue *a = RA(), *b = RKB(), *c = RKC();
+            if (b != a || c != a) { /* iterate over `RK(B) .. RK(C)` */
+                if (var_isint(b) && var_isint(c)) {
+                    bvalue lower = *b, upper = *c;
+                    a[0] = lower;
+                    a[1] = upper;
+                    dispatch();
+                }
+                if (var_isstr(b)) {
+                    connect_str(vm, var_tostr(b), c);
+                } else if (var_isinstance(b)) {
+                    object_binop(vm, "..", *b, *c);
+                } else {
+                    binop_error(vm, "..", b, c);
+                }
+                reg = vm->reg;
+                *RA() = *vm->top; /* copy result to R(A) */
+            }
+            for_prepare(vm, IGET_RA(ins));
+            reg = vm->reg;
+            dispatch();
+        }
+        opcase(FORLOOP): {
+            bvalue *a = RA();
+            if (var_isint(a)) { /* integer range */
+                bint i = var_toint(a);
+                if (i > var_toint(a + 1)) {
+                    vm->ip += IGET_sBx(ins); /* leave the loop */
+                    dispatch();
+                }
+                var_setint(a + 2, i);
+                var_setint(a, i + 1);
+                dispatch();
+            }
+            if (var_isinstance(a) && var_isint(a + 1)) { /* `list` or `map` */
+                bvalue *members = be_instance_members(cast(binstance*, var_toobj(a)));
+                int pos = var_toidx(a + 1);
+                if (var_islist(members)) {
+                    blist *list = var_toobj(members);
+                    if (pos < be_list_count(list)) {
+                        a[2] = *be_list_at(list, pos);
+                        var_setint(a + 1, pos + 1);
+                        dispatch();
+                    }
+                } else if (var_ismap(members)) {
+                    bmap *map = var_toobj(members);
+                    if (pos <= map->size) {
+                        bmapiter iter = pos ? map->slots + pos - 1 : be_map_iter();
+                        bmapnode *node = be_map_next(map, &iter);
+                        if (node) {
+                            a[2] = node->value;
+                            var_setint(a + 1, cast_int(iter - map->slots) + 1);
+                            dispatch();
+                        }
+                    }
+                }
+                vm->ip += IGET_sBx(ins); /* leave the loop */
+                dispatch();
+            }
+            /* itvar = .it() */
+            a[2] = a[0];
+            ins = ISET_OP(OP_CALL) | ISET_RA(IGET_RA(ins) + 2);
+            goto callins;
+        }
         opcase(SETGBL): {
             bvalue *v = RA();
             int idx = IGET_Bx(ins);
@@ -594,6 +956,7 @@ newframe: /* a new call frame */
             int idx = IGET_Bx(ins);
             be_assert(*clos->upvals != NULL);
             *clos->upvals[idx]->value = *v;
+            be_gc_barriervar(vm, v);
             dispatch();
         }
         opcase(MOVE): {
@@ -601,12 +964,17 @@ newframe: /* a new call frame */
             *dst = *RKB();
             dispatch();
         }
-        opcase(ADD): {
+        opcase(ADD):
+        generic_ADD: {
             bvalue *dst = RA(), *a = RKB(), *b = RKC();
             if (var_isint(a) && var_isint(b)) {
-                var_setint(dst, ibinop(+, a, b));
+                quicken(ADD_II);
+                var_setint(dst, iwrapop(+, a, b));
             } else if (var_isnumber(a) && var_isnumber(b)) {
                 breal x = var2real(a), y = var2real(b);
+                if (var_isreal(a) && var_isreal(b)) {
+                    quicken(ADD_RR);
+                }
                 var_setreal(dst, x + y);
             } else if (var_isstr(a) && var_isstr(b)) { /* strcat */
                 bstring *s = be_strcat(vm, var_tostr(a), var_tostr(b));
@@ -620,10 +988,12 @@ newframe: /* a new call frame */
             }
             dispatch();
         }
-        opcase(SUB): {
+        opcase(SUB):
+        generic_SUB: {
             bvalue *dst = RA(), *a = RKB(), *b = RKC();
             if (var_isint(a) && var_isint(b)) {
-                var_setint(dst, ibinop(-, a, b));
+                quicken(SUB_II);
+                var_setint(dst, iwrapop(-, a, b));
             } else if (var_isnumber(a) && var_isnumber(b)) {
                 breal x = var2real(a), y = var2real(b);
                 var_setreal(dst, x - y);
@@ -637,7 +1007,7 @@ newframe: /* a new call frame */
         opcase(MUL): {
             bvalue *dst = RA(), *a = RKB(), *b = RKC();
             if (var_isint(a) && var_isint(b)) {
-                var_setint(dst, ibinop(*, a, b));
+                var_setint(dst, iwrapop(*, a, b));
             } else if (var_isnumber(a) && var_isnumber(b)) {
                 breal x = var2real(a), y = var2real(b);
                 var_setreal(dst, x * y);
@@ -683,20 +1053,14 @@ newframe: /* a new call frame */
             }
             dispatch();
         }
-        opcase(LT): {
-            bbool res = be_vm_islt(vm, RKB(), RKC());
-            bvalue *dst;
-            reg = vm->reg;
-            dst = RA();
-            var_setbool(dst, res);
+        opcase(LT):
+        generic_LT: {
+            relop_block(LT, be_vm_islt);
             dispatch();
         }
-        opcase(LE): {
-            bbool res = be_vm_isle(vm, RKB(), RKC());
-            bvalue *dst;
-            reg = vm->reg;
-            dst = RA();
-            var_setbool(dst, res);
+        opcase(LE):
+        generic_LE: {
+            relop_block(LE, be_vm_isle);
             dispatch();
         }
         opcase(EQ): {
@@ -715,30 +1079,27 @@ newframe: /* a new call frame */
             var_setbool(dst, res);
             dispatch();
         }
-        opcase(GT): {
-            bbool res = be_vm_isgt(vm, RKB(), RKC());
-            bvalue *dst;
-            reg = vm->reg;
-            dst = RA();
-            var_setbool(dst, res);
+        opcase(GT):
+        generic_GT: {
+            relop_block(GT, be_vm_isgt);
             dispatch();
         }
-        opcase(GE): {
-            bbool res = be_vm_isge(vm, RKB(), RKC());
-            bvalue *dst;
-            reg = vm->reg;
-            dst = RA();
-            var_setbool(dst, res);
+        opcase(GE):
+        generic_GE: {
+            relop_block(GE, be_vm_isge);
             dispatch();
         }
-        opcase(CONNECT): {
+        opcase(CONNECT):
+        connectins: {
             bvalue *a = RKB(), *b = RKC();
             if (var_isint(a) && var_isint(b)) {
                 make_range(vm, *RKB(), *RKC());
+                vm->catstr = NULL;
             } else if (var_isstr(a)) {
                 connect_str(vm, var_tostr(a), b);
             } else if (var_isinstance(a)) {
                 object_binop(vm, "..", *RKB(), *RKC());
+                vm->catstr = NULL;
             } else {
                 binop_error(vm, "..", RKB(), RKC());
             }
@@ -746,6 +1107,16 @@ newframe: /* a new call frame */
             *RA() = *vm->top; /* copy result to R(A) */
             dispatch();
         }
+        opcase(APPEND): {
+            bvalue *a = RA();
+            if (!var_isstr(a)) {
+                goto connectins; /* same as CONNECT, B == A */
+            }
+            append_str(vm, var_tostr(a), RKC());
+            reg = vm->reg;
+            *RA() = *vm->top; /* copy result to R(A) */
+            dispatch();
+        }
         opcase(AND): {
             bitwise_block(&);
             dispatch();
@@ -769,9 +1140,9 @@ newframe: /* a new call frame */
         opcase(NEG): {
             bvalue *dst = RA(), *a = RKB();
             if (var_isint(a)) {
-                var_setint(dst, -a->v.i);
+                var_setint(dst, int_wrap(-, 0, var_toint(a)));
             } else if (var_isreal(a)) {
-                var_setreal(dst, -a->v.r);
+                var_setreal(dst, -var_toreal(a));
             } else if (var_isinstance(a)) {
                 ins_unop(vm, "-*", *RKB());
                 reg = vm->reg;
@@ -784,7 +1155,7 @@ newframe: /* a new call frame */
         opcase(FLIP): {
             bvalue *dst = RA(), *a = RKB();
             if (var_isint(a)) {
-                var_setint(dst, ~a->v.i);
+                var_setint(dst, ~var_toint(a));
             } else if (var_isinstance(a)) {
                 ins_unop(vm, "~", *RKB());
                 reg = vm->reg;
@@ -826,14 +1197,47 @@ newframe: /* a new call frame */
             be_class_upvalue_init(vm, c);
             dispatch();
         }
-        opcase(GETMBR): {
+        opcase(GETSMBR): {
+            bvalue *self = reg;
+            if (var_isinstance(self)) {
+                binstance *obj = var_toobj(self);
+                if (obj->_class == clos->proto->cls) {
+#if BE_USE_PERF_COUNTERS
+                    vm->counter_get++;
+#endif
+                    *RA() = obj->members[IGET_RKB(ins)];
+                    dispatch();
+                }
+            }
+            /* `self` is an instance of a subclass: look the member up by name */
+            ins = (ins & ~(IOP_MASK | IRKB_MASK)) | ISET_OP(OP_GETMBR) | ISET_RKB(0);
+            goto getmbr;
+        }
+        opcase(COMPILE): { /* first call of a function compiled lazily */
+#if BE_USE_SCRIPT_COMPILER
+            bproto *proto = clos->proto;
+            be_parser_lazy(vm, proto); /* syntax errors are raised at the call */
+            be_stack_require(vm, proto->nstack + BE_STACK_FREE_MIN);
+            vm->top = vm->reg + proto->nstack;
+            vm->ip = proto->code; /* restart with the compiled body */
+#if BE_USE_DEBUG_HOOK
+            vm->cf->lineinfo = proto->lineinfo;
+#endif
+            goto newframe;
+#else
+            be_assert(0); /* only the compiler creates lazy functions */
+            dispatch();
+#endif
+        }
+        opcase(GETMBR):
+        getmbr: {
 #if BE_USE_PERF_COUNTERS
             vm->counter_get++;
 #endif
             bvalue result;  /* copy result to a temp variable because the stack may be relocated in virtual member calls */
             bvalue *b = RKB(), *c = RKC();
             if (var_isinstance(b) && var_isstr(c)) {
-                obj_attribute(vm, b, var_tostr(c), &result);
+                obj_attribute(vm, ICACHE(), b, var_tostr(c), &result);
                 reg = vm->reg;
             } else if (var_isclass(b) && var_isstr(c)) {
                 class_attribute(vm, b, c, &result);
@@ -857,7 +1261,7 @@ newframe: /* a new call frame */
             bvalue *b = RKB(), *c = RKC();
             if (var_isinstance(b) && var_isstr(c)) {
                 binstance *obj = var_toobj(b);
-                int type = obj_attribute(vm, b, var_tostr(c), &result);
+                int type = obj_attribute(vm, ICACHE(), b, var_tostr(c), &result);
                 reg = vm->reg;
                 bvalue *a = RA();
                 *a = result;
@@ -901,7 +1305,29 @@ newframe: /* a new call frame */
             }
             dispatch();
         }
-        opcase(SETMBR): {
+        opcase(SETSMBR): {
+            bvalue *self = reg;
+            if (var_isinstance(self)) {
+                binstance *obj = var_toobj(self);
+                if (obj->_class == clos->proto->cls) {
+                    bvalue *dst = obj->members + IGET_RA(ins);
+#if BE_USE_PERF_COUNTERS
+                    vm->counter_set++;
+#endif
+                    *dst = *RKC();
+                    if (var_isfunction(dst)) {
+                        var_markstatic(dst);
+                    }
+                    be_gc_barrier(vm, obj);
+                    dispatch();
+                }
+            }
+            /* `self` is an instance of a subclass: set the member by name */
+            ins = (ins & ~(IOP_MASK | IRA_MASK)) | ISET_OP(OP_SETMBR) | ISET_RA(0);
+            goto setmbr;
+        }
+        opcase(SETMBR):
+        setmbr: {
 #if BE_USE_PERF_COUNTERS
             vm->counter_set++;
 #endif
@@ -913,7 +1339,7 @@ newframe: /* a new call frame */
                 if (var_isfunction(&result)) {
                     var_markstatic(&result);
                 }
-                if (!be_instance_setmember(vm, obj, attr, &result)) {
+                if (!obj_setmember(vm, ICACHE(), obj, attr, &result)) {
                     reg = vm->reg;
                     vm_error(vm, "attribute_error",
                         "class '%s' cannot assign to attribute '%s'",
@@ -953,10 +1379,14 @@ newframe: /* a new call frame */
             attribute_error(vm, "writable attribute", a, b);
             dispatch();
         }
-        opcase(GETIDX): {
+        opcase(GETIDX):
+        generic_GETIDX: {
             bvalue *b = RKB(), *c = RKC();
             if (var_isinstance(b)) {
                 bvalue *top = vm->top;
+                if (is_list_instance(b) && var_isint(c)) {
+                    quicken(GETIDX_LI);
+                }
                 /* get method 'item' */
                 obj_method(vm, b, str_literal(vm, "item"), vm->top);
                 top[1] = *b; /* move object to argv[0] */
@@ -977,10 +1407,14 @@ newframe: /* a new call frame */
             }
             dispatch();
         }
-        opcase(SETIDX): {
+        opcase(SETIDX):
+        generic_SETIDX: {
             bvalue *a = RA(), *b = RKB(), *c = RKC();
             if (var_isinstance(a)) {
                 bvalue *top = vm->top;
+                if (is_list_instance(a) && var_isint(b)) {
+                    quicken(SETIDX_LI);
+                }
                 /* get method 'setitem' */
                 obj_method(vm, a, str_literal(vm, "setitem"), vm->top);
                 top[1] = *a; /* move object to argv[0] */
@@ -1002,7 +1436,11 @@ newframe: /* a new call frame */
             if (var_isclass(a) && var_isclass(b)) {
                 bclass *obj = var_toobj(a);
                 if (!gc_isconst(obj))  {
+#if BE_USE_INLINE_CACHE
+                   be_icache_invalidate(vm);
+#endif
                    be_class_setsuper(obj, var_toobj(b));
+                   be_gc_barrier(vm, obj);
                 } else {
                     vm_error(vm, "internal_error",
                     "cannot change superclass of a read-only class");
@@ -1076,25 +1514,27 @@ newframe: /* a new call frame */
 #if BE_USE_PERF_COUNTERS
             vm->counter_try++;
 #endif
-            if (!IGET_RA(ins)) {
-                be_except_block_setup(vm);
-                if (be_setjmp(vm->errjmp->b)) {
-                    bvalue *top = vm->top;
-                    bvalue e1 = top[0];
-                    bvalue e2 = top[1];
-                    be_except_block_resume(vm);
-                    top = vm->top;
-                    top[0] = e1;
-                    top[1] = e2;
+            if (!clos->proto->ntryranges) { /* code made before the ranges, e.g. by a stale solidifier */
+                vm_error(vm, "internal_error", "'try' block without range, solidify the function again");
+            }
+            if (vm->errjmp != &errjmp) { /* first `try` block of this call */
+                errjmp.status = 0;
+                errjmp.prev = vm->errjmp;
+                vm->errjmp = &errjmp;
+                if (be_setjmp(errjmp.b)) {
+                    if (errjmp.status != BE_EXCEPTION ||
+                        !be_except_block_resume(vm, depth, refcount)) {
+                        vm->errjmp = errjmp.prev; /* not catched in this call */
+                        be_throw(vm, errjmp.status);
+                    }
                     goto newframe;
                 }
-                reg = vm->reg;
-            } else {
-                be_except_block_close(vm, IGET_Bx(ins));
+                reg = vm->reg; /* `reg` is not kept across be_setjmp() */
             }
             dispatch();
         }
-        opcase(CALL): {
+        opcase(CALL):
+        callins: {
 #if BE_USE_PERF_COUNTERS
             vm->counter_call++;
 #endif
@@ -1124,6 +1564,11 @@ newframe: /* a new call frame */
                 goto recall; /* call '()' method */
             }
             case BE_CLOSURE: {
+                if (IGET_RKC(ins) && var == RA() && !mode && vm->cf->func + 1 == reg) {
+                    tail_closure(vm, var, argc); /* reuse the current frame */
+                    reg = vm->reg;
+                    goto newframe;
+                }
                 prep_closure(vm, var - reg, argc, mode);
                 reg = vm->reg;  /* `reg` has changed, now new base register */
                 goto newframe;  /* continue execution of the closure */
@@ -1142,6 +1587,9 @@ newframe: /* a new call frame */
                 ret_native(vm);
                 break;
             }
+            case BE_LEAF_FUNC:
+                call_leaf(vm, var, argc, mode);
+                break;
             case BE_CTYPE_FUNC: {
                 if (vm->ctypefunc) {
                     push_native(vm, var, argc, mode);
@@ -1186,6 +1634,9 @@ newframe: /* a new call frame */
             be_stack_pop(&vm->callstack); /* pop don't delete */
             if (cf->status & BASE_FRAME) { /* entrance function */
                 bstack *cs = &vm->callstack;
+                if (vm->errjmp == &errjmp) {
+                    vm->errjmp = errjmp.prev;
+                }
                 if (!be_stack_isempty(cs)) {
                     vm->cf = be_stack_top(cs);
                 }
@@ -1194,6 +1645,58 @@ newframe: /* a new call frame */
             vm->cf = be_stack_top(&vm->callstack);
             goto newframe;
         }
+        /* type-specialized opcodes */
+        opcase(ADD_II): {
+            quick_arith_ii(+, ADD);
+        }
+        opcase(SUB_II): {
+            quick_arith_ii(-, SUB);
+        }
+        opcase(LT_II): {
+            quick_relop_ii(<, LT);
+        }
+        opcase(LE_II): {
+            quick_relop_ii(<=, LE);
+        }
+        opcase(GT_II): {
+            quick_relop_ii(>, GT);
+        }
+        opcase(GE_II): {
+            quick_relop_ii(>=, GE);
+        }
+        opcase(ADD_RR): {
+            bvalue *a = RKB(), *b = RKC();
+            if (var_isreal(a) && var_isreal(b)) {
+                bvalue *dst = RA();
+                var_setreal(dst, var_toreal(a) + var_toreal(b));
+                dispatch();
+            }
+            deoptimize(ADD);
+        }
+        opcase(GETIDX_LI): {
+            bvalue *b = RKB(), *c = RKC();
+            if (is_list_instance(b) && var_isint(c)) {
+                bvalue *src = be_list_index(instance_list(b), var_toidx(c));
+                if (src) {
+                    *RA() = *src;
+                    dispatch();
+                }
+            }
+            deoptimize(GETIDX); /* also raises the index error */
+        }
+        opcase(SETIDX_LI): {
+            bvalue *a = RA(), *b = RKB();
+            if (is_list_instance(a) && var_isint(b)) {
+                blist *list = instance_list(a);
+                bvalue *dst = be_list_index(list, var_toidx(b));
+                if (dst) {
+                    *dst = *RKC();
+                    be_gc_barrier(vm, list);
+                    dispatch();
+                }
+            }
+            deoptimize(SETIDX); /* also raises the index error */
+        }
     }
 }
 
@@ -1223,6 +1726,27 @@ static void prep_closure(bvm *vm, int pos, int argc, int mode)
     }
 }
 
+/* Call the closure in `func` in place of the current call frame (tail
+ * call), the callee returns directly to the caller of the current frame */
+static void tail_closure(bvm *vm, bvalue *func, int argc)
+{
+    bcallframe *cf = vm->cf;
+    bvalue *base = cf->func;
+    int i, status = cf->status;
+#if BE_USE_DEBUG_HOOK
+    be_callhook(vm, BE_HOOK_RET);
+#endif
+    for (i = 0; i <= argc; ++i) { /* move function and arguments down */
+        base[i] = func[i];
+    }
+    vm->reg = cf->reg;
+    vm->top = cf->top;
+    vm->ip = cf->ip;
+    be_stack_pop(&vm->callstack); /* pop don't delete, `vm->cf` is set again below */
+    prep_closure(vm, cast_int(base - vm->reg), argc, 0);
+    vm->cf->status = status; /* keep BASE_FRAME */
+}
+
 static void do_closure(bvm *vm, int pos, int argc)
 {
     // bvalue *v, *end;
@@ -1284,7 +1808,7 @@ void be_dofunc(bvm *vm, bvalue *v, int argc)
     case BE_CLASS: do_class(vm, pos, argc); break;
     case BE_CLOSURE: do_closure(vm, pos, argc); break;
     case BE_NTVCLOS: do_ntvclos(vm, pos, argc); break;
-    case BE_NTVFUNC: do_ntvfunc(vm, pos, argc); break;
+    case BE_NTVFUNC: case BE_LEAF_FUNC: do_ntvfunc(vm, pos, argc); break;
     case BE_CTYPE_FUNC: do_cfunc(vm, pos, argc); break;
     default: call_error(vm, v);
     }
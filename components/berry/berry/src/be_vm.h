@@ -9,6 +9,8 @@
 #define BE_VM_H
 
 #include "be_object.h"
+#include "be_mem.h"
+#include "be_gc.h"
 
 #define comp_is_named_gbl(vm)       ((vm)->compopt & (1<<COMP_NAMED_GBL))
 #define comp_set_named_gbl(vm)      ((vm)->compopt |= (1<<COMP_NAMED_GBL))
@@ -18,10 +20,23 @@
 #define comp_set_strict(vm)      ((vm)->compopt |= (1<<COMP_STRICT))
 #define comp_clear_strict(vm)    ((vm)->compopt &= ~(1<<COMP_STRICT))
 
+#define comp_is_optimize(vm)       ((vm)->compopt & (1<<COMP_OPTIMIZE))
+#define comp_set_optimize(vm)      ((vm)->compopt |= (1<<COMP_OPTIMIZE))
+#define comp_clear_optimize(vm)    ((vm)->compopt &= ~(1<<COMP_OPTIMIZE))
+
+#define comp_is_lazy(vm)       ((vm)->compopt & (1<<COMP_LAZY))
+#define comp_set_lazy(vm)      ((vm)->compopt |= (1<<COMP_LAZY))
+#define comp_clear_lazy(vm)    ((vm)->compopt &= ~(1<<COMP_LAZY))
+
+/* drop every inline cache entry, to be called when a class layout changes */
+#define be_icache_invalidate(vm)    ((vm)->icepoch++)
+
 /* Compilation options */
 typedef enum {
     COMP_NAMED_GBL = 0x00, /* compile with named globals */
     COMP_STRICT = 0x01, /* compile with named globals */
+    COMP_OPTIMIZE = 0x02, /* run the peephole optimiser on the compiled code */
+    COMP_LAZY = 0x03, /* compile the body of nested functions on their first call */
 } compoptmask;
 
 typedef struct {
@@ -33,6 +48,12 @@ typedef struct {
         bmap *vtab; /* built-in variable index table */
         bvector vlist; /* built-in variable list */
     } builtin;
+#if BE_GLOBAL_CACHE_SIZE
+    struct {
+        bstring *name;
+        int idx;
+    } cache[BE_GLOBAL_CACHE_SIZE]; /* direct-mapped name to index cache */
+#endif
 } bglobaldesc;
 
 typedef struct {
@@ -46,18 +67,58 @@ typedef struct {
     int status;
 } bcallframe;
 
-struct gc16_t;           /* memory pool for 0-16 bytes or less objects */
-struct gc32_t;           /* memory pool for 17-32 bytes */
+struct bslab;            /* block of slots of a memory pool, see be_mem.c */
+struct bmempool {
+    void *free; /* the free slots */
+    struct bslab *slabs; /* the slabs of the pool */
+    size_t nslabs; /* the count of slabs */
+    size_t used; /* the count of allocated slots */
+};
+
+/* the measures and settings of the pacing of the major cycles, a period
+ * runs from the end of a cycle to the end of the next one */
+struct bgcpace {
+    bgcpacer pacer; /* computes the threshold of the next cycle, see be_gc_pace() */
+    size_t limit; /* the target ceiling of the memory in use, 0 if none */
+    size_t live; /* memory in use at the end of the last cycle */
+    size_t allocated; /* bytes allocated in the last period */
+    size_t cyclealloc; /* bytes allocated during the last cycle */
+    size_t start; /* memory in use at the start of the current cycle */
+    size_t freed; /* bytes freed in the current period */
+    size_t startfreed; /* bytes freed in the current period before the start of the cycle */
+    unsigned long clock; /* clock at the start of the current period */
+    unsigned long elapsed; /* duration of the last period */
+    unsigned long gctime; /* time spent by the GC in the last period */
+    unsigned long maxpause; /* longest pause measured in the last period */
+    unsigned long curgctime; /* time spent by the GC in the current period */
+    unsigned long curmaxpause; /* longest pause measured in the current period */
+    unsigned int survival; /* allocation of the last period in use at the start of the cycle (per mille) */
+    unsigned int steps; /* count of the incremental steps, some of them are timed */
+    bbyte cpushare; /* the maximum share of the time spent by the GC (percentage), 0 for none */
+};
+
 struct bgc {
     bgcobject *list; /* the GC-object list */
     bgcobject *gray; /* the gray object list */
+    bgcobject *grayagain; /* objects changed after their scan, scanned again by the atomic phase */
+    bgcobject **sweep; /* link to the next object of the current cycle to sweep */
+    bgcobject *cursor; /* next object of the fixed objects search or of the destructor calls */
     bgcobject *fixed; /* the fixed objecct list  */
-    struct gc16_t* pool16;
-    struct gc32_t* pool32;
+    bvector remembered; /* old objects changed since the last major cycle */
+    bvector youngstr; /* young short strings, swept by the minor collections */
+    struct bmempool pools[BE_MEM_POOLS]; /* memory pools by size class */
+    struct bgcpace pace; /* pacing of the major cycles */
     size_t usage; /* the count of bytes currently allocated */
     size_t threshold; /* he threshold of allocation for the next GC */
+    size_t stepsize; /* work done by an incremental step, see BE_GC_STEP_SIZE */
+    size_t nursery; /* allocation between two minor collections, see BE_GC_NURSERY_SIZE */
+    size_t minorthreshold; /* the threshold of allocation for the next minor collection */
+    int strpos; /* next list of the string table to sweep */
     bbyte steprate; /* the rate of increase in the distribution between two GCs (percentage) */
     bbyte status;
+    bbyte state; /* phase of the current cycle (bgcstate) */
+    bbyte promoteage; /* minor collections survived by the old objects, 0 if not generational */
+    bbyte youngref; /* the object scanned by a minor collection references young objects */
 };
 
 struct bstringtable {
@@ -91,8 +152,8 @@ struct bvm {
     bvalue *stacktop; /* stack top register */
     bupval *upvalist; /* open upvalue list */
     bstack callstack; /* function call stack */
-    bstack exceptstack; /* exception stack */
     bcallframe *cf; /* function call frame */
+    bcallframe leafcf; /* frame of the running leaf native function, not in callstack */
     bvalue *reg; /* function base register */
     bvalue *top; /* function top register */
     binstruction *ip; /* function instruction pointer */
@@ -105,7 +166,11 @@ struct bvm {
     struct bgc gc;
     bctypefunc ctypefunc; /* handler to ctype_func */
     bbyte compopt; /* compilation options */
+    bstring *catstr; /* string created by the last `..`, can still be appended in place by APPEND */
     bobshook obshook;
+#if BE_USE_INLINE_CACHE
+    uint32_t icepoch; /* inline cache epoch, entries filled with another epoch are stale */
+#endif
 #if BE_USE_PERF_COUNTERS
     uint32_t counter_ins; /* instructions counter */
     uint32_t counter_enter; /* counter for times the VM was entered */
@@ -116,6 +181,8 @@ struct bvm {
     uint32_t counter_exc; /* counter for raised exceptions */
     uint32_t counter_gc_kept; /* counter for objects scanned by last gc */
     uint32_t counter_gc_freed; /* counter for objects freed by last gc */
+    size_t gc_slots_used_before; /* memory pools slots used at the start of the last gc */
+    size_t gc_slots_allocated_before; /* memory pools slots allocated at the start of the last gc */
 #endif
 #if BE_USE_DEBUG_HOOK
     bvalue hook;
@@ -136,5 +203,6 @@ bbool be_vm_islt(bvm *vm, bvalue *a, bvalue *b);
 bbool be_vm_isle(bvm *vm, bvalue *a, bvalue *b);
 bbool be_vm_isgt(bvm *vm, bvalue *a, bvalue *b);
 bbool be_vm_isge(bvm *vm, bvalue *a, bvalue *b);
+binstruction be_vm_unquicken(binstruction ins);
 
 #endif
@@ -312,6 +312,14 @@ typedef bclass_ptr bclass_array[];              /* array of bclass* pointers, NU
 #else
   #define PROTO_VAR_INFO_BLOCK
 #endif
+#if BE_USE_INLINE_CACHE
+  #define PROTO_INLINE_CACHE_BLOCK\
+    NULL,     /* icache */    \
+    NULL,     /* icindex */   \
+    0,        /* nicache */
+#else
+  #define PROTO_INLINE_CACHE_BLOCK
+#endif
 
 /* define bproto */
 #define be_define_local_proto(_name, _nstack, _argc, _is_const, _is_subproto, _is_upval)     \
@@ -335,10 +343,19 @@ typedef bclass_ptr bclass_array[];              /* array of bclass* pointers, NU
     be_local_const_str(_name##_str_source),    /* source */                       \
     PROTO_RUNTIME_BLOCK                                                           \
     PROTO_VAR_INFO_BLOCK                                                          \
+    PROTO_INLINE_CACHE_BLOCK                                                      \
   }
 
-/* new version for more compact literals */
+/* new version for more compact literals, a function with `try` blocks needs
+ * be_nested_proto_try(): its code raises an `internal_error` otherwise */
 #define be_nested_proto(_nstack, _argc, _varg, _has_upval, _upvals, _has_subproto, _protos, _has_const, _ktab, _fname, _source, _code)     \
+  be_nested_proto_ex(_nstack, _argc, _varg, _has_upval, _upvals, _has_subproto, _protos, _has_const, _ktab, _fname, _source, _code, 0, NULL, NULL)
+
+/* same as be_nested_proto() for functions with `try` blocks */
+#define be_nested_proto_try(_nstack, _argc, _varg, _has_upval, _upvals, _has_subproto, _protos, _has_const, _ktab, _fname, _source, _code, _tryranges)     \
+  be_nested_proto_ex(_nstack, _argc, _varg, _has_upval, _upvals, _has_subproto, _protos, _has_const, _ktab, _fname, _source, _code, 1, _tryranges, NULL)
+
+#define be_nested_proto_ex(_nstack, _argc, _varg, _has_upval, _upvals, _has_subproto, _protos, _has_const, _ktab, _fname, _source, _code, _has_try, _tryranges, _cls)     \
   & (const bproto) {                                                              \
     NULL,                       /* bgcobject *next */                             \
     BE_PROTO,                   /* type BE_PROTO */                               \
@@ -359,6 +376,10 @@ typedef bclass_ptr bclass_array[];              /* array of bclass* pointers, NU
     ((bstring*) _source),        /* source */                                      \
     PROTO_RUNTIME_BLOCK                                                           \
     PROTO_VAR_INFO_BLOCK                                                          \
+    PROTO_INLINE_CACHE_BLOCK                                                      \
+    (btryrange*) _tryranges,    /* try blocks */                                  \
+    BE_IIF(_has_try)(sizeof(*_tryranges)/sizeof(btryrange),0),  /* ntryranges */  \
+    (struct bclass*) _cls,      /* class of a method */                           \
   }
 
 #define be_define_local_closure(_name)        \
@@ -417,6 +438,7 @@ enum beobshookevents {
   BE_OBS_GC_END,          /* end of GC, arg = allocated size */
   BE_OBS_VM_HEARTBEAT,    /* VM heartbeat called every million instructions */
   BE_OBS_STACK_RESIZE_START,    /* Berry stack resized */
+  BE_OBS_GC_MINOR,        /* end of a minor GC, args = allocated size before and after */
 };
 
 typedef int (*bctypefunc)(bvm*, const void*);
@@ -567,6 +589,10 @@ BERRY_API bctypefunc be_get_ctype_func_hanlder(bvm *vm);
 /* code load APIs */
 BERRY_API int be_loadbuffer(bvm *vm,
     const char *name, const char *buffer, size_t length);
+BERRY_API int be_loadbytecode(bvm *vm,
+    const char *name, const void *buffer, size_t length);
+BERRY_API int be_mapbytecode(bvm *vm,
+    const char *name, const void *image, size_t length);
 BERRY_API int be_loadmode(bvm *vm, const char *name, bbool islocal);
 BERRY_API int be_loadlib(bvm *vm, const char *path);
 BERRY_API int be_savecode(bvm *vm, const char *name);
@@ -107,7 +107,7 @@ static int32_t be_cb_add_handler(bvm *vm) {
     if (!elt) { be_throw(vm, BE_MALLOC_FAIL); }
 
     if (be_isgcobj(v)) {
-      be_gc_fix_set(vm, v->v.gc, btrue);    // mark the function as non-gc
+      be_gc_fix_set(vm, var_togc(v), btrue);    // mark the function as non-gc
     }
     elt->vm = vm;
     elt->f = *v;
@@ -189,12 +189,12 @@ static int32_t be_cb_gen_cb(bvm *vm) {
     // find first available slot
     int32_t slot;
     for (slot = 0; slot < BE_MAX_CB; slot++) {
-      if (be_cb_hooks[slot].f.type == BE_NIL) break;
+      if (be_cb_hooks[slot].vm == NULL) break;
     }
     bvalue *v = be_indexof(vm, 1);
     if (slot < BE_MAX_CB) {
       if (be_isgcobj(v)) {
-        be_gc_fix_set(vm, v->v.gc, btrue);    // mark the function as non-gc
+        be_gc_fix_set(vm, var_togc(v), btrue);    // mark the function as non-gc
       }
       // record pointers
       be_cb_hooks[slot].vm = vm;
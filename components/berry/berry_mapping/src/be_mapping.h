@@ -17,6 +17,14 @@
       bvaldata((const void*) &ctype_func_def##_f),                \
       BE_CTYPE_FUNC | BE_STATIC                                   \
   }
+#elif BE_USE_NAN_BOXING
+typedef const void* be_constptr;
+  #define be_const_ctype_func(_f) {                               \
+      .u = be_vbox(&ctype_func_def##_f, BE_CTYPE_FUNC)            \
+  }
+  #define be_const_static_ctype_func(_f) {                        \
+      .u = be_vbox(&ctype_func_def##_f, BE_CTYPE_FUNC | BE_STATIC) \
+  }
 #else // __cplusplus
 typedef const void* be_constptr;
   #define be_const_ctype_func(_f) {                               \
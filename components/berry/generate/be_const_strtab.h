@@ -16,6 +16,7 @@ extern const bcstring be_const_str_abs;
 extern const bcstring be_const_str_acos;
 extern const bcstring be_const_str_add;
 extern const bcstring be_const_str_add_handler;
+extern const bcstring be_const_str_append;
 extern const bcstring be_const_str_as;
 extern const bcstring be_const_str_asin;
 extern const bcstring be_const_str_assert;
@@ -142,6 +143,7 @@ extern const bcstring be_const_str_sqrt;
 extern const bcstring be_const_str_srand;
 extern const bcstring be_const_str_static;
 extern const bcstring be_const_str_str;
+extern const bcstring be_const_str_strbuilder;
 extern const bcstring be_const_str_super;
 extern const bcstring be_const_str_system;
 extern const bcstring be_const_str_tan;
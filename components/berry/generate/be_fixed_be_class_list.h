@@ -7,7 +7,7 @@ static be_define_const_map_slots(be_class_list_map) {
     { be_const_key(tostring, 2), be_const_func(m_tostring) },
     { be_const_key(pop, 6), be_const_func(m_pop) },
     { be_const_key(insert, -1), be_const_func(m_insert) },
-    { be_const_key(size, -1), be_const_func(m_size) },
+    { be_const_key(size, -1), be_const_leaf_func(m_size) },
     { be_const_key(remove, 12), be_const_func(m_remove) },
     { be_const_key(find, -1), be_const_func(m_find) },
     { be_const_key(push, 1), be_const_func(m_push) },
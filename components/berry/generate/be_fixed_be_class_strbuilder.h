@@ -0,0 +1,23 @@
+#include "be_constobj.h"
+
+static be_define_const_map_slots(be_class_strbuilder_map) {
+    { be_const_key(append, 4), be_const_func(m_append) },
+    { be_const_key(_X2E_X2E, -1), be_const_func(m_append) },
+    { be_const_key(init, -1), be_const_func(m_init) },
+    { be_const_key(tostring, -1), be_const_func(m_tostring) },
+    { be_const_key(_X2Ep, -1), be_const_var(0) },
+    { be_const_key(clear, 2), be_const_func(m_clear) },
+    { be_const_key(size, -1), be_const_leaf_func(m_size) },
+};
+
+static be_define_const_map(
+    be_class_strbuilder_map,
+    7
+);
+
+BE_EXPORT_VARIABLE be_define_const_class(
+    be_class_strbuilder,
+    1,
+    NULL,
+    strbuilder
+);
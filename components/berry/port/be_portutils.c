@@ -32,6 +32,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <time.h>
 
 #include "esp_heap_caps.h"
 #include "esp_chip_info.h"
@@ -86,6 +87,8 @@ int32_t callBerryEventDispatcher(bvm *vm, const char *type, const char *cmd, int
             be_pushstring(vm, cmd != NULL ? cmd : "");
             be_pushint(vm, idx);
             be_pushstring(vm, payload != NULL ? payload : "");  // empty json
+            // the temporaries of the handler are released when it returns
+            size_t scope = be_gc_scope_begin(vm);
             //BrTimeoutStart();
             if (data_len > 0) {
                 be_pushbytes(vm, payload, data_len); // if data_len is set, we also push raw bytes
@@ -95,6 +98,7 @@ int32_t callBerryEventDispatcher(bvm *vm, const char *type, const char *cmd, int
                 ret = be_pcall(vm, 5); // 5 arguments
             }
             //BrTimeoutReset();
+            be_gc_scope_end(vm, scope);
             if (ret != 0) {
                 be_error_pop_all(vm); // clear Berry stack
                 return ret;
@@ -126,8 +130,10 @@ void callBerryFastLoop(bvm *vm) {
     if (be_getglobal(vm, "custom")) {
         if (be_getmethod(vm, -1, "fast_loop")) {
             be_pushvalue(vm, -2); // add instance as first arg
+            size_t scope = be_gc_scope_begin(vm);
             //BrTimeoutStart();
             int32_t ret = be_pcall(vm, 1);
+            be_gc_scope_end(vm, scope);
             if (ret != 0) {
                 be_error_pop_all(vm); // clear Berry stack
             }
@@ -162,7 +168,6 @@ void BerryObservability(bvm *vm, int event, ...) {
     va_list param;
     va_start(param, event);
     static int32_t vm_usage = 0;
-    static uint32_t gc_time = 0;
 
     switch (event) {
         case BE_OBS_PCALL_ERROR: {  // error after be_pcall
@@ -178,26 +183,23 @@ void BerryObservability(bvm *vm, int event, ...) {
         __attribute__ ((fallthrough));
         //no break
         case BE_OBS_GC_START: {
-            gc_time = esp_timer_get_time() / 1000;
             vm_usage = va_arg(param, int32_t);
         }
             break;
         case BE_OBS_GC_END: {
             int32_t vm_usage2 = va_arg(param, int32_t);
-            uint32_t gc_elapsed = (esp_timer_get_time() / 1000) - gc_time;
+            // the cycle runs in steps between allocations: report the GC time the pacer
+            // measured since the previous cycle and the longest of its pauses
+            uint32_t gc_time = (uint32_t)((uint64_t)vm->gc.pace.gctime * 1000 / CLOCKS_PER_SEC);
+            uint32_t gc_maxpause = (uint32_t)((uint64_t)vm->gc.pace.maxpause * 1000000 / CLOCKS_PER_SEC);
             uint32_t vm_scanned = va_arg(param, uint32_t);
             uint32_t vm_freed = va_arg(param, uint32_t);
             size_t slots_used_before_gc = va_arg(param, size_t);
             size_t slots_allocated_before_gc = va_arg(param, size_t);
             size_t slots_used_after_gc = va_arg(param, size_t);
             size_t slots_allocated_after_gc = va_arg(param, size_t);
-            ESP_LOGI(TAG, "GC from %i to %i bytes, objects freed %i/%i (in %d ms) - slots from %i/%i to %i/%i", vm_usage, vm_usage2, vm_freed, vm_scanned,
-                    gc_elapsed, slots_used_before_gc, slots_allocated_before_gc, slots_used_after_gc, slots_allocated_after_gc);
-
-            // make new threshold tighter when we reach high memory usage
-            if (vm->gc.threshold > 20 * 1024) {
-                vm->gc.threshold = vm->gc.usage + 10 * 1024; // increase by only 10 KB
-            }
+            ESP_LOGI(TAG, "GC from %i to %i bytes, objects freed %i/%i (GC time %d ms, longest pause %d us) - slots from %i/%i to %i/%i", vm_usage, vm_usage2, vm_freed, vm_scanned,
+                    gc_time, gc_maxpause, slots_used_before_gc, slots_allocated_before_gc, slots_used_after_gc, slots_allocated_after_gc);
         }
             break;
         case BE_OBS_STACK_RESIZE_START: {
@@ -246,6 +248,8 @@ bool BerryInit(bvm **vm, char *berry_prog) {
 
     // Set the GC threshold to 3584 bytes to avoid the first useless GC
     (*vm)->gc.threshold = 3584;
+    // the GC paces the cycles to keep the VM within half of the free heap
+    be_gc_setpace(*vm, heap_caps_get_free_size(MALLOC_CAP_8BIT) / 2, BE_GC_CPU_SHARE);
 
     berry_init_ok = true;
 